@@ -11,6 +11,19 @@ sentences_file = "tmp/examples.utf.gz"
 if not os.path.exists(sentences_file):
 	download('ftp://ftp.monash.edu.au/pub/nihongo/examples.utf.gz', 'examples.utf.gz')
 
+def normalize_digits(string_line):
+	for i in range(43):
+		string_line = string_line.replace(chr(ord('０') + i), chr(ord('0') + i))
+	return string_line
+
+def sentence_texts():
+	""" Plain texts of all sentences, without parsing their words """
+	with gzip.open(sentences_file, 'rt') as f:
+		for string_line in f:
+			if string_line[0] == 'A':
+				string_line = normalize_digits(string_line)
+				yield string_line[3:string_line.index('\t')]
+
 Sentence = namedtuple('Sentence', 'text, words')
 Word = namedtuple('Word', 'dkanji, dreading, form, start_index')
 def parse(w, sentence_plain_text, minimal_start_index):
@@ -60,8 +73,7 @@ def corpus_reader():
 	#with io.StringIO(sample) as f, open('shit.log', 'w') as shit_of:
 		sentence_plain_text = None
 		for string_line in f:
-			for i in range(43):
-				string_line = string_line.replace(chr(ord('０') + i), chr(ord('0') + i))
+			string_line = normalize_digits(string_line)
 			if string_line[0] == 'A':
 				sentence_plain_text = string_line[3:string_line.index('\t')]
 				continue
@@ -7,7 +7,7 @@ import gzip
 import pickle
 import os
 
-from utils import download
+from utils import download, cached
 from index import index_keys
 
 class Kanji(namedtuple('Kanji', 'text, inf, common')):
@@ -189,8 +189,11 @@ def make_entry(elem, entities):
 
 	return entry
 
+def get_dictionary_path(dictionary='JMdict_e.gz'):
+	return download('http://ftp.monash.edu.au/pub/nihongo/' + dictionary, dictionary)
+
 def dictionary_reader(dictionary='JMdict_e.gz'):
-	dictionary_path = download('http://ftp.monash.edu.au/pub/nihongo/' + dictionary, dictionary)
+	dictionary_path = get_dictionary_path(dictionary)
 	entities = {}
 	with gzip.open(dictionary_path, 'rt') as f:
 		for l in f:
@@ -214,6 +217,13 @@ def dictionary_reader(dictionary='JMdict_e.gz'):
 		elif elem.tag in ('JMdict', 'JMnedict'):
 			elem.clear()
 
+def load_entries(dictionary='JMdict_e.gz'):
+	""" All entries of dictionary, parsed once per dictionary (and parser) version """
+	return cached(
+		f'parsed-{dictionary}', [get_dictionary_path(dictionary), __file__],
+		lambda: list(dictionary_reader(dictionary))
+	)
+
 IndexedDictionaryType = Dict[str, List[Entry]]
 def make_indexed_dictionary(
 		entries,
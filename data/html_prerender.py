@@ -0,0 +1,52 @@
+'''
+	Build-time counterpart of render_sense_group() from wasm/src/html_render.c.
+	When dictionary is prepared with --prerendered-html, definition part of every
+	line is stored as ready HTML, and engine only has to substitute review list
+	class toggles, marked with placeholder bytes below.
+'''
+
+import re
+
+# Replaced with ' rikaigu-hidden' when entry is NOT in review list
+HIDDEN_UNLESS_REVIEWED = '\x01'
+# Replaced with ' rikaigu-hidden' when entry is in review list
+HIDDEN_IF_REVIEWED = '\x02'
+
+# Must be kept in sync with wasm/src/names_types_mapping.c
+name_type_descriptions = {
+	'a': 'place',
+	'c': 'company',
+	'd': 'product',
+	'f': 'female given name or forename',
+	'g': 'given name or forename, gender not specified',
+	'm': 'male given name or forename',
+	'n': 'family or surname',
+	'o': 'organization',
+	'p': 'full name of a particular person',
+	's': 'railway station',
+	'u': 'unclassified name',
+	'w': 'work of art, literature, music, etc. name',
+}
+
+control_symbols = re.compile('[\t\n\x00-\x02]')
+def render_sense_group(types, senses):
+	parts = ['<span class="w-pos">', ', '.join(types), '</span>']
+	if len(senses) == 0:
+		return ''.join(parts)
+
+	parts.append(f'<span class="rikaigu-review-listed{HIDDEN_UNLESS_REVIEWED}">; </span>')
+	if len(senses) > 1:
+		parts.append(f'<ul class="w-def rikaigu-review-listed{HIDDEN_IF_REVIEWED}"><li>')
+		parts.append('</li><li>'.join(senses))
+		parts.append('</li></ul>')
+	else:
+		parts.append(f' <span class="w-def rikaigu-review-listed{HIDDEN_IF_REVIEWED}">')
+		parts.append(senses[0])
+		parts.append('</span><br />')
+
+	res = ''.join(parts)
+	assert control_symbols.search(res.replace(HIDDEN_UNLESS_REVIEWED, '').replace(HIDDEN_IF_REVIEWED, '')) is None
+	return res
+
+def render_name_types(type_keys):
+	return [name_type_descriptions[k] for k in type_keys]
@@ -0,0 +1,121 @@
+"""
+Orders dictionary lines, so entries looked up together share LZ4 chunks.
+
+Lookup trace is replayed from example sentences (see corpus.py): every
+Japanese character of a sentence is hovered, and every entry which index
+has for a prefix of the text from there is fetched, so the engine
+decompresses chunks of all of them. Deinflection isn't replayed, only
+exact (hiragana converted) keys.
+"""
+
+import itertools
+from collections import defaultdict, Counter
+
+from utils import kata_to_hira, is_japanese_character
+
+# Same as input_t capacity in wasm/src/state.h
+MAX_INPUT_LENGTH = 32
+# Entries of bigger queries are counted, but not paired:
+# they don't fit a chunk anyway and pairs grow quadratically
+MAX_PAIRED_QUERY = 32
+# Every n-th sentence is kept out of ordering to evaluate it
+HELD_OUT_EVERY = 10
+
+def lookup_trace(keys_of_lines, sentences):
+	"""
+	Yields sorted line numbers fetched by every hover.
+	`keys_of_lines[i]` are index keys of line `i`.
+	"""
+	index = defaultdict(list)
+	for line, keys in enumerate(keys_of_lines):
+		for key in keys:
+			index[key].append(line)
+	max_key_length = min(MAX_INPUT_LENGTH, max(map(len, index)))
+
+	for text in sentences:
+		text = kata_to_hira(text, agressive=False)
+		for start in range(len(text)):
+			if not is_japanese_character(text[start]):
+				continue
+			query = set()
+			for end in range(start + 1, min(len(text), start + max_key_length) + 1):
+				query.update(index.get(text[start:end], ()))
+			if len(query) > 0:
+				yield sorted(query)
+
+def locality_order(line_lengths, queries, chunk_size):
+	"""
+	Returns line numbers in new order. Lines are packed chunk by chunk:
+	chunk is seeded with the most fetched line not placed yet and filled
+	with lines fetched together with ones already in it most often.
+	Lines never fetched keep their order after all others.
+	"""
+	fetch_counts = Counter()
+	pair_counts = defaultdict(Counter)
+	for query in queries:
+		fetch_counts.update(query)
+		if len(query) > MAX_PAIRED_QUERY:
+			continue
+		for a, b in itertools.permutations(query, 2):
+			pair_counts[a][b] += 1
+
+	order = []
+	placed = set()
+	seeds = iter(sorted(fetch_counts, key=lambda line: (-fetch_counts[line], line)))
+	chunk_left = 0
+	candidates = Counter()
+	while True:
+		if chunk_left <= 0 or len(candidates) == 0:
+			line = next((line for line in seeds if line not in placed), None)
+			if line is None:
+				break
+			if chunk_left <= 0:
+				# Line crossing the boundary takes part of the next chunk
+				chunk_left += chunk_size
+				candidates.clear()
+		else:
+			line, _ = max(candidates.items(), key=lambda item: (item[1], -item[0]))
+
+		order.append(line)
+		placed.add(line)
+		candidates.pop(line, None)
+		chunk_left -= line_lengths[line] + 1
+		for neighbour, count in pair_counts[line].items():
+			if neighbour not in placed:
+				candidates[neighbour] += count
+
+	order.extend(line for line in range(len(line_lengths)) if line not in placed)
+	assert len(order) == len(line_lengths)
+	return order
+
+def chunks_per_query(order, line_lengths, queries, chunk_size):
+	""" Mean number of distinct chunks decompressed by a query """
+	line_chunks = [None] * len(line_lengths)
+	offset = 0
+	for line in order:
+		end = offset + line_lengths[line]
+		line_chunks[line] = range(offset // chunk_size, end // chunk_size + 1)
+		offset = end + 1
+
+	num_queries = 0
+	num_chunks = 0
+	for query in queries:
+		num_queries += 1
+		num_chunks += len(set(itertools.chain.from_iterable(line_chunks[line] for line in query)))
+	return num_chunks / max(num_queries, 1)
+
+def make_locality_order(keys_of_lines, line_lengths, sentences, chunk_size):
+	sentences = list(sentences)
+	training = [s for i, s in enumerate(sentences) if i % HELD_OUT_EVERY != 0]
+	held_out = [s for i, s in enumerate(sentences) if i % HELD_OUT_EVERY == 0]
+
+	order = locality_order(line_lengths, lookup_trace(keys_of_lines, training), chunk_size)
+
+	identity = range(len(line_lengths))
+	for label, part in (('training', training), ('held out', held_out)):
+		queries = list(lookup_trace(keys_of_lines, part))
+		before = chunks_per_query(identity, line_lengths, queries, chunk_size)
+		after = chunks_per_query(order, line_lengths, queries, chunk_size)
+		print(f'{label} lookups ({len(queries)}) decompress {before:.2f} chunks per query before, {after:.2f} after')
+
+	return order
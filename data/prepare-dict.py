@@ -1,13 +1,16 @@
 #!/usr/bin/env python3
 
 import re
-import struct
 import itertools
+import functools
+import argparse
+import multiprocessing
 from collections import defaultdict
 
 import dictionary
 import wasm_generator
-from utils import kata_to_hira
+import html_prerender
+from utils import kata_to_hira, is_kanji, cached, format_uint_base62, parse_uint_base62
 from index import index_keys
 from romaji import is_romajination
 
@@ -47,35 +50,28 @@ trans_type_abbreviations = {
 	"unclass": "u",
 	"work": "w",
 }
-def format_trans(trans, name):
-	parts = []
-	parts.append(','.join(map(trans_type_abbreviations.__getitem__, trans.types)))
+def format_trans(trans, name, prerendered_html=False):
+	type_keys = list(map(trans_type_abbreviations.__getitem__, trans.types))
 	if (len(trans.glosses) == 1 and len(name.readings) == 1
 				and is_romajination(kata_to_hira(name.readings[0].text, agressive=False), trans.glosses[0])):
-		pass
+		glosses = None
 	else:
+		glosses = '; '.join(trans.glosses)
+
+	if prerendered_html:
+		senses = [] if glosses is None else [glosses]
+		return html_prerender.render_sense_group(html_prerender.render_name_types(type_keys), senses)
+
+	parts = [','.join(type_keys)]
+	if glosses is not None:
 		parts.append(';')
-		parts.append('; '.join(trans.glosses))
+		parts.append(glosses)
 	return ''.join(parts)
 
-_base62_alphabeth = [
-	*map(str, range(ord('0'), ord('9') + 1)),
-	*map(str, range(ord('a'), ord('z') + 1)),
-	*map(str, range(ord('A'), ord('Z') + 1)),
-]
-assert len(_base62_alphabeth) == 62
-def format_uint_base62(v):
-	v, i = divmod(v, 62)
-	s = [_base62_alphabeth[i]]
-	while v != 0:
-		v, i = divmod(v, 62)
-		s.append(_base62_alphabeth[i])
-	return ''.join(s)
-
 control_kanji_symbols = re.compile('[#|U,;\t]')
 control_reading_symbols = re.compile('[|U;\t]')
 max_readings_index = 0
-def format_entry(entry, min_entry_id=None):
+def format_entry(entry, min_entry_id=None, prerendered_html=False):
 	global max_readings_index
 
 	any_common_kanji = any(map(lambda k: k.common, entry.kanjis))
@@ -151,26 +147,55 @@ def format_entry(entry, min_entry_id=None):
 		sense_groups = []
 		for g in entry.sense_groups:
 			# TODO use mecab to infer additional pos for exp entries
-			sense_groups.append(','.join(g.pos) + ';' + '`'.join(map(lambda s: format_sense(s, entry), g.senses)))
-		parts.append('\\'.join(sense_groups))
+			senses = [format_sense(s, entry) for s in g.senses]
+			if prerendered_html:
+				sense_groups.append(html_prerender.render_sense_group(g.pos, senses))
+			else:
+				sense_groups.append(','.join(g.pos) + ';' + '`'.join(senses))
+		parts.append(('' if prerendered_html else '\\').join(sense_groups))
 		del sense_groups
 
 		parts.append(format_uint_base62(entry.id - min_entry_id))
 	else:
 		transes = []
 		for t in entry.transes:
-			transes.append(format_trans(t, entry))
-		parts.append('\\'.join(transes))
+			transes.append(format_trans(t, entry, prerendered_html))
+		parts.append(('' if prerendered_html else '\\').join(transes))
 		del transes
 
 	return '\t'.join(parts)
 
-def prepare_names():
-	index = defaultdict(set)
-	offset = 0
+# Everything formatted entries depend on, besides the dictionary itself
+FORMAT_SOURCES = [
+	__file__, 'data/dictionary.py', 'data/index.py', 'data/utils.py',
+	'data/romaji.py', 'data/html_prerender.py', 'data/kanji.dat',
+]
+
+def reset_max_readings_index():
+	global max_readings_index
+	max_readings_index = 0
+
+def format_entries(format_one, entries):
+	"""
+	Formats entries in parallel, keeping order. Returns them and maximum
+	of `max_readings_index` updated by format_entry() in workers. Workers
+	start from 0 instead of the value forked from this process, so the
+	maximum depends on these entries only, as their cache does.
+	"""
+	with multiprocessing.Pool(initializer=reset_max_readings_index) as pool:
+		formatted = pool.map(format_one, entries, chunksize=256)
+	return formatted, max((f[-1] for f in formatted), default=0)
+
+def format_name(entry, prerendered_html):
+	keys = index_keys(entry, variate=False)
+	line = format_entry(entry, prerendered_html=prerendered_html).encode('utf-8')
+	text_line = format_entry(entry).encode('utf-8') if prerendered_html else None
+	return keys, line, text_line, max_readings_index
+
+def format_names(prerendered_html):
+	entries = []
 	combined_entries = {}
-	dictionary_lines = []
-	for entry in dictionary.dictionary_reader('JMnedict.xml.gz'):
+	for entry in dictionary.load_entries('JMnedict.xml.gz'):
 		if len(entry.readings) == 1 and len(entry.transes) == 1 and len(entry.transes[0].glosses) == 1:
 			key = entry.readings[0].text + ' - ' + ','.join(entry.transes[0].types)
 			combined_entry = combined_entries.get(key)
@@ -180,73 +205,207 @@ def prepare_names():
 				combined_entry.kanjis.extend(entry.kanjis)
 			continue
 
-		entry_index_keys = index_keys(entry, variate=False)
-		for key in entry_index_keys:
-			index[key].add(offset)
+		entries.append(entry)
+	entries.extend(combined_entries.values())
 
-		line = format_entry(entry).encode('utf-8')
-		dictionary_lines.append(line)
-		offset += len(line) + 1
+	return format_entries(functools.partial(format_name, prerendered_html=prerendered_html), entries)
 
-	for combined_entry in combined_entries.values():
-		entry_index_keys = index_keys(combined_entry, variate=False)
-		for key in entry_index_keys:
+def prepare_names(prerendered_html=False):
+	global max_readings_index
+	formatted, names_max_readings_index = cached(
+		'formatted-JMnedict', [dictionary.get_dictionary_path('JMnedict.xml.gz'), *FORMAT_SOURCES],
+		lambda: format_names(prerendered_html), prerendered_html
+	)
+	max_readings_index = max(max_readings_index, names_max_readings_index)
+
+	strings = wasm_generator.StringTable('names', [] if prerendered_html else [
+		wasm_generator.line_definition(line, with_entry_id=False) for _, line, _, _ in formatted
+	])
+	index = defaultdict(set)
+	offset = 0
+	definitions_offset = 0
+	dictionary_lines = []
+	definitions = []
+	html_lines = []
+	text_lines = []
+	for keys, line, text_line, _ in formatted:
+		for key in keys:
 			index[key].add(offset)
 
-		line = format_entry(combined_entry).encode('utf-8')
-		dictionary_lines.append(line)
-		offset += len(line) + 1
-
-	return dictionary_lines, index
-
-def prepare_words(pos_flags_map):
-	min_entry_id = 2**63
-	for entry in dictionary.dictionary_reader('JMdict_e.gz'):
-		min_entry_id = min(entry.id, min_entry_id)
-
+		header, definition = wasm_generator.split_definition(line, definitions_offset, with_entry_id=False, strings=strings)
+		dictionary_lines.append(header)
+		definitions.append(definition)
+		offset += len(header) + 1
+		definitions_offset += len(definition) + 1
+		if prerendered_html:
+			html_lines.append(line)
+			text_lines.append(text_line)
+
+	if prerendered_html:
+		wasm_generator.print_formats_size_comparison('names', text_lines, html_lines)
+
+	return (dictionary_lines, definitions, strings), index
+
+def kanji_word_ranks(entry):
+	# Entry is ranked by its first writing containing the kanji
+	ranks = {}
+	for k in entry.kanjis:
+		for c in k.text:
+			if is_kanji(c) and c not in ranks:
+				ranks[c] = (not k.common, len(k.text))
+	return list(ranks.items())
+
+def rank_kanji_words(kanji_words):
+	"""
+	Postings are words dictionary offsets, best first: common (JMdict
+	priority marked) writings, then shorter ones, then JMdict order.
+	"""
+	return {
+		ord(c): [offset for _, offset in sorted(postings)[:wasm_generator.KANJI_WORDS_MAX_POSTINGS]]
+		for c, postings in kanji_words.items()
+	}
+
+def format_word(entry, min_entry_id, prerendered_html):
+	all_pos = set(itertools.chain.from_iterable(sg.pos for sg in entry.sense_groups))
+	keys = index_keys(entry, variate=True)
+	line = format_entry(entry, min_entry_id, prerendered_html).encode('utf-8')
+	text_line = format_entry(entry, min_entry_id).encode('utf-8') if prerendered_html else None
+	return all_pos, keys, kanji_word_ranks(entry), line, text_line, max_readings_index
+
+def format_words(prerendered_html):
+	entries = dictionary.load_entries('JMdict_e.gz')
+	min_entry_id = min(entry.id for entry in entries)
+	format_one = functools.partial(format_word, min_entry_id=min_entry_id, prerendered_html=prerendered_html)
+	formatted, words_max_readings_index = format_entries(format_one, entries)
+	return formatted, min_entry_id, words_max_readings_index
+
+def words_locality_order(formatted, prerendered_html):
+	import corpus  # downloads example sentences
+	import locality
+
+	keys_of_lines = [keys for _, keys, _, _, _, _ in formatted]
+	# Lines share chunks of headers file, definition offset is a few
+	# bytes, unknown until order is
+	line_lengths = [len(line) - len(line.rsplit(b'\t', 2)[1]) + 4 for _, _, _, line, _, _ in formatted]
+	return cached(
+		'locality-order-JMdict_e',
+		[
+			dictionary.get_dictionary_path('JMdict_e.gz'), corpus.sentences_file,
+			*FORMAT_SOURCES, 'data/corpus.py', 'data/locality.py',
+		],
+		lambda: locality.make_locality_order(
+			keys_of_lines, line_lengths, corpus.sentence_texts(), wasm_generator.DICTIONARY_CHUNK_SIZE
+		),
+		prerendered_html, wasm_generator.DICTIONARY_CHUNK_SIZE
+	)
+
+def prepare_words(pos_flags_map, prerendered_html=False, locality_order=False):
+	"""
+	Parsing and formatting is cached, so changes of deinflection rules
+	or output format only redo assembling of dictionary and index.
+	With `locality_order` lines are ordered so entries looked up together
+	share chunks (see locality.py), otherwise they are in JMdict order.
+	"""
+	global max_readings_index
+	formatted, min_entry_id, words_max_readings_index = cached(
+		'formatted-JMdict_e', [dictionary.get_dictionary_path('JMdict_e.gz'), *FORMAT_SOURCES],
+		lambda: format_words(prerendered_html), prerendered_html
+	)
+	max_readings_index = max(max_readings_index, words_max_readings_index)
+
+	lines_order = range(len(formatted))
+	if locality_order:
+		# Engine ranks results of reordered lines by entry ids instead of
+		# offsets, see rank_words_results_by_entry_id() of wasm/src/dictionaries.c
+		entry_ids = [parse_uint_base62(line.rsplit(b'\t', 1)[1].decode()) for _, _, _, line, _, _ in formatted]
+		assert all(a < b for a, b in zip(entry_ids, entry_ids[1:])), 'entry ids must follow JMdict order'
+		lines_order = words_locality_order(formatted, prerendered_html)
+
+	strings = wasm_generator.StringTable('words', [] if prerendered_html else [
+		wasm_generator.line_definition(line, with_entry_id=True) for _, _, _, line, _, _ in formatted
+	])
 	index = defaultdict(set)
+	kanji_words = defaultdict(list)
 	offset = 0
+	definitions_offset = 0
 	dictionary_lines = []
-	for entry in dictionary.dictionary_reader('JMdict_e.gz'):
-		all_pos = set(itertools.chain.from_iterable(sg.pos for sg in entry.sense_groups))
+	definitions = []
+	html_lines = []
+	text_lines = []
+	for i in lines_order:
+		all_pos, keys, kanji_ranks, line, text_line, _ = formatted[i]
+		for c, rank in kanji_ranks:
+			# Ties are broken by JMdict order, whatever order of lines is
+			kanji_words[c].append(((*rank, i), offset))
+
 		pos_flags = sum(pos_flags_map.get(pos, 0) for pos in all_pos)
 		index_entry = offset if pos_flags == 0 else wasm_generator.TypedOffset(type=pos_flags, offset=offset)
-
-		for key in index_keys(entry, variate=True):
+		for key in keys:
 			index[key].add(index_entry)
 
-		line = format_entry(entry, min_entry_id).encode('utf-8')
-		dictionary_lines.append(line)
-		offset += len(line) + 1
+		header, definition = wasm_generator.split_definition(line, definitions_offset, with_entry_id=True, strings=strings)
+		dictionary_lines.append(header)
+		definitions.append(definition)
+		offset += len(header) + 1
+		definitions_offset += len(definition) + 1
+		if prerendered_html:
+			html_lines.append(line)
+			text_lines.append(text_line)
 
-	return dictionary_lines, index, min_entry_id
+	if prerendered_html:
+		wasm_generator.print_formats_size_comparison('words', text_lines, html_lines)
 
-def index_kanji():
-	index = []
-	offset = 0
+	return (dictionary_lines, definitions, strings), index, min_entry_id, rank_kanji_words(kanji_words)
 
-	entry_no = 0
+def prepare_kanji():
+	records = []
 	with open('data/kanji.dat', 'r') as f:
 		for l in f:
-			entry_no += 1
-			if entry_no % 1000 == 0:
-				print('kanji', entry_no)
-			index.append((ord(l[0]), offset))
-			offset += len(l.encode('utf-8'))
-
-	index.sort()
-	with open('data/kanji.idx', 'wb') as of:
-		for kanji_code_point, offset in index:
-			of.write(struct.pack('<II', kanji_code_point, offset))
-
-pos_flags_map = wasm_generator.generate_deinflection_rules_header()
-words_dictionary, words_index, min_entry_id = prepare_words(pos_flags_map)
-names_dictionary, names_index = prepare_names()
-
-wasm_generator.write_dictionaries(words_dictionary, names_dictionary)
-wasm_generator.write_utf16_indexies(words_index, names_index)
-wasm_generator.generate_config_header(max_readings_index, min_entry_id)
-wasm_generator.get_lz4_source()
-
-# TODO generate kanji.dat
-index_kanji()
+			if len(records) % 1000 == 0 and len(records) > 0:
+				print('kanji', len(records))
+			records.append((ord(l[0]), l.rstrip('\n').encode('utf-8')))
+
+	records.sort()
+	return records
+
+def prepare_radicals():
+	radicals = []
+	with open('data/radicals.dat', 'r', encoding='utf-8-sig') as f:
+		for l in f:
+			radical, _alternative, _reading, _meaning, kanjis = l.rstrip('\n').split('\t')
+			# Position variants are marked with dot, e.g. '.阝' and '阝.'
+			radicals.append((radical, list(map(ord, kanjis))))
+
+	return radicals
+
+if __name__ == '__main__':
+	parser = argparse.ArgumentParser()
+	parser.add_argument(
+		'--prerendered-html', action='store_true',
+		help='store definitions as ready HTML fragments instead of plain text'
+	)
+	parser.add_argument(
+		'--external-data', action='store_true',
+		help=f'keep dictionaries out of the module in {wasm_generator.ExternalData.path}, read by chunks on demand'
+	)
+	parser.add_argument(
+		'--locality-order', action='store_true',
+		help='order words dictionary lines by lookup trace of example sentences, see data/locality.py'
+	)
+	args = parser.parse_args()
+	if args.external_data:
+		wasm_generator.external_data = wasm_generator.ExternalData()
+
+	pos_flags_map = wasm_generator.generate_deinflection_rules_header()
+	words_dictionary, words_index, min_entry_id, kanji_words = prepare_words(pos_flags_map, args.prerendered_html, args.locality_order)
+	names_dictionary, names_index = prepare_names(args.prerendered_html)
+
+	wasm_generator.write_dictionaries(words_dictionary, names_dictionary)
+	wasm_generator.write_utf16_indexies(words_index, names_index, kanji_words)
+	wasm_generator.generate_config_header(max_readings_index, min_entry_id, args.prerendered_html, args.locality_order)
+	wasm_generator.get_lz4_source()
+
+	# TODO generate kanji.dat
+	wasm_generator.write_kanji(prepare_kanji(), prepare_radicals())
+	if args.external_data:
+		wasm_generator.external_data.write()
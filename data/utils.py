@@ -1,4 +1,6 @@
 import os
+import pickle
+import hashlib
 import subprocess
 import builtins
 import itertools
@@ -137,6 +139,32 @@ def download(url, filename, temp=True):
 		print(f"\nDownloaded {filename}")
 	return path
 
+def cached(name, input_paths, compute, *key):
+	"""
+	Returns `compute()` result, pickled under tmp/cache/ with a key made of
+	`input_paths` contents and `key`, so it is recomputed only after any
+	of them changes
+	"""
+	h = hashlib.sha256()
+	for input_path in input_paths:
+		with open(input_path, 'rb') as f:
+			for block in iter(lambda: f.read(1 << 20), b''):
+				h.update(block)
+	h.update(repr(key).encode())
+
+	path = os.path.join('tmp', 'cache', f'{name}-{h.hexdigest()[:16]}.pkl')
+	if os.path.exists(path):
+		print(f'Using cached {name}')
+		with open(path, 'rb') as f:
+			return pickle.load(f)
+
+	res = compute()
+	os.makedirs(os.path.dirname(path), exist_ok=True)
+	with open(path + '-part', 'wb') as of:
+		pickle.dump(res, of, protocol=pickle.HIGHEST_PROTOCOL)
+	os.rename(path + '-part', path)
+	return res
+
 def print_lengths_stats(label, line_lengths):
 	line_lengths.sort()
 	print(f'''{label} lines stats:
@@ -146,3 +174,24 @@ def print_lengths_stats(label, line_lengths):
 
 def ceil_power_of_2(n):
 	return 2**math.ceil(math.log2(n))
+
+_base62_alphabeth = [
+	*map(chr, range(ord('0'), ord('9') + 1)),
+	*map(chr, range(ord('a'), ord('z') + 1)),
+	*map(chr, range(ord('A'), ord('Z') + 1)),
+]
+assert len(_base62_alphabeth) == 62
+def format_uint_base62(v):
+	""" Most significant digit first, see parse_base62_uint() of wasm/src/dentry.c """
+	v, i = divmod(v, 62)
+	s = [_base62_alphabeth[i]]
+	while v != 0:
+		v, i = divmod(v, 62)
+		s.append(_base62_alphabeth[i])
+	return ''.join(reversed(s))
+
+def parse_uint_base62(s):
+	v = 0
+	for c in s:
+		v = v * 62 + _base62_alphabeth.index(c)
+	return v
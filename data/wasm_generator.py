@@ -1,19 +1,41 @@
 import math
+import heapq
+import struct
 import random
+import itertools
+import functools
+import multiprocessing
 import subprocess
-from collections import namedtuple
+from collections import namedtuple, Counter, defaultdict
 
 import lz4.block
 
-from utils import print_lengths_stats, download, ceil_power_of_2
-
-CHUNK_SIZE = 2048
-
-def generate_config_header(max_reading_index, min_entry_id):
+from utils import print_lengths_stats, download, ceil_power_of_2, format_uint_base62
+
+# Every LZ4-chunked file has its own chunk size (see `chunk_size` of
+# compressed_file_t): bigger chunks compress better, but every lookup
+# decompresses more. Index entries span at most two chunks, so index chunk
+# can't be smaller than an entry. See wasm/bench/sweep.py for the tradeoff.
+INDEX_CHUNK_SIZE = 2048
+DICTIONARY_CHUNK_SIZE = 2048
+KANJI_CHUNK_SIZE = 2048
+# 'lz4' or 'lz4hc': same block format (and decompressor), HC compresses
+# better and much slower
+CODEC = 'lz4'
+# Chunks of a file are compressed against shared dictionary of this size
+# (see train_lz4_dict()), so boilerplate like POS tags isn't relearned in
+# every chunk. 0 - compress chunks independently. Dictionary is dropped
+# for files it doesn't make smaller.
+LZ4_DICT_SIZE = 1 << 15
+
+def generate_config_header(max_reading_index, min_entry_id, prerendered_html=False, locality_order=False):
 	with open('wasm/generated/config.h', 'w') as of:
 		print('#define MAX_READING_INDEX', max_reading_index, file=of)
 		print('#define MIN_ENTRY_ID', min_entry_id, file=of)
-		print('#define CHUNK_SIZE', CHUNK_SIZE, file=of)
+		print('#define MAX_CHUNK_SIZE', max(INDEX_CHUNK_SIZE, DICTIONARY_CHUNK_SIZE, KANJI_CHUNK_SIZE), file=of)
+		print('#define PRERENDERED_DEFINITIONS', int(prerendered_html), file=of)
+		print('#define LOCALITY_ORDERED_WORDS', int(locality_order), file=of)
+		print('#define EXTERNAL_DATA', int(external_data is not None), file=of)
 
 def get_lz4_source():
 	download('https://github.com/lz4/lz4/raw/master/lib/lz4.c', 'wasm/generated/lz4.c', temp=False)
@@ -137,23 +159,84 @@ def encode_int(i, is_type=False):
 
 TypedOffset = namedtuple('TypedOffset', 'type, offset')
 
-def encode_index(label, index, line_lengths):
+def decoded_postings(offsets):
+	""" uint32 words of posting list, as current_index_entry_decode_offsets() yields them """
+	words = []
+	for offset in sorted(offsets, key=lambda o: o if type(o) == int else o.offset):
+		if type(offset) == int:
+			words.append(offset)
+		else:
+			assert offset.type != 0
+			words.extend((offset.type | (1 << type_bit_shift), offset.offset))
+	return words
+
+SharedPostings = namedtuple('SharedPostings', 'positions, buf, max_length')
+
+def share_postings(index):
+	"""
+	Keys of an entry (writings, readings and their variations, see
+	index_keys()) often have identical posting lists. Such list is stored
+	once in postings file as its length and decoded words, and keys refer
+	to it with type 0 (which real postings never have) followed by list
+	position in words. List is shared only when it's smaller than its
+	copies. Position 0 is an empty list, so the file is never empty.
+	"""
+	keys_of_lists = defaultdict(list)
+	for key, offsets in sorted(index.items()):
+		keys_of_lists[frozenset(offsets)].append(key)
+
+	positions = {}
+	words = [0]
+	max_length = 0
+	for offsets, keys in keys_of_lists.items():
+		list_words = decoded_postings(offsets)
+		inline_size = 4 * len(list_words) * len(keys)
+		shared_size = 8 * len(keys) + 4 * (1 + len(list_words))
+		if shared_size >= inline_size:
+			continue
+
+		for key in keys:
+			positions[key] = len(words)
+		words.append(len(list_words))
+		words.extend(list_words)
+		max_length = max(max_length, len(list_words))
+
+	shared = SharedPostings(positions, struct.pack(f'<{len(words)}I', *words), max_length)
+	check_shared_postings(index, shared)
+	return shared
+
+def check_shared_postings(index, shared):
+	""" Lookup of every key yields the same postings with and without sharing """
+	words = struct.unpack(f'<{len(shared.buf) // 4}I', shared.buf)
+	for key, position in shared.positions.items():
+		length = words[position]
+		assert list(words[position + 1:position + 1 + length]) == decoded_postings(index[key]), key
+
+def encode_index(label, index, line_lengths, shared_positions={}, verbose=True):
 	buf = bytearray()
 	keys_len = 0
 	offsets_len = 0
 	types_len = 0
+	references_len = 0
 
 	index = list(index.items())
 	index.sort()
 	for w, offsets in index:
 		old_buf_len = len(buf)
 
+		position = shared_positions.get(w)
 		w = w.encode('utf-16le')
 		for b2 in w[1::2]:
 			assert (b2 & (prefix_mask >> 8)) != (offset_prefix >> 8)
 		buf.extend(w)
 		keys_len += len(w)
 
+		if position is not None:
+			buf.extend(encode_int(0, is_type=True))
+			buf.extend(encode_int(position))
+			references_len += 8
+			offsets = ()
+
 		for offset in offsets:
 
 			if type(offset) == int:
@@ -167,59 +250,311 @@ def encode_index(label, index, line_lengths):
 
 		line_lengths.append(len(buf) - old_buf_len)
 
-	print(f'''{label}.u16.idx would be of {len(buf) / 2**20:.2f}MiB:
-		{keys_len / 2**20:.2f} - keys,
-		{offsets_len / 2**20:.2f} - offsets,
-		{types_len / 2**20:.2f} - types,
-	''')
+	if verbose:
+		print(f'''{label}.u16.idx would be of {len(buf) / 2**20:.2f}MiB:
+			{keys_len / 2**20:.2f} - keys,
+			{offsets_len / 2**20:.2f} - offsets,
+			{types_len / 2**20:.2f} - types,
+			{references_len / 2**20:.2f} - shared postings references,
+		''')
 
 	return buf
 
+# Printable ASCII is kept as is in LLVM IR strings, everything else is `\XX`
+ir_string_escapes = [
+	chr(b) if 0x20 <= b < 0x7F and b not in b'"\\' else f'\\{b:02X}'
+	for b in range(256)
+]
+
+class GeneratedModule:
+	"""
+	Bitcode of generated data: `wasm/generated/<name>.bc`. Small tables are
+	printed as C source to clang (`source`), while blobs are written as raw
+	`.bin` files and assembled into constant globals of LLVM IR, then both
+	parts are linked together. Clang builds AST node for every element of an
+	initializer list, so megabytes of data as C arrays used to take minutes,
+	while IR assembler reads string constant in one go.
+	"""
+	def __init__(self, name):
+		self.name = name
+		self.blobs = []
+		with open('wasm/cflags') as f:
+			flags = f.read().strip().split()
+		flags.insert(0, 'clang')
+		flags.extend([
+			'-c', '-emit-llvm', '--target=wasm32-unknown-unknown-wasm',
+			'-x', 'c', '-o', f'wasm/generated/{name}.c.bc', '-'
+		])
+		self.clang = subprocess.Popen(flags, stdin=subprocess.PIPE, text=True)
+		self.source = self.clang.stdin
+		print('#include <stdint.h>', file=self.source)
+
+	def add_blob(self, symbol, data, align=1):
+		"""
+		Defines `symbol` as constant array with contents of `data`, which
+		is declared in C as array of any type (multibyte types are read in
+		little endian)
+		"""
+		path = f'wasm/generated/{symbol}.bin'
+		with open(path, 'wb') as of:
+			of.write(data)
+		self.blobs.append((symbol, path, align))
+
+	def close(self):
+		print(file=self.source)
+		self.source.close()
+		assert self.clang.wait() == 0
+
+		ir_path = f'wasm/generated/{self.name}.blobs.ll'
+		with open(ir_path, 'w') as of:
+			for symbol, path, align in self.blobs:
+				with open(path, 'rb') as f:
+					data = f.read()
+				of.write(f'@{symbol} = constant [{len(data)} x i8] c"')
+				of.write(''.join(map(ir_string_escapes.__getitem__, data)))
+				of.write(f'", align {align}\n')
+
+		subprocess.run(['llvm-as', ir_path, '-o', f'wasm/generated/{self.name}.blobs.bc'], check=True)
+		subprocess.run([
+			'llvm-link', f'wasm/generated/{self.name}.c.bc', f'wasm/generated/{self.name}.blobs.bc',
+			'-o', f'wasm/generated/{self.name}.bc'
+		], check=True)
+
+def compress_chunk(chunk, codec='lz4', lz4_dict=b''):
+	mode = 'high_compression' if codec == 'lz4hc' else 'default'
+	return lz4.block.compress(chunk, mode=mode, store_size=False, dict=lz4_dict)
+
+def compress_chunks(buf, chunk_size, codec=None, lz4_dict=b''):
+	# Postings of kanji words index never cross chunks
+	assert chunk_size % 8 == 0
+	chunks = [buf[chunk_start:chunk_start + chunk_size] for chunk_start in range(0, len(buf), chunk_size)]
+	with multiprocessing.Pool() as pool:
+		return chunks, pool.map(functools.partial(compress_chunk, codec=codec or CODEC, lz4_dict=lz4_dict), chunks, chunksize=64)
+
+def train_lz4_dict(chunks, size, segment_size=32, dmer_size=8):
+	"""
+	LZ4 has no dictionary builder, so this is a simplified zstd's COVER:
+	`dmer_size`-byte substrings are scored by number of (sampled) chunks
+	they occur in, and dictionary is greedily made of `segment_size`-byte
+	segments of chunks with the best total score of substrings not yet
+	in dictionary. Best segments go last, closest to compressed data.
+	"""
+	samples = list(map(bytes, chunks[::max(1, len(chunks) * len(chunks[0]) // (32 * size))]))
+	frequencies = Counter()
+	for sample in samples:
+		frequencies.update({sample[i:i + dmer_size] for i in range(len(sample) - dmer_size + 1)})
+
+	def dmers(segment):
+		return {segment[i:i + dmer_size] for i in range(len(segment) - dmer_size + 1)}
+
+	def score(segment):
+		# Substrings of a single chunk don't help others
+		return sum(frequencies[dmer] for dmer in dmers(segment) if frequencies[dmer] > 1)
+
+	segments = [
+		sample[start:start + segment_size]
+		for sample in samples
+		for start in range(0, len(sample) - segment_size + 1, segment_size // 2)
+	]
+	# Lazy greedy: scores only decrease, so popped segment is the best
+	# if its updated score is still not worse than the next one's stale
+	heap = [(-score(segment), i) for i, segment in enumerate(segments)]
+	heapq.heapify(heap)
+	picked = []
+	while heap and len(picked) * segment_size < size:
+		_, i = heapq.heappop(heap)
+		segment_score = score(segments[i])
+		if segment_score == 0:
+			continue
+		if heap and segment_score < -heap[0][0]:
+			heapq.heappush(heap, (-segment_score, i))
+			continue
+
+		picked.append(segments[i])
+		for dmer in dmers(segments[i]):
+			frequencies[dmer] = 0
+
+	return b''.join(reversed(picked))[-size:]
+
+class InlineModule:
+	""" GeneratedModule stand-in, which prints blobs as C arrays to `source` (for small test data) """
+	def __init__(self, source):
+		self.source = source
+
+	def add_blob(self, symbol, data, align=1):
+		alignment = f' __attribute__((aligned({align})))' if align > 1 else ''
+		print(f'const uint8_t {symbol}[]{alignment} = {{', file=self.source)
+		print(*data, sep=',', end='};\n', file=self.source)
+
+class ExternalData:
+	"""
+	LZ4 chunks of files kept out of the module (see `--external-data` of
+	prepare-dict.py) in `wasm/generated/rikai.dat`, served to wasm with
+	read_chunk() import. All numbers are little endian uint32: number of
+	files and chunk table position of every file, then chunk tables and
+	chunks. Chunk table of a file is positions of its chunks plus end of
+	the last one. Positions are relative to the file start.
+	"""
+	path = 'wasm/generated/rikai.dat'
+
+	def __init__(self):
+		self.file_ids = {}
+		self.files = []
+
+	def add(self, label, compressed_chunks):
+		self.file_ids[label] = len(self.files)
+		self.files.append(compressed_chunks)
+
+	def write(self):
+		header_size = 4 * (1 + len(self.files))
+		tables_size = sum(4 * (len(chunks) + 1) for chunks in self.files)
+		table_positions = []
+		tables = []
+		position = header_size + tables_size
+		for chunks in self.files:
+			table_positions.append(header_size + 4 * len(tables))
+			tables.extend(itertools.accumulate(map(len, chunks), initial=position))
+			position = tables[-1]
+
+		with open(self.path, 'wb') as of:
+			of.write(struct.pack(f'<{1 + len(self.files)}I', len(self.files), *table_positions))
+			of.write(struct.pack(f'<{len(tables)}I', *tables))
+			for chunks in self.files:
+				of.write(b''.join(chunks))
+		print(f'external data is of size {position / 2**20:.2f}MiB')
+
+# Set to ExternalData() to keep LZ4-chunked files out of the module
+external_data = None
+
+def write_blobs(label, buf, module, chunk_size, header, lz4_dict=None):
+	"""
+	Writes LZ4-chunked `buf` to module and its compressed_file_t fields
+	to header, returns compressed size. `lz4_dict` - dictionary to compress
+	chunks against, trained when None (see LZ4_DICT_SIZE).
+	"""
+	chunks, compressed_chunks = compress_chunks(buf, chunk_size)
+	if lz4_dict is None:
+		lz4_dict = train_lz4_dict(chunks, LZ4_DICT_SIZE) if LZ4_DICT_SIZE > 0 else b''
+		if len(lz4_dict) > 0:
+			independent_size = sum(map(len, compressed_chunks))
+			_, dict_compressed_chunks = compress_chunks(buf, chunk_size, lz4_dict=lz4_dict)
+			dict_size = len(lz4_dict) + sum(map(len, dict_compressed_chunks))
+			print(
+				f'{label} with {len(lz4_dict) / 2**10:.0f}KiB dictionary is of size {dict_size / 2**20:.2f}MiB,',
+				f'without - {independent_size / 2**20:.2f}MiB'
+			)
+			if dict_size < independent_size:
+				compressed_chunks = dict_compressed_chunks
+			else:
+				lz4_dict = b''
+	elif len(lz4_dict) > 0:
+		_, compressed_chunks = compress_chunks(buf, chunk_size, lz4_dict=lz4_dict)
 
-def write_blobs_to_clang(label, buf, clang):
 	# len(chunk_offsets) would be number of chunks + 1, so for all `i`
 	# can compute compressed chunk length with single expression:
 	# `chunk_offsets[i + 1] - chunk_offsets[i]`
-	chunk_offsets = [0]
-	print(f'const uint8_t {label}_data[] = {{', file=clang)
-	for chunk_start in range(0, len(buf), CHUNK_SIZE):
-		chunk = buf[chunk_start:chunk_start + CHUNK_SIZE]
-
-		compressed = lz4.block.compress(chunk, store_size=False)
-		chunk_offsets.append(chunk_offsets[-1] + len(compressed))
-		print(*compressed, sep=',', end=',', file=clang)
-
-	print('};', file=clang)
-	print(f'const int32_t {label}_chunks_offsets[] = {{', file=clang)
-	print(*chunk_offsets, sep=',', end='};', file=clang)
-
-	return chunk_offsets[-1], len(chunk_offsets), len(chunk)
+	chunk_offsets = list(itertools.accumulate(map(len, compressed_chunks), initial=0))
+
+	if external_data is not None:
+		external_data.add(label, compressed_chunks)
+	else:
+		module.add_blob(f'{label}_data', b''.join(compressed_chunks))
+		print(f'const int32_t {label}_chunks_offsets[] = {{', file=module.source)
+		print(*chunk_offsets, sep=',', end='};', file=module.source)
+	# Dictionary is needed for every chunk, so it stays in the module
+	if len(lz4_dict) > 0:
+		module.add_blob(f'{label}_lz4_dict', lz4_dict)
+
+	write_blob_header(label, len(buf), chunk_offsets[-1], len(chunk_offsets), len(chunks[-1]), chunk_size, len(lz4_dict), header)
+	return chunk_offsets[-1]
+
+def compressed_size(buf):
+	return sum(map(len, compress_chunks(buf, DICTIONARY_CHUNK_SIZE)[1]))
+
+def print_formats_size_comparison(label, text_lines, html_lines):
+	text_buf = b'\n'.join(text_lines)
+	html_buf = b'\n'.join(html_lines)
+	text_compressed = compressed_size(text_buf)
+	html_compressed = compressed_size(html_buf)
+	print(f'''{label} dictionary prerendered html vs text format:
+		raw {len(html_buf) / 2**20:.2f}MiB vs {len(text_buf) / 2**20:.2f}MiB,
+		lz4-chunked {html_compressed / 2**20:.2f}MiB vs {text_compressed / 2**20:.2f}MiB ({html_compressed / text_compressed:.2f}x)
+	''')
 
-def write_blob_header(label, original_size, compressed_len, num_chunk_offsets, last_chunk_size, of):
+def write_blob_header(label, original_size, compressed_len, num_chunk_offsets, last_chunk_size, chunk_size, lz4_dict_size, of):
 	print(f'const size_t {label}_original_size = {original_size};', file=of)
-	print(f'extern const uint8_t {label}_data[{compressed_len}];', file=of)
-	print(f'extern const int32_t {label}_chunks_offsets[{num_chunk_offsets}];', file=of)
+	print(f'const size_t {label}_chunk_size = {chunk_size};', file=of)
+	if external_data is not None:
+		print(f'#define {label}_data NULL', file=of)
+		print(f'#define {label}_chunks_offsets NULL', file=of)
+		print(f'const uint32_t {label}_file_id = {external_data.file_ids[label]};', file=of)
+	else:
+		print(f'extern const uint8_t {label}_data[{compressed_len}];', file=of)
+		print(f'extern const int32_t {label}_chunks_offsets[{num_chunk_offsets}];', file=of)
+		print(f'const uint32_t {label}_file_id = UINT32_MAX;', file=of)
 	print(f'const size_t {label}_last_chunk_size = {last_chunk_size};', file=of)
+	if lz4_dict_size > 0:
+		print(f'extern const uint8_t {label}_lz4_dict[{lz4_dict_size}];', file=of)
+	else:
+		print(f'#define {label}_lz4_dict NULL', file=of)
+	print(f'const size_t {label}_lz4_dict_size = {lz4_dict_size};', file=of)
 	print(f'const size_t {label}_last_chunk_index = {num_chunk_offsets - 2};', file=of)
 
-def write_utf16_index(label, index, line_lengths, header, clang):
-	buf = encode_index(label, index, line_lengths)
-	label = f'{label}_dictionary_index'
-	compressed_len, num_chunk_offsets, last_chunk_size = write_blobs_to_clang(label, buf, clang)
-	write_blob_header(label, len(buf), compressed_len, num_chunk_offsets, last_chunk_size, header)
-	print(f'{label} utf16 lz4-chunked is of size {compressed_len / 2**20:.2f}MiB')
+def write_utf16_index(label, index, line_lengths, header, module, chunk_size=None, shared=None):
+	chunk_size = chunk_size or INDEX_CHUNK_SIZE
+	buf = encode_index(label, index, line_lengths, shared.positions if shared else {})
+	assert max(line_lengths) <= chunk_size, 'index entry spans more than two chunks'
+	index_label = f'{label}_dictionary_index'
+	compressed_len = write_blobs(index_label, buf, module, chunk_size, header)
+	print(f'{index_label} utf16 lz4-chunked is of size {compressed_len / 2**20:.2f}MiB')
+	if shared:
+		write_blobs(f'{label}_dictionary_postings', shared.buf, module, chunk_size, header)
+		print_shared_postings_savings(index_label, buf, shared, encode_index(label, index, [], verbose=False), chunk_size)
 	return buf
 
-def write_utf16_indexies(words_index, names_index):
-	with open('wasm/cflags') as f:
-		flags = f.read().strip().split()
-	flags.insert(0, 'clang')
-	flags.extend([
-		'-c', '-emit-llvm', '--target=wasm32-unknown-unknown-wasm',
-		'-x', 'c', '-o', 'wasm/generated/index.bc', '-'
-	])
-	clang = subprocess.Popen(flags, stdin=subprocess.PIPE, text=True)
-	print('#include <stdint.h>', file=clang.stdin)
+def print_shared_postings_savings(label, buf, shared, unshared_buf, chunk_size):
+	# Chunks compressed independently, as trained dictionaries would differ
+	compressed = lambda buf: sum(map(len, compress_chunks(buf, chunk_size)[1]))
+	shared_len = len(buf) + len(shared.buf)
+	shared_compressed_len = compressed(buf) + compressed(shared.buf)
+	print(
+		f'{label} with {len(set(shared.positions.values()))} posting lists shared by {len(shared.positions)} keys',
+		f'is of size {shared_len / 2**20:.2f}MiB ({shared_compressed_len / 2**20:.2f}MiB compressed),',
+		f'without sharing - {len(unshared_buf) / 2**20:.2f}MiB ({compressed(unshared_buf) / 2**20:.2f}MiB compressed)'
+	)
+
+KANJI_WORDS_MAX_POSTINGS = 64
+
+def write_kanji_words_index(kanji_words, header, module):
+	"""
+	Postings (uint32 words dictionary offsets, best first) of all kanjis
+	are concatenated into LZ4-chunked blob, ordered by code point.
+	`kanji_words_code_points` is sorted, and postings of kanji `i` are
+	`kanji_words_starts[i]` to `kanji_words_starts[i + 1]`.
+	"""
+	code_points = sorted(kanji_words)
+	starts = [0]
+	buf = bytearray()
+	for code_point in code_points:
+		for offset in kanji_words[code_point]:
+			buf.extend(offset.to_bytes(4, 'little'))
+		starts.append(len(buf) // 4)
+
+	label = 'kanji_words_index'
+	compressed_len = write_blobs(label, buf, module, INDEX_CHUNK_SIZE, header)
+
+	print('const uint32_t kanji_words_code_points[] = {', file=module.source)
+	print(*code_points, sep=',', end='};\n', file=module.source)
+	print('const uint32_t kanji_words_starts[] = {', file=module.source)
+	print(*starts, sep=',', end='};\n', file=module.source)
+	print(f'#define KANJI_WORDS_MAX_POSTINGS {KANJI_WORDS_MAX_POSTINGS}', file=header)
+	print(f'extern const uint32_t kanji_words_code_points[{len(code_points)}];', file=header)
+	print(f'extern const uint32_t kanji_words_starts[{len(starts)}];', file=header)
+
+	print(f'{label} lz4-chunked is of size {compressed_len / 2**20:.2f}MiB, table - {len(code_points) * 8 / 2**10:.2f}KiB')
+
+def write_utf16_indexies(words_index, names_index, kanji_words):
+	module = GeneratedModule('index')
 
 	with open('wasm/generated/index.h', 'w') as of:
 		print(f'const uint32_t dictionary_index_type_bit = 0x{1<<type_bit_shift:08X};', file=of)
@@ -229,19 +564,25 @@ def write_utf16_indexies(words_index, names_index):
 		print(f'const uint16_t dictionary_index_offset_suffix_mask = 0x{suffix_mask:04X};', file=of)
 
 		line_lengths = []
+		max_shared_postings = 1
 		for label, index in zip(('words', 'names'), (words_index, names_index)):
-			write_utf16_index(label, index, line_lengths, of, clang.stdin)
+			shared = share_postings(index)
+			max_shared_postings = max(max_shared_postings, shared.max_length)
+			write_utf16_index(label, index, line_lengths, of, module, shared=shared)
+
+		write_kanji_words_index(kanji_words, of, module)
 
 		print_lengths_stats('utf16 index', line_lengths)
 		print(f'''
 			#ifndef dictionary_index_max_entry_length
 			#define dictionary_index_max_entry_length {ceil_power_of_2(max(line_lengths))}
 			#endif
+			#ifndef dictionary_index_max_shared_postings
+			#define dictionary_index_max_shared_postings {max_shared_postings}
+			#endif
 		''', file=of)
 
-	print(file=clang.stdin)
-	clang.stdin.close()
-	clang.wait()
+	module.close()
 
 	with open('wasm/generated/index-samples.csv', 'w') as of:
 		print(
@@ -249,29 +590,123 @@ def write_utf16_indexies(words_index, names_index):
 			sep=',', file=of
 		)
 
-def write_dictionary(label, dictionary, header, clang):
-	buf = b'\n'.join(dictionary)
-	label = f'{label}_dictionary'
-	compressed_len, num_chunk_offsets, last_chunk_size = write_blobs_to_clang(label, buf, clang)
-	write_blob_header(label, len(buf), compressed_len, num_chunk_offsets, last_chunk_size, header)
-	print(f'{label} lz4-chunked is of size {compressed_len / 2**20:.2f}MiB')
-	return buf
+INTERNED_STRING_MARKER = b'\x01'
+
+def definition_strings(definition):
+	""" Types and senses of text format definition """
+	for group in definition.split(b'\\'):
+		types, _, senses = group.partition(b';')
+		yield from types.split(b',')
+		if len(senses) > 0:
+			yield from senses.split(b'`')
+
+class StringTable:
+	"""
+	Types and senses repeated across definitions (POS tags, common glosses)
+	are stored once, uncompressed, and definitions refer to them with
+	INTERNED_STRING_MARKER followed by base62 id, see string_table_t of
+	wasm/src/dentry.h. Only text format definitions are interned.
+	"""
+	def __init__(self, label, definitions):
+		self.label = f'{label}_strings'
+		self.ids = {}
+		self.strings = []
+		if len(definitions) == 0:
+			return
+
+		counts = Counter(itertools.chain.from_iterable(map(definition_strings, definitions)))
+		# Most frequent strings get shortest ids
+		for string, count in counts.most_common():
+			if count == 1:
+				break
+			assert INTERNED_STRING_MARKER not in string
+			encoded = INTERNED_STRING_MARKER + format_uint_base62(len(self.strings)).encode()
+			# Table costs the string itself and its offset
+			if (len(string) - len(encoded)) * count > len(string) + 4:
+				self.ids[string] = encoded
+				self.strings.append(string)
+
+		plain_size = compressed_size(b'\n'.join(definitions))
+		interned_size = self.size() + compressed_size(b'\n'.join(map(self.encode, definitions)))
+		print(
+			f'{self.label}: {len(self.strings)} interned strings, definitions with them are of size',
+			f'{interned_size / 2**20:.2f}MiB, without - {plain_size / 2**20:.2f}MiB'
+		)
+		if interned_size >= plain_size:
+			self.ids = {}
+			self.strings = []
+
+	def size(self):
+		return sum(map(len, self.strings)) + 4 * (len(self.strings) + 1)
+
+	def encode(self, definition):
+		if len(self.ids) == 0:
+			return definition
+		groups = []
+		for group in definition.split(b'\\'):
+			types, sep, senses = group.partition(b';')
+			group = b','.join(self.ids.get(t, t) for t in types.split(b','))
+			if len(senses) > 0:
+				group += sep + b'`'.join(self.ids.get(s, s) for s in senses.split(b'`'))
+			else:
+				group += sep
+			groups.append(group)
+		return b'\\'.join(groups)
+
+	def write(self, header, module):
+		offsets = list(itertools.accumulate(map(len, self.strings), initial=0))
+		if len(self.strings) > 0:
+			module.add_blob(self.label, b''.join(self.strings))
+			print(f'const uint32_t {self.label}_offsets[] = {{', file=module.source)
+			print(*offsets, sep=',', end='};\n', file=module.source)
+			print(f'extern const uint8_t {self.label}[{offsets[-1]}];', file=header)
+			print(f'extern const uint32_t {self.label}_offsets[{len(offsets)}];', file=header)
+		else:
+			print(f'#define {self.label} NULL', file=header)
+			print(f'#define {self.label}_offsets NULL', file=header)
+		print(f'const size_t {self.label}_count = {len(self.strings)};', file=header)
+
+def line_definition(line, with_entry_id):
+	return line.rsplit(b'\t', 2 if with_entry_id else 1)[1]
+
+def split_definition(line, definition_offset, with_entry_id, strings):
+	"""
+	Splits formatted entry into header - writings, readings, offset of
+	definition and entry id (see dentry_make() of wasm/src/dentry.c), and
+	definition with `strings` interned. Headers and definitions are written
+	to separate files, so search touches only former, and latter are
+	decompressed only for rendered entries.
+	"""
+	if with_entry_id:
+		head, definition, entry_id = line.rsplit(b'\t', 2)
+		tail = b'\t' + entry_id
+	else:
+		head, definition = line.rsplit(b'\t', 1)
+		tail = b''
+	return head + b'\t' + format_uint_base62(definition_offset).encode() + tail, strings.encode(definition)
+
+def write_dictionary(label, dictionary, header, module):
+	headers, definitions, strings = dictionary
+	headers_len = write_blobs(f'{label}_dictionary', b'\n'.join(headers), module, DICTIONARY_CHUNK_SIZE, header)
+	definitions_len = write_blobs(f'{label}_definitions', b'\n'.join(definitions), module, DICTIONARY_CHUNK_SIZE, header)
+	strings.write(header, module)
+	print(
+		f'{label}_dictionary lz4-chunked is of size {(headers_len + definitions_len + strings.size()) / 2**20:.2f}MiB',
+		f'(headers {headers_len / 2**20:.2f}MiB, definitions {definitions_len / 2**20:.2f}MiB,',
+		f'strings {strings.size() / 2**20:.2f}MiB)'
+	)
 
 def write_dictionaries(words_dictionary, names_dictionary):
-	with open('wasm/cflags') as f:
-		flags = f.read().strip().split()
-	flags.insert(0, 'clang')
-	flags.extend([
-		'-c', '-emit-llvm', '--target=wasm32-unknown-unknown-wasm',
-		'-x', 'c', '-o', 'wasm/generated/dictionary.bc', '-'
-	])
-	clang = subprocess.Popen(flags, stdin=subprocess.PIPE, text=True)
-	print('#include <stdint.h>', file=clang.stdin)
-
-	line_lengths = [len(l) for l in words_dictionary] + [len(l) for l in names_dictionary]
+	"""
+	Dictionaries are triples of header lines (index offsets point to),
+	definitions and StringTable, see split_definition()
+	"""
+	module = GeneratedModule('dictionary')
+
+	line_lengths = [len(l) for l in itertools.chain(*words_dictionary[:2], *names_dictionary[:2])]
 	with open('wasm/generated/dictionary.h', 'w') as of:
 		for label, dictionary in zip(('words', 'names'), (words_dictionary, names_dictionary)):
-			write_dictionary(label, dictionary, of, clang.stdin)
+			write_dictionary(label, dictionary, of, module)
 
 		print_lengths_stats('dictionaries', line_lengths)
 		print(f'''
@@ -280,14 +715,12 @@ def write_dictionaries(words_dictionary, names_dictionary):
 			#endif
 		''', file=of)
 
-	print(file=clang.stdin)
-	clang.stdin.close()
-	clang.wait()
+	module.close()
 
 	with open('wasm/generated/dictionary-sample.csv', 'wb') as of:
 		offset = 0
-		for line in words_dictionary:
-			if offset // CHUNK_SIZE != (offset + len(line) + 1) // CHUNK_SIZE:
+		for line in words_dictionary[0]:
+			if offset // DICTIONARY_CHUNK_SIZE != (offset + len(line) + 1) // DICTIONARY_CHUNK_SIZE:
 				of.write(str(offset).encode())
 				of.write(b';')
 				of.write(line)
@@ -295,6 +728,124 @@ def write_dictionaries(words_dictionary, names_dictionary):
 
 			offset += len(line) + 1
 
+KANJI_PAGE_BITS = 8
+
+def pack_kanji_records(records):
+	"""
+	Lays records out so none crosses chunk boundary, so a single kanji lookup
+	decompresses at most one chunk. Chunk tails are padded with newlines,
+	which LZ4 compresses to nothing.
+	"""
+	buf = bytearray()
+	positions = {}
+	for code_point, record in records:
+		assert len(record) < KANJI_CHUNK_SIZE
+		chunk_left = KANJI_CHUNK_SIZE - len(buf) % KANJI_CHUNK_SIZE
+		if len(record) + 1 > chunk_left:
+			buf.extend(b'\n' * chunk_left)
+		positions[code_point] = len(buf)
+		buf.extend(record)
+		buf.extend(b'\n')
+
+	return buf, positions
+
+def write_kanji_table(positions, header, module):
+	"""
+	Two level direct-indexed table: `kanji_pages[code_point >> KANJI_PAGE_BITS]`
+	is a page number plus one (zero - no kanjis on the page), and
+	`kanji_positions[page * page_size + (code_point & page_mask)]`
+	is record position plus one (zero - no such kanji).
+	"""
+	page_size = 1 << KANJI_PAGE_BITS
+	num_page_slots = (max(positions) >> KANJI_PAGE_BITS) + 1
+	pages = [0] * num_page_slots
+	page_positions = []
+	for code_point in sorted(positions):
+		page_slot = code_point >> KANJI_PAGE_BITS
+		if pages[page_slot] == 0:
+			page_positions.append([0] * page_size)
+			pages[page_slot] = len(page_positions)
+		page_positions[pages[page_slot] - 1][code_point & (page_size - 1)] = positions[code_point] + 1
+
+	assert len(page_positions) < 2**16
+	print('const uint16_t kanji_pages[] = {', file=module.source)
+	print(*pages, sep=',', end='};\n', file=module.source)
+	module.add_blob('kanji_positions', struct.pack(f'<{len(page_positions) * page_size}I', *itertools.chain.from_iterable(page_positions)), align=4)
+
+	print(f'#define KANJI_PAGE_BITS {KANJI_PAGE_BITS}', file=header)
+	print(f'extern const uint16_t kanji_pages[{num_page_slots}];', file=header)
+	print(f'extern const uint32_t kanji_positions[{len(page_positions) * page_size}];', file=header)
+
+	return (num_page_slots * 2 + len(page_positions) * page_size * 4)
+
+def write_kanji_dictionary(records, header, module):
+	buf, positions = pack_kanji_records(records)
+	label = 'kanji_dictionary'
+	compressed_len = write_blobs(label, buf, module, KANJI_CHUNK_SIZE, header)
+	table_size = write_kanji_table(positions, header, module)
+	print(f'{label} lz4-chunked is of size {compressed_len / 2**20:.2f}MiB, table - {table_size / 2**10:.2f}KiB')
+
+def kanji_codes(record):
+	codes = {}
+	for code in record.split(b'|')[1].decode().split():
+		key = ''.join(itertools.takewhile(str.isupper, code))
+		codes.setdefault(key, code[len(key):])
+	return codes
+
+def write_radicals(radicals, records, header, module):
+	"""
+	Bitset of kanjis containing radical for every radical. Kanjis are
+	numbered in frequency order, so walking intersection bits yields
+	kanjis already sorted.
+	"""
+	codes = { code_point: kanji_codes(record) for code_point, record in records }
+	def frequency_order(code_point):
+		c = codes.get(code_point, {})
+		return (int(c.get('F', 2**31)), int(c.get('S', 2**31)), code_point)
+	kanjis = sorted(set(itertools.chain.from_iterable(k for _, k in radicals)), key=frequency_order)
+	kanji_numbers = { code_point: i for i, code_point in enumerate(kanjis) }
+
+	# Whole number of 16-byte vectors
+	bitset_words = (len(kanjis) + 127) // 128 * 2
+	bitsets = []
+	for _, radical_kanjis in radicals:
+		bitset = [0] * bitset_words
+		for code_point in radical_kanjis:
+			i = kanji_numbers[code_point]
+			bitset[i // 64] |= 1 << (i % 64)
+		bitsets.extend(bitset)
+
+	names = '\n'.join(r for r, _ in radicals).encode()
+	module.add_blob('radical_names', names)
+	module.add_blob('radical_bitsets', struct.pack(f'<{len(bitsets)}Q', *bitsets), align=16)
+	print('const uint32_t radical_kanjis[] = {', file=module.source)
+	print(*kanjis, sep=',', end='};\n', file=module.source)
+	print('const uint8_t radical_kanji_strokes[] = {', file=module.source)
+	print(*(min(int(codes.get(k, {}).get('S', 0)), 255) for k in kanjis), sep=',', end='};\n', file=module.source)
+
+	print(f'#define NUM_RADICALS {len(radicals)}', file=header)
+	print(f'#define NUM_RADICAL_KANJIS {len(kanjis)}', file=header)
+	print(f'#define RADICAL_BITSET_WORDS {bitset_words}', file=header)
+	# Newline separated utf-8
+	print(f'extern const uint8_t radical_names[{len(names)}];', file=header)
+	print('extern const uint64_t radical_bitsets[NUM_RADICALS * RADICAL_BITSET_WORDS];', file=header)
+	print('extern const uint32_t radical_kanjis[NUM_RADICAL_KANJIS];', file=header)
+	print('extern const uint8_t radical_kanji_strokes[NUM_RADICAL_KANJIS];', file=header)
+
+	table_size = len(names) + len(bitsets) * 8 + len(kanjis) * 5
+	print(f'radical bitsets over {len(kanjis)} kanjis are of size {table_size / 2**10:.2f}KiB')
+
+def write_kanji(records, radicals):
+	module = GeneratedModule('kanji')
+
+	with open('wasm/generated/kanji.h', 'w') as of:
+		print('#include <stddef.h>', file=of)
+		print('#include <stdint.h>', file=of)
+		write_kanji_dictionary(records, of, module)
+		write_radicals(radicals, records, of, module)
+
+	module.close()
+
 if __name__ == '__main__':
 	get_lz4_source()
 	generate_deinflection_rules_header()
@@ -338,6 +889,7 @@ if __name__ == '__main__':
 			res.append(v)
 	print('\n', *(f'0x{v:08X}, ' for v in res), sep='')
 
+	TEST_CHUNK_SIZE = 2048
 	test_entries = [
 		('五劫の', 750),
 		('住む処', 750),
@@ -369,16 +921,26 @@ if __name__ == '__main__':
 	assert all(len(k.encode('utf-16le')) == len(k) * 2 for k in test_index)
 
 	line_lengths = []
+	# Test index chunks are compressed independently, and same chunks
+	# against a dictionary are `test_dict_index`
+	LZ4_DICT_SIZE = 0
 	with open('wasm/generated/index.test.c', 'w') as of:
 		print('#include <stddef.h>', file=of)
 		print('#include <stdint.h>', file=of)
-		buf = write_utf16_index('test', test_index, line_lengths, of, of)
+		buf = write_utf16_index('test', test_index, line_lengths, of, InlineModule(of), TEST_CHUNK_SIZE)
+		# Only あ, い and う share their list, え's one is too short
+		shared_postings = [1, 2, 3, TypedOffset(4, 5)]
+		test_shared_index = {'あ': shared_postings, 'い': shared_postings, 'う': shared_postings, 'え': [6]}
+		shared = share_postings(test_shared_index)
+		assert shared.positions == {'あ': 1, 'い': 1, 'う': 1}
+		write_utf16_index('test_shared', test_shared_index, [], of, InlineModule(of), TEST_CHUNK_SIZE, shared)
+		write_blobs('test_dict_index', buf, InlineModule(of), TEST_CHUNK_SIZE, of, lz4_dict=bytes(buf[:TEST_CHUNK_SIZE]))
 		print('const uint8_t test_dictionary_index_original_data[] = {', ','.join(map(str, buf)), '};', file=of)
 		test_entries_offsets = [0]
 		for l in line_lengths:
 			test_entries_offsets.append(test_entries_offsets[-1] + l)
 		print('const size_t test_dictionary_index_entries_offsets[] = {', ','.join(map(str, test_entries_offsets)), '};', file=of)
 	assert line_lengths == gold_line_length, f'{line_lengths}\n{gold_line_length}'
-	assert sum(line_lengths[:2]) < CHUNK_SIZE and sum(line_lengths[:3]) > CHUNK_SIZE
-	assert sum(line_lengths[:5]) == CHUNK_SIZE * 2 - 4
-	assert sum(line_lengths[:8]) == CHUNK_SIZE * 3
+	assert sum(line_lengths[:2]) < TEST_CHUNK_SIZE and sum(line_lengths[:3]) > TEST_CHUNK_SIZE
+	assert sum(line_lengths[:5]) == TEST_CHUNK_SIZE * 2 - 4
+	assert sum(line_lengths[:8]) == TEST_CHUNK_SIZE * 3
@@ -115,31 +115,234 @@ function print(ptr) {
 	console.log(readCString(ptr));
 }
 
+// Smallest modules using memory.copy and v128 instructions respectively
+const BULK_MEMORY_PROBE = new Uint8Array([
+	0, 97, 115, 109, 1, 0, 0, 0, 1, 4, 1, 96, 0, 0, 3, 2, 1, 0, 5, 3, 1, 0, 1,
+	10, 14, 1, 12, 0, 65, 0, 65, 0, 65, 0, 252, 10, 0, 0, 11,
+]);
+const SIMD128_PROBE = new Uint8Array([
+	0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0,
+	10, 10, 1, 8, 0, 65, 0, 253, 15, 253, 98, 11,
+]);
+
+// Picks the fastest of rikai.wasm variants built by wasm/Makefile,
+// which engine supports. Plain rikai.wasm runs everywhere.
+function wasmModuleUrl() {
+	const bulkMemory = WebAssembly.validate(BULK_MEMORY_PROBE);
+	const simd128 = WebAssembly.validate(SIMD128_PROBE);
+	if (bulkMemory && simd128) {
+		return '/wasm/rikai.bulk-memory+simd128.wasm';
+	}
+	if (bulkMemory) {
+		return '/wasm/rikai.bulk-memory.wasm';
+	}
+	if (simd128) {
+		return '/wasm/rikai.simd128.wasm';
+	}
+	return '/wasm/rikai.wasm';
+}
+
+// Dictionaries generated with --external-data, see ExternalData in data/wasm_generator.py
+const EXTERNAL_DATA_URL = '/wasm/generated/rikai.dat';
+
+async function loadExternalData() {
+	try {
+		const response = await fetch(EXTERNAL_DATA_URL);
+		return response.ok ? new DataView(await response.arrayBuffer()) : null;
+	} catch(err) {
+		// Reported by readChunk()
+		return null;
+	}
+}
+
+// See read_chunk() in wasm/src/imports.h
+function readChunk(fileId, chunkIndex, dst, capacity) {
+	const data = Module.externalData;
+	if (!data) {
+		onError('No external data');
+		throw new Error('No external data');
+	}
+	const tablePosition = data.getUint32(4 + 4 * fileId, true);
+	const start = data.getUint32(tablePosition + 4 * chunkIndex, true);
+	const end = data.getUint32(tablePosition + 4 * (chunkIndex + 1), true);
+	if (end - start > capacity) {
+		return 0;
+	}
+	new Uint8Array(Module.instance.exports.memory.buffer, dst, end - start)
+		.set(new Uint8Array(data.buffer, start, end - start));
+	return end - start;
+}
+
 async function rikaiguEnable(tab) {
 	if (!!window.Module) {
 		console.error("Double enable");
 		return;
 	}
+	let wasm;
 	try {
-		window.Module = await WebAssembly.instantiateStreaming(
-			fetch('/wasm/rikai.wasm'),
+		wasm = await WebAssembly.instantiateStreaming(
+			fetch(wasmModuleUrl()),
 			{ env: {
 				take_a_trip: takeATrip,
 				print: print,
+				read_chunk: readChunk,
 			}}
 		);
 	} catch(err) {
 		onError(err);
+		return;
+	}
+	// Dictionaries of other builds are linked into the module
+	if (wasm.instance.exports.rikaigu_uses_external_data()) {
+		wasm.externalData = await loadExternalData();
 	}
+	window.Module = wasm;
 
+	savedArenaPeakSizes().forEach((peakSize, bufferIndex) => {
+		Module.instance.exports.rikaigu_set_reserved_size(bufferIndex, peakSize);
+	});
 	Module.inputDataOffset = Module.instance.exports.rikaigu_set_config(
 		Module.instance.exports.__heap_base,
 		Module.instance.exports.memory.buffer.byteLength,
 	);
+	importReviewList(config.reviewList, Object.keys(config.reviewList).map(Number));
+	importSrsState(config.srsState);
 
 	onLoaded(tab);
 }
 
+function importReviewList(reviewList, entryIds) {
+	if (entryIds.length === 0) {
+		return;
+	}
+	if (entryIds.length === 1) {
+		// Keeps render cache, which bulk import flushes
+		Module.instance.exports.review_list_add_entry(entryIds[0]);
+		setReviewContext(entryIds[0], reviewList[entryIds[0]]);
+		return;
+	}
+	const ptr = Module.instance.exports.review_list_import_buffer(entryIds.length);
+	new Uint32Array(Module.instance.exports.memory.buffer, ptr, entryIds.length).set(entryIds);
+	Module.instance.exports.review_list_import(entryIds.length);
+	importReviewContexts(reviewList, entryIds);
+}
+
+const reviewContextEncoder = new TextEncoder();
+
+function setReviewContext(entryId, context) {
+	const text = reviewContextEncoder.encode(context || '');
+	const ptr = Module.instance.exports.review_list_context_buffer(text.length);
+	new Uint8Array(Module.instance.exports.memory.buffer, ptr, text.length).set(text);
+	if (!Module.instance.exports.review_list_set_context(entryId, text.length) && text.length > 0) {
+		console.error('Review context of', entryId, 'is too long to be kept');
+	}
+}
+
+// Record layout is described at review_list_import_contexts() in wasm/src/review_list.c
+function importReviewContexts(reviewList, entryIds) {
+	const contexts = entryIds
+		.map(entryId => [entryId, reviewContextEncoder.encode(reviewList[entryId] || '')])
+		.filter(([, text]) => text.length > 0);
+	if (contexts.length === 0) {
+		return;
+	}
+
+	const recordSize = text => 8 + ((text.length + 3) & ~3);
+	const size = contexts.reduce((size, [, text]) => size + recordSize(text), 0);
+	const ptr = Module.instance.exports.review_list_context_buffer(size);
+	// Memory may have grown, so views are taken after allocation
+	const view = new DataView(Module.instance.exports.memory.buffer, ptr, size);
+	const bytes = new Uint8Array(Module.instance.exports.memory.buffer, ptr, size);
+	let offset = 0;
+	for (const [entryId, text] of contexts) {
+		view.setUint32(offset, entryId, true);
+		view.setUint32(offset + 4, text.length, true);
+		bytes.set(text, offset + 8);
+		offset += recordSize(text);
+	}
+	const numDropped = Module.instance.exports.review_list_import_contexts(size);
+	if (numDropped > 0) {
+		console.error(numDropped, 'review contexts are too long to be kept');
+	}
+}
+
+// State is kept as flat array of uint32 words, see srs_record_t in wasm/src/srs.c
+function importSrsState(srsState) {
+	const numCards = srsState.length / 4;
+	if (numCards === 0) {
+		return;
+	}
+	const ptr = Module.instance.exports.srs_import_buffer(numCards);
+	new Uint32Array(Module.instance.exports.memory.buffer, ptr, srsState.length).set(srsState);
+	Module.instance.exports.srs_import(numCards);
+}
+
+function readSrsState() {
+	const [ptr, size] = unpackBuffer(Module.instance.exports.srs_get_state());
+	return Array.from(new Uint32Array(Module.instance.exports.memory.buffer, ptr, size / 4));
+}
+
+// Whole state is written, so grades of a review session are
+// saved together, at most once in srsSaveDelay milliseconds
+const srsSaveDelay = 5000;
+let srsSaveTimeout = null;
+
+function scheduleSrsStateSave() {
+	if (srsSaveTimeout === null) {
+		srsSaveTimeout = setTimeout(saveSrsState, srsSaveDelay);
+	}
+}
+
+function saveSrsState() {
+	clearTimeout(srsSaveTimeout);
+	srsSaveTimeout = null;
+	browser.storage.local.set({srsState: readSrsState()});
+}
+
+function nowSeconds() {
+	return Math.floor(Date.now() / 1000);
+}
+
+function getDueEntries(maxCards) {
+	const [ptr, size] = unpackBuffer(Module.instance.exports.srs_get_due(nowSeconds(), maxCards));
+	return Array.from(new Uint32Array(Module.instance.exports.memory.buffer, ptr, size / 4));
+}
+
+// Grades are 0 - again, 1 - hard, 2 - good, 3 - easy
+function gradeEntry(entryId, grade) {
+	const due = Module.instance.exports.srs_grade(entryId, grade, nowSeconds());
+	scheduleSrsStateSave();
+	return due;
+}
+
+// Profile saved with another buffers layout (or an array, saved before
+// layouts were versioned) would reserve sizes for wrong buffers
+function savedArenaPeakSizes() {
+	const profile = config.arenaProfile;
+	if (profile.layoutVersion !== Module.instance.exports.rikaigu_get_arena_layout_version()) {
+		return [];
+	}
+	return profile.peakSizes;
+}
+
+// Mirrors arena_stats_t from wasm/src/state.h
+function readArenaStats() {
+	const ptr = Module.instance.exports.rikaigu_get_arena_stats();
+	const numBuffers = new Uint32Array(Module.instance.exports.memory.buffer, ptr, 1)[0];
+	const fields = new Uint32Array(Module.instance.exports.memory.buffer, ptr + 4, numBuffers * 5);
+	const stats = [];
+	for (let i = 0; i < numBuffers; i += 1) {
+		stats.push({
+			capacity: fields[i * 5],
+			size: fields[i * 5 + 1],
+			peakSize: fields[i * 5 + 2],
+			numEnlargements: fields[i * 5 + 3],
+			enlargedBytes: fields[i * 5 + 4],
+		});
+	}
+	return stats;
+}
+
 function rikaiguDisable() {
 	// Send a disable message to all browsers
 	browser.windows.getAll({
@@ -155,7 +358,20 @@ function rikaiguDisable() {
 				}
 			}
 		});
-	browser.storage.local.set({'reload': true});
+	const reloadConfig = {'reload': true};
+	if (!!window.Module) {
+		// Next time buffers will be reserved big enough to never grow
+		const savedPeakSizes = savedArenaPeakSizes();
+		reloadConfig.arenaProfile = {
+			layoutVersion: Module.instance.exports.rikaigu_get_arena_layout_version(),
+			peakSizes: readArenaStats().map((stats, i) => Math.max(stats.peakSize, savedPeakSizes[i] || 0)),
+		};
+		if (srsSaveTimeout !== null) {
+			clearTimeout(srsSaveTimeout);
+			reloadConfig.srsState = readSrsState();
+		}
+	}
+	browser.storage.local.set(reloadConfig);
 	location.reload();
 }
 
@@ -166,10 +382,15 @@ function writeInputText(text) {
 	}
 }
 
+// Exports return pointer and size of the output packed in a double
+function unpackBuffer(packed) {
+	const ptr = packed % Math.pow(2, 32);
+	const size = (packed - ptr) / Math.pow(2, 32);
+	return [ptr, size];
+}
+
 function sendHtmlToTab(tabId, request, matchLength) {
-	let res = Module.instance.exports.get_html();
-	const htmlPtr = res % Math.pow(2, 32);
-	const htmlLength = (res - htmlPtr) / Math.pow(2, 32);
+	const [htmlPtr, htmlLength] = unpackBuffer(Module.instance.exports.get_html());
 
 	const htmlView = new Uint8Array(Module.instance.exports.memory.buffer, htmlPtr, htmlLength);
 	const html = decoder.decode(htmlView);
@@ -182,7 +403,66 @@ function sendHtmlToTab(tabId, request, matchLength) {
 	});
 }
 
+// Same order as kanjiInfoKeys in options.js
+const kanjiInfoKeys = ["H", "L", "E", "DK", "N", "V", "Y", "P", "IN", "I", "U"];
+const kanjiWordsCount = 8;
+
+function kanjiSearch(request, tabId) {
+	const codePoint = request.text.codePointAt(0);
+	const matchLength = codePoint === undefined ? 0 : Module.instance.exports.rikaigu_kanji_search(codePoint);
+	if (matchLength > 0) {
+		const enabledKeys = config.kanjiInfo.split(' ');
+		const infoMask = kanjiInfoKeys.reduce(
+			(mask, key, i) => enabledKeys.includes(key) ? (mask | (1 << i)) : mask, 0);
+		const [htmlPtr, htmlLength] = unpackBuffer(Module.instance.exports.get_kanji_html(infoMask));
+		let html = decoder.decode(new Uint8Array(Module.instance.exports.memory.buffer, htmlPtr, htmlLength));
+
+		// Common words containing the kanji go below it
+		if (Module.instance.exports.rikaigu_kanji_words_search(codePoint, kanjiWordsCount) > 0) {
+			const [wordsPtr, wordsLength] = unpackBuffer(Module.instance.exports.get_html());
+			html += decoder.decode(new Uint8Array(Module.instance.exports.memory.buffer, wordsPtr, wordsLength));
+		}
+
+		browser.tabs.sendMessage(tabId, {
+			"type": "show",
+			"html": html,
+			"match": request.text.substring(0, matchLength),
+			"renderParams": request.renderParams,
+		});
+	}
+
+	return matchLength;
+}
+
+let radicalNames = null;
+
+function getRadicalNames() {
+	if (radicalNames === null) {
+		const [ptr, size] = unpackBuffer(Module.instance.exports.get_radical_names());
+		radicalNames = decoder.decode(new Uint8Array(Module.instance.exports.memory.buffer, ptr, size)).split('\n');
+	}
+	return radicalNames;
+}
+
+// Returns kanjis containing every one of `radicals` (names from getRadicalNames()),
+// most frequent first
+function radicalSearch(radicals, minStrokes = 0, maxStrokes = 255) {
+	const names = getRadicalNames();
+	const indices = radicals.map(r => names.indexOf(r)).filter(i => i >= 0);
+	const ptr = Module.instance.exports.radical_search_buffer(indices.length);
+	new Uint8Array(Module.instance.exports.memory.buffer, ptr, indices.length).set(indices);
+
+	const [resultPtr, resultSize] = unpackBuffer(
+		Module.instance.exports.get_radical_search(indices.length, minStrokes, maxStrokes));
+	const codePoints = new Uint32Array(Module.instance.exports.memory.buffer, resultPtr, resultSize / 4);
+	return String.fromCodePoint(...codePoints);
+}
+
 function search(request, tabId) {
+	if (config.defaultDict === 2) {
+		return kanjiSearch(request, tabId);
+	}
+
 	writeInputText(request.text);
 	const matchLength = Module.instance.exports.rikaigu_search(request.text.length);
 	if (matchLength > 0) {
@@ -205,6 +485,26 @@ function onMessage(request, sender, response) {
 
 			break;
 
+		case 'radical-names':
+			if (rikaiguError || !window.Module) return;
+			response({radicals: getRadicalNames()});
+			break;
+
+		case 'radical-search':
+			if (rikaiguError || !window.Module) return;
+			response({kanjis: radicalSearch(request.radicals, request.minStrokes, request.maxStrokes)});
+			break;
+
+		case 'srs-due':
+			if (rikaiguError || !window.Module) return;
+			response({entryIds: getDueEntries(request.maxCards)});
+			break;
+
+		case 'srs-grade':
+			if (rikaiguError || !window.Module) return;
+			response({due: gradeEntry(request.entryId, request.grade)});
+			break;
+
 		case 'relay':
 			request.type = request.targetType;
 			if ('frameId' in request) {
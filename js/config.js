@@ -15,11 +15,14 @@ function onConfigChange(configChange) {
 		}
 
 		for (var key of Object.keys(newReviewList)) {
-			console.assert(typeof key === "number");
-			if (!(key in oldReviewList)) {
-				Module.instance.exports.review_list_add_entry(Number(key));
+			if (key in oldReviewList && newReviewList[key] !== oldReviewList[key]) {
+				setReviewContext(Number(key), newReviewList[key]);
 			}
 		}
+
+		importReviewList(newReviewList, Object.keys(newReviewList)
+			.filter(key => !(key in oldReviewList))
+			.map(Number));
 	}
 }
 
@@ -38,6 +41,11 @@ function initConfig(config) {
 		'configVersion': 'v1.0.0',
 		'autostart': false,
 		'reviewList': {},
+		// Scheduler state of review list entries, see importSrsState()
+		'srsState': [],
+		// Peak sizes of wasm state buffers by index, valid for
+		// their layout version only, see readArenaStats()
+		'arenaProfile': {'layoutVersion': 0, 'peakSizes': []},
 	};
 
 	var needUpdate = false;
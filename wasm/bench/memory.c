@@ -0,0 +1,116 @@
+/*
+ * Native throughput benchmark of block memory functions from src/libc.c
+ * over sizes typical for buffer_allocate() copies.
+ *
+ * Built twice by Makefile: with backend selected for the host
+ * and with RIKAIGU_SCALAR_MEMORY, so both can be compared.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <stdnoreturn.h>
+
+#include "../src/libc.c"
+#include "../src/utf.c"
+
+// Bytes processed per size and function
+#define bytes_per_run (1 << 28)
+#define max_size (1 << 16)
+
+noreturn void take_a_trip(const char* error)
+{
+	fprintf(stderr, "%s\n", error);
+	abort();
+}
+
+void print(const char* s)
+{
+	printf("print('%s')\n", s);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Slack for unaligned and overlapping accesses
+static uint8_t src_buffer[max_size + 64];
+static uint8_t dest_buffer[max_size + 64];
+
+static void report(const char* name, size_t size, size_t iterations, uint64_t elapsed)
+{
+	printf("%-16s %6zu B: %8.2f ns/op, %6.2f GB/s\n",
+		name, size,
+		(double)elapsed / (double)iterations,
+		(double)(size * iterations) / (double)elapsed
+	);
+}
+
+int main(void)
+{
+	for (size_t i = 0; i < sizeof(src_buffer); ++i)
+	{
+		src_buffer[i] = (uint8_t)i;
+	}
+
+#if defined(MEMORY_BACKEND_BULK)
+	printf("backend: bulk memory\n");
+#elif defined(MEMORY_BACKEND_VECTOR)
+	printf("backend: 16-byte vectors\n");
+#else
+	printf("backend: 8-byte scalar\n");
+#endif
+
+	uint64_t checksum = 0;
+	for (size_t size = 16; size <= max_size; size *= 4)
+	{
+		const size_t iterations = bytes_per_run / size;
+
+		uint64_t start = now_ns();
+		for (size_t i = 0; i < iterations; ++i)
+		{
+			memcpy(dest_buffer, src_buffer, size);
+			checksum += dest_buffer[i % size];
+		}
+		report("memcpy", size, iterations, now_ns() - start);
+
+		start = now_ns();
+		for (size_t i = 0; i < iterations; ++i)
+		{
+			memcpy(dest_buffer + 1, src_buffer + 3, size);
+			checksum += dest_buffer[i % size];
+		}
+		report("memcpy unaligned", size, iterations, now_ns() - start);
+
+		start = now_ns();
+		for (size_t i = 0; i < iterations; ++i)
+		{
+			// Alternating directions, like vardata_array insertions and removals
+			if (i % 2 == 0)
+			{
+				memmove(dest_buffer + 8, dest_buffer, size);
+			}
+			else
+			{
+				memmove(dest_buffer, dest_buffer + 8, size);
+			}
+			checksum += dest_buffer[i % size];
+		}
+		report("memmove", size, iterations, now_ns() - start);
+
+		start = now_ns();
+		for (size_t i = 0; i < iterations; ++i)
+		{
+			memzero(dest_buffer, size);
+			checksum += dest_buffer[i % size];
+		}
+		report("memzero", size, iterations, now_ns() - start);
+	}
+
+	// Keeps loops from being optimized out
+	printf("checksum: %lu\n", (unsigned long)checksum);
+	return 0;
+}
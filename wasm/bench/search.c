@@ -0,0 +1,219 @@
+/*
+ * Native latency benchmark of search + html rendering.
+ *
+ * Replays hovering over every position of every line of workload
+ * file (like content script does, up to `max_word_length` characters
+ * per request) and reports latency distribution.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <stdnoreturn.h>
+
+#include "../src/state.h"
+#include "../src/utf.h"
+#include "../src/html_render.h"
+#include "../src/decompress.h"
+#include "../generated/config.h"
+
+// Same as maxWordLength in js/selection.js
+#define max_word_length 13
+#define max_queries (1<<16)
+#define memory_max_pages 1024
+
+void init(size_t heap_base, size_t free_size);
+uint32_t rikaigu_search(size_t utf16_input_length);
+wchar_t decode_utf8_wchar(const char** pUtf8);
+
+static uint8_t* wasm_memory = NULL;
+static size_t wasm_memory_size_pages = 0;
+
+size_t __builtin_wasm_memory_size(int memory_index)
+{
+	assert(memory_index == 0);
+	return wasm_memory_size_pages;
+}
+
+size_t __builtin_wasm_memory_grow(int memory_index, size_t num_pages)
+{
+	assert(memory_index == 0);
+	if (wasm_memory_size_pages + num_pages > memory_max_pages)
+	{
+		return (size_t)-1;
+	}
+
+	size_t old_size_pages = wasm_memory_size_pages;
+	wasm_memory_size_pages += num_pages;
+	return old_size_pages;
+}
+
+noreturn void take_a_trip(const char* error)
+{
+	fprintf(stderr, "%s\n", error);
+	abort();
+}
+
+void print(const char* s)
+{
+	printf("print('%s')\n", s);
+}
+
+// Same as loadExternalData() and readChunk() of js/background.js, for
+// data prepared with --external-data. Built with NDEBUG, so no asserts here.
+uint32_t read_chunk(uint32_t file_id, uint32_t chunk_index, uint8_t* dst, uint32_t capacity)
+{
+	static FILE* f = NULL;
+	if (f == NULL && (f = fopen("generated/rikai.dat", "rb")) == NULL)
+	{
+		take_a_trip("can't open generated/rikai.dat");
+	}
+
+	uint32_t table_position;
+	uint32_t chunk_range[2];
+	if (fseek(f, 4 + 4 * (long)file_id, SEEK_SET) != 0
+		|| fread(&table_position, sizeof(table_position), 1, f) != 1
+		|| fseek(f, table_position + 4 * (long)chunk_index, SEEK_SET) != 0
+		|| fread(chunk_range, sizeof(chunk_range[0]), 2, f) != 2
+		|| fseek(f, chunk_range[0], SEEK_SET) != 0)
+	{
+		take_a_trip("can't read chunk table of generated/rikai.dat");
+	}
+	if (chunk_range[1] - chunk_range[0] > capacity)
+	{
+		return 0;
+	}
+	return (uint32_t)fread(dst, 1, chunk_range[1] - chunk_range[0], f);
+}
+
+static size_t utf8_to_utf16(const char* utf8, const char* const end, char16_t* out)
+{
+	size_t length = 0;
+	while (utf8 < end)
+	{
+		wchar_t c = decode_utf8_wchar(&utf8);
+		if (c >= 0x10000)
+		{
+			c -= 0x10000;
+			out[length] = (char16_t)(0xD800 + (c >> 10));
+			out[length + 1] = (char16_t)(0xDC00 + (c & 0x3FF));
+			length += 2;
+		}
+		else
+		{
+			out[length] = (char16_t)c;
+			length += 1;
+		}
+	}
+	return length;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static int uint64_cmp(const void* a, const void* b)
+{
+	const uint64_t x = *(const uint64_t*)a;
+	const uint64_t y = *(const uint64_t*)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static uint64_t latencies[max_queries];
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "Usage: %s workload.txt [repeats]\n", argv[0]);
+		return 1;
+	}
+	const int repeats = argc > 2 ? atoi(argv[2]) : 5;
+
+	FILE* f = fopen(argv[1], "r");
+	if (f == NULL)
+	{
+		perror(argv[1]);
+		return 1;
+	}
+
+	wasm_memory = aligned_alloc(1<<16, memory_max_pages * (1<<16));
+	wasm_memory_size_pages = 1;
+	init((size_t)wasm_memory, wasm_memory_size_pages * (1<<16));
+
+	char line[4096];
+	char16_t text[4096];
+	size_t num_queries = 0;
+	size_t num_matched = 0;
+	size_t html_bytes = 0;
+	const size_t initial_decompressed_chunks = num_decompressed_chunks;
+	const size_t initial_decompressed_bytes = num_decompressed_bytes;
+	for (int repeat = 0; repeat < repeats; ++repeat)
+	{
+		rewind(f);
+		while (fgets(line, sizeof(line), f) != NULL)
+		{
+			const size_t text_length = utf8_to_utf16(line, line + strcspn(line, "\n"), text);
+			for (size_t i = 0; i < text_length && num_queries < max_queries; ++i)
+			{
+				const size_t length = text_length - i < max_word_length ? text_length - i : max_word_length;
+				input_t* input = state_get_input();
+
+				const uint64_t start = now_ns();
+				memcpy(input->data, text + i, length * sizeof(char16_t));
+				if (rikaigu_search(length) > 0)
+				{
+					make_html();
+					num_matched += 1;
+					html_bytes += state_get_html_buffer()->size;
+				}
+				latencies[num_queries] = now_ns() - start;
+				num_queries += 1;
+			}
+		}
+	}
+	fclose(f);
+
+	if (num_queries == 0)
+	{
+		fprintf(stderr, "Empty workload\n");
+		return 1;
+	}
+
+	uint64_t total = 0;
+	for (size_t i = 0; i < num_queries; ++i)
+	{
+		total += latencies[i];
+	}
+	qsort(latencies, num_queries, sizeof(uint64_t), uint64_cmp);
+
+	printf("definitions format: %s\n", PRERENDERED_DEFINITIONS ? "prerendered html" : "text");
+	printf("queries: %zu (%zu matched), mean html size: %zu bytes\n",
+		num_queries, num_matched, num_matched > 0 ? html_bytes / num_matched : 0);
+	printf("decompressed chunks per query: %.2f, bytes per query: %.0f\n",
+		(double)(num_decompressed_chunks - initial_decompressed_chunks) / (double)num_queries,
+		(double)(num_decompressed_bytes - initial_decompressed_bytes) / (double)num_queries);
+	printf("latency: mean %.1fus, p50 %.1fus, p99 %.1fus, max %.1fus\n",
+		(double)total / (double)num_queries / 1000.0,
+		(double)latencies[num_queries / 2] / 1000.0,
+		(double)latencies[num_queries * 99 / 100] / 1000.0,
+		(double)latencies[num_queries - 1] / 1000.0
+	);
+
+	// Candidates for reserved_sizes in src/state.c
+	const arena_stats_t* arena_stats = rikaigu_get_arena_stats();
+	printf("arena peak sizes:");
+	for (size_t i = 0; i < arena_stats->num_buffers; ++i)
+	{
+		printf(" %zu", arena_stats->buffers[i].peak_size);
+	}
+	printf(", html buffer grown %zu times\n", arena_stats->buffers[arena_stats->num_buffers - 1].num_enlargements);
+
+	free(wasm_memory);
+	return 0;
+}
@@ -0,0 +1,268 @@
+#!/usr/bin/env python3
+"""
+Sweep of chunk sizes and codecs of dictionaries and indexes.
+
+For every combination of index chunk size, dictionary chunk size and codec
+reports compressed size of words and names dictionaries and indexes. Codecs
+the engine decodes (`lz4` and `lz4hc`, which share LZ4 block format, and
+their `-dict` variants with trained dictionary, see LZ4_DICT_SIZE of
+data/wasm_generator.py) are written to wasm/generated, build/search.bench
+is rebuilt and replays bench/workload.txt, reporting decompressed chunks
+per query and p50/p99 latency. `zstd` (when `zstandard` module is
+installed) is measured offline: its latency is estimated from `lz4` run of
+the same chunk sizes plus difference of mean chunk decoding time, measured
+here in Python.
+
+Formatted dictionaries come from data/prepare-dict.py cache, so it's fast
+after the first run. Dictionaries are prepared with the flags the tree was
+built with (PREPARE_DICT_FLAGS, as recorded in wasm/generated/config.h),
+and in the end wasm/generated is restored as it was before the sweep.
+
+Run with `make sweep` from wasm/ (or from the repository root).
+"""
+import argparse
+import collections
+import importlib.util
+import itertools
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+os.chdir(os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..'))
+sys.path.insert(0, 'data')
+
+import lz4.block
+import wasm_generator
+
+try:
+	import zstandard
+except ImportError:
+	zstandard = None
+
+# Codec name -> CODEC and LZ4_DICT_SIZE of wasm_generator
+ENGINE_CODECS = {
+	'lz4': ('lz4', 0),
+	'lz4hc': ('lz4hc', 0),
+	'lz4-dict': ('lz4', wasm_generator.LZ4_DICT_SIZE),
+	'lz4hc-dict': ('lz4hc', wasm_generator.LZ4_DICT_SIZE),
+}
+ZSTD_DICT_SIZE = 1 << 16
+ZSTD_LEVEL = 19
+
+def load_prepare_dict():
+	spec = importlib.util.spec_from_file_location('prepare_dict', 'data/prepare-dict.py')
+	module = importlib.util.module_from_spec(spec)
+	# For multiprocessing to pickle its functions
+	sys.modules[spec.name] = module
+	spec.loader.exec_module(module)
+	return module
+
+def split_chunks(buf, chunk_size):
+	return [buf[chunk_start:chunk_start + chunk_size] for chunk_start in range(0, len(buf), chunk_size)]
+
+def sample_chunks(chunks, size):
+	""" Evenly spread chunks, `size` bytes in total """
+	step = max(1, len(chunks) * len(chunks[0]) // size)
+	return chunks[::step]
+
+class Lz4Codec:
+	def __init__(self, mode, dictionary=b''):
+		self.mode = mode
+		self.dict = dictionary
+
+	def compress(self, chunk):
+		return lz4.block.compress(chunk, mode=self.mode, store_size=False, dict=self.dict)
+
+	def decompress(self, compressed, size):
+		return lz4.block.decompress(compressed, uncompressed_size=size, dict=self.dict)
+
+class ZstdCodec:
+	def __init__(self, chunks):
+		samples = sample_chunks(chunks, 100 * ZSTD_DICT_SIZE)
+		dictionary = zstandard.train_dictionary(ZSTD_DICT_SIZE, samples) if len(samples) > 7 else None
+		self.compressor = zstandard.ZstdCompressor(
+			level=ZSTD_LEVEL, dict_data=dictionary,
+			write_checksum=False, write_content_size=False, write_dict_id=False
+		)
+		self.decompressor = zstandard.ZstdDecompressor(dict_data=dictionary)
+		self.dict = dictionary.as_bytes() if dictionary is not None else b''
+
+	def compress(self, chunk):
+		return self.compressor.compress(chunk)
+
+	def decompress(self, compressed, size):
+		return self.decompressor.decompress(compressed, max_output_size=size)
+
+def lz4_codec(generator_codec, dict_size):
+	mode = 'high_compression' if generator_codec == 'lz4hc' else 'default'
+	return lambda chunks: Lz4Codec(mode, wasm_generator.train_lz4_dict(chunks, dict_size) if dict_size > 0 else b'')
+
+# Codec name -> factory taking chunks to be compressed
+CODECS = {codec: lz4_codec(*params) for codec, params in ENGINE_CODECS.items()}
+if zstandard is not None:
+	CODECS['zstd'] = ZstdCodec
+
+def measure_offline(codec_name, buf, chunk_size):
+	"""
+	Returns compressed size (dictionary included), total decoding time
+	and number of decoded chunks
+	"""
+	chunks = split_chunks(buf, chunk_size)
+	codec = CODECS[codec_name](chunks)
+	compressed_chunks = list(map(codec.compress, chunks))
+
+	start = time.perf_counter()
+	for chunk, compressed in zip(chunks, compressed_chunks):
+		assert codec.decompress(compressed, len(chunk)) == chunk
+	elapsed = time.perf_counter() - start
+
+	return len(codec.dict) + sum(map(len, compressed_chunks)), elapsed, len(chunks)
+
+def measure_sizes(codec, bufs):
+	""" Returns total compressed size of (buf, chunk_size) pairs and mean decoding time of their chunk """
+	size, elapsed, num_chunks = map(sum, zip(*(measure_offline(codec, buf, chunk_size) for buf, chunk_size in bufs)))
+	return size, elapsed / num_chunks * 1e6
+
+BuildFlags = collections.namedtuple('BuildFlags', 'prerendered_html, locality_order, external_data')
+
+def read_build_flags():
+	""" Flags of data/prepare-dict.py the tree is built with, see generate_config_header() of wasm_generator """
+	with open('wasm/generated/config.h') as f:
+		config = f.read()
+	def flag(name):
+		match = re.search(rf'#define {name} (\d+)', config)
+		return match is not None and int(match.group(1)) != 0
+	return BuildFlags(flag('PRERENDERED_DEFINITIONS'), flag('LOCALITY_ORDERED_WORDS'), flag('EXTERNAL_DATA'))
+
+def generate(prepare_dict, data, flags, index_chunk_size, dictionary_chunk_size, codec, lz4_dict_size):
+	wasm_generator.INDEX_CHUNK_SIZE = index_chunk_size
+	wasm_generator.DICTIONARY_CHUNK_SIZE = dictionary_chunk_size
+	wasm_generator.CODEC = codec
+	wasm_generator.LZ4_DICT_SIZE = lz4_dict_size
+	with open(os.devnull, 'w') as devnull:
+		stdout, sys.stdout = sys.stdout, devnull
+		try:
+			if flags.external_data:
+				wasm_generator.external_data = wasm_generator.ExternalData()
+			wasm_generator.write_dictionaries(data['words_dictionary'], data['names_dictionary'])
+			wasm_generator.write_utf16_indexies(data['words_index'], data['names_index'], data['kanji_words'])
+			wasm_generator.generate_config_header(
+				prepare_dict.max_readings_index, data['min_entry_id'],
+				flags.prerendered_html, flags.locality_order
+			)
+			if flags.external_data:
+				# Kanji dictionary is in the same rikai.dat
+				wasm_generator.write_kanji(*data['kanji'])
+				wasm_generator.external_data.write()
+		finally:
+			wasm_generator.external_data = None
+			sys.stdout = stdout
+
+def run_bench(repeats):
+	if os.path.exists('wasm/build/search.bench'):
+		os.remove('wasm/build/search.bench')
+	subprocess.run(['make', '-C', 'wasm', '--silent', 'build/search.bench'], check=True, stdout=subprocess.DEVNULL)
+	output = subprocess.run(
+		['./build/search.bench', 'bench/workload.txt', str(repeats)],
+		cwd='wasm', check=True, capture_output=True, text=True
+	).stdout
+
+	chunks_per_query = float(re.search(r'decompressed chunks per query: ([0-9.]+)', output).group(1))
+	p50, p99 = map(float, re.search(r'p50 ([0-9.]+)us, p99 ([0-9.]+)us', output).groups())
+	return chunks_per_query, p50, p99
+
+def parse_sizes(s):
+	return [int(size) for size in s.split(',')]
+
+def sweep(args, flags):
+	prepare_dict = load_prepare_dict()
+	pos_flags_map = wasm_generator.generate_deinflection_rules_header()
+	data = dict(zip(
+		('words_dictionary', 'words_index', 'min_entry_id', 'kanji_words'),
+		prepare_dict.prepare_words(pos_flags_map, flags.prerendered_html, flags.locality_order)
+	))
+	data['names_dictionary'], data['names_index'] = prepare_dict.prepare_names(flags.prerendered_html)
+	if flags.external_data and not args.offline:
+		data['kanji'] = (prepare_dict.prepare_kanji(), prepare_dict.prepare_radicals())
+
+	# Headers and definitions of both dictionaries, see split_definition() of
+	# wasm_generator. String tables aren't compressed, so they are just added to sizes
+	dictionaries_bufs = [
+		b'\n'.join(lines)
+		for label in ('words', 'names')
+		for lines in data[f'{label}_dictionary'][:2]
+	]
+	strings_size = sum(data[f'{label}_dictionary'][2].size() for label in ('words', 'names'))
+	# Indexes with their shared posting lists, see share_postings() of wasm_generator
+	indexes_buf = b''.join(
+		wasm_generator.encode_index(label, data[f'{label}_index'], [], shared.positions) + shared.buf
+		for label in ('words', 'names')
+		for shared in (wasm_generator.share_postings(data[f'{label}_index']),)
+	)
+
+	print(
+		'index chunk', 'dict chunk', 'codec', 'size MiB', 'decode us/chunk',
+		'chunks/query', 'p50 us', 'p99 us', sep='\t'
+	)
+	for index_chunk_size, dictionary_chunk_size in itertools.product(args.index_chunk_sizes, args.dictionary_chunk_sizes):
+		bufs = ((indexes_buf, index_chunk_size), *((buf, dictionary_chunk_size) for buf in dictionaries_bufs))
+		engine_results = {}
+		def run_engine(codec):
+			if codec not in engine_results:
+				generate(prepare_dict, data, flags, index_chunk_size, dictionary_chunk_size, *ENGINE_CODECS[codec])
+				engine_results[codec] = run_bench(args.repeats)
+			return engine_results[codec]
+
+		lz4_decode_time = measure_sizes('lz4', bufs)[1]
+		for codec in args.codecs:
+			size, decode_time = measure_sizes(codec, bufs)
+			if args.offline:
+				results = ('n/a',) * 3
+			elif codec in ENGINE_CODECS:
+				chunks_per_query, p50, p99 = run_engine(codec)
+				results = (f'{chunks_per_query:.2f}', f'{p50:.1f}', f'{p99:.1f}')
+			else:
+				chunks_per_query, p50, p99 = run_engine('lz4')
+				delta = (decode_time - lz4_decode_time) * chunks_per_query
+				results = (f'{chunks_per_query:.2f}', f'~{p50 + delta:.1f}', f'~{p99 + delta:.1f}')
+
+			print(
+				index_chunk_size, dictionary_chunk_size, codec, f'{(size + strings_size) / 2**20:.3f}',
+				f'{decode_time:.2f}', *results, sep='\t', flush=True
+			)
+
+def main():
+	parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+	parser.add_argument('--index-chunk-sizes', type=parse_sizes, default=[1024, 2048, 4096, 8192])
+	parser.add_argument('--dictionary-chunk-sizes', type=parse_sizes, default=[1024, 2048, 4096, 8192])
+	parser.add_argument('--codecs', type=lambda s: s.split(','), default=list(CODECS))
+	parser.add_argument('--repeats', type=int, default=3, help='workload repeats per run')
+	parser.add_argument('--offline', action='store_true', help="don't build and run the engine, sizes only")
+	args = parser.parse_args()
+	for codec in args.codecs:
+		assert codec in CODECS, f'unknown or unavailable codec {codec}'
+
+	flags = read_build_flags()
+	if args.offline:
+		sweep(args, flags)
+		return
+
+	# Regenerated files are those of the last run, so generated
+	# tree is restored as is, rikai.dat and config.h included
+	with tempfile.TemporaryDirectory() as backup_dir:
+		backup = os.path.join(backup_dir, 'generated')
+		shutil.copytree('wasm/generated', backup)
+		try:
+			sweep(args, flags)
+		finally:
+			shutil.rmtree('wasm/generated')
+			# Fresh modification times, so make rebuilds everything
+			# built from the sweep's files
+			shutil.copytree(backup, 'wasm/generated', copy_function=shutil.copy)
+
+if __name__ == '__main__':
+	main()
@@ -1,6 +1,11 @@
+#include <assert.h>
+
 #include "state.h"
+#include "libc.h"
 #include "dictionaries.h"
 #include "html_render.h"
+#include "srs.h"
+#include "kanji.h"
 
 export uint32_t rikaigu_search(size_t utf16_input_length)
 {
@@ -8,12 +13,79 @@ export uint32_t rikaigu_search(size_t utf16_input_length)
 	return (uint32_t)search(utf16_input_length);
 }
 
-export double get_html()
+double pack_buffer(buffer_t* buffer)
 {
-	make_html();
-	buffer_t* buffer = state_get_html_buffer();
 	uint64_t res = (size_t)buffer->data;
 	uint64_t size = buffer->size;
 	res |= size << 32;
 	return (double)res;
 }
+
+// Returns utf16 length of found kanji
+export uint32_t rikaigu_kanji_search(uint32_t code_point)
+{
+	state_clear();
+	return (uint32_t)kanji_search(code_point);
+}
+
+// Results are output with get_html() like rikaigu_search() ones
+export uint32_t rikaigu_kanji_words_search(uint32_t code_point, uint32_t max_words)
+{
+	state_clear();
+	return (uint32_t)kanji_words_search(code_point, max_words);
+}
+
+// `info_mask` selects index codes to show, see make_kanji_html()
+export double get_kanji_html(uint32_t info_mask)
+{
+	make_kanji_html(info_mask);
+	return pack_buffer(state_get_html_buffer());
+}
+
+export double get_radical_names()
+{
+	buffer_t* b = state_get_html_buffer();
+	b->size = 0;
+	radical_get_names(b);
+	return pack_buffer(b);
+}
+
+export uint8_t* radical_search_buffer(const size_t num_radicals)
+{
+	// Radicals are passed through html buffer, which is free between searches
+	buffer_t* b = state_get_html_buffer();
+	b->size = 0;
+	return buffer_allocate(b, num_radicals);
+}
+
+// Returns code points of matching kanjis, see radical_search()
+export double get_radical_search(const size_t num_radicals, const uint32_t min_strokes, const uint32_t max_strokes)
+{
+	buffer_t* b = state_get_html_buffer();
+	assert(b->size >= num_radicals && num_radicals <= max_radicals);
+	uint8_t radicals[max_radicals];
+	memcpy(radicals, b->data, num_radicals);
+	b->size = 0;
+	radical_search(b, radicals, num_radicals, min_strokes, max_strokes);
+	return pack_buffer(b);
+}
+
+export double get_html()
+{
+	make_html();
+	return pack_buffer(state_get_html_buffer());
+}
+
+// Ids (`uint32_t`) of entries due at `now` (seconds), earliest first
+export double srs_get_due(uint32_t now, uint32_t max_cards)
+{
+	srs_write_due(state_get_html_buffer(), now, max_cards);
+	return pack_buffer(state_get_html_buffer());
+}
+
+// Records for srs_import(), see src/srs.c for the layout
+export double srs_get_state()
+{
+	srs_write_state(state_get_html_buffer());
+	return pack_buffer(state_get_html_buffer());
+}
@@ -0,0 +1,320 @@
+#include "binary_render.h"
+
+#include <stdbool.h>
+#include <assert.h>
+
+#include "state.h"
+#include "libc.h"
+#include "word_results.h"
+#include "vardata_array.h"
+#include "names_types_mapping.h"
+#include "review_list.h"
+#include "dictionaries.h"
+#include "../generated/config.h"
+
+/*
+ * Structured alternative to make_html() for native tools linking the engine
+ * (popup is rendered from html, so it isn't exported from wasm module).
+ * Layout is written into html buffer, little endian, every record 4-byte aligned:
+ *
+ *   binary_header_t
+ *   binary_result_t[num_results]
+ *   per result: kanji groups, their kanjis, readings, sense groups, their strings
+ *
+ * Array references (`uint32_t` offsets) point inside the blob. Text references
+ * (`int32_t` offsets) are relative to blob start too, but point directly
+ * into dentry buffers, so no text is copied, except names types
+ * descriptions, inflection names and interned strings of text definitions
+ * (`definition` itself refers to the latter by ids). Empty strings have
+ * zero offset. So `header.size` covers only the blob itself, and consumer needs
+ * the whole memory the engine runs in, not just [blob, blob + size), which
+ * stays valid until the next search.
+ */
+
+#define BINARY_RESULTS_MAGIC 0x42474B52 // "RKGB"
+#define BINARY_RESULTS_VERSION 1
+
+enum {
+	BINARY_FLAG_PRERENDERED_DEFINITIONS = 0x1,
+};
+
+enum {
+	BINARY_RESULT_NAME = 0x1,
+	BINARY_RESULT_REVIEWED = 0x2,
+};
+
+enum {
+	BINARY_SURFACE_COMMON = 0x1,
+};
+
+typedef struct {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t flags;
+	uint32_t num_results;
+	uint32_t size;
+} binary_header_t;
+
+typedef struct {
+	int32_t text;
+	uint32_t length;
+} binary_string_t;
+
+// Zero length means surface was filtered out by search key
+typedef struct {
+	int32_t text;
+	uint16_t length;
+	uint16_t flags;
+} binary_surface_t;
+
+typedef struct {
+	uint16_t num_kanjis;
+	uint16_t num_reading_indices;
+	uint32_t kanjis;
+	// uint8_t[num_reading_indices], zero means all readings
+	int32_t reading_indices;
+} binary_kanji_group_t;
+
+typedef struct {
+	uint16_t num_types;
+	uint16_t num_senses;
+	uint32_t types;
+	uint32_t senses;
+} binary_sense_group_t;
+
+typedef struct {
+	uint32_t entry_id;
+	uint8_t match_length;
+	uint8_t flags;
+	uint16_t num_kanji_groups;
+	uint16_t num_readings;
+	uint16_t num_sense_groups;
+	binary_string_t inflection_name;
+	// Raw definition part of dictionary line (prerendered HTML
+	// when BINARY_FLAG_PRERENDERED_DEFINITIONS is set)
+	binary_string_t definition;
+	uint32_t kanji_groups;
+	uint32_t readings;
+	uint32_t sense_groups;
+} binary_result_t;
+
+_Static_assert(sizeof(binary_header_t) == 16, "Layout is part of the format");
+_Static_assert(sizeof(binary_result_t) == 40, "Layout is part of the format");
+
+#define at(b, offset) ((void*)((b)->data + (offset)))
+
+uint32_t binary_reserve(buffer_t* b, size_t num_bytes)
+{
+	const size_t padding = (4 - b->size % 4) % 4;
+	memzero(buffer_allocate(b, padding), padding);
+
+	const size_t offset = b->size;
+	buffer_allocate(b, num_bytes);
+	return (uint32_t)offset;
+}
+
+int32_t binary_text_offset(buffer_t* b, const char* text)
+{
+	const ptrdiff_t offset = text - (const char*)b->data;
+	assert(offset == (int32_t)offset);
+	return (int32_t)offset;
+}
+
+binary_string_t binary_string(buffer_t* b, const char* text, size_t length)
+{
+	return (binary_string_t){
+		.text = binary_text_offset(b, text),
+		.length = (uint32_t)length,
+	};
+}
+
+// Copies text into the blob, so it doesn't depend on where text lives.
+// Empty string has zero offset
+binary_string_t binary_copy_string(buffer_t* b, const char* text, size_t length)
+{
+	if (length == 0)
+	{
+		return (binary_string_t){ .text = 0, .length = 0 };
+	}
+
+	const int32_t text_offset = (int32_t)b->size;
+	memcpy(buffer_allocate(b, length), text, length);
+	return (binary_string_t){ .text = text_offset, .length = (uint32_t)length };
+}
+
+uint32_t binary_write_surfaces(buffer_t* b, const surface_t* surfaces, size_t num_surfaces)
+{
+	const uint32_t offset = binary_reserve(b, num_surfaces * sizeof(binary_surface_t));
+	binary_surface_t* out = at(b, offset);
+	for (size_t i = 0; i < num_surfaces; ++i)
+	{
+		out[i] = (binary_surface_t){
+			.text = binary_text_offset(b, surfaces[i].text),
+			.length = (uint16_t)surfaces[i].length,
+			.flags = surfaces[i].common ? BINARY_SURFACE_COMMON : 0,
+		};
+	}
+	return offset;
+}
+
+uint32_t binary_write_kanji_groups(buffer_t* b, const dentry_t* dentry)
+{
+	const uint32_t offset = binary_reserve(b, dentry->num_kanji_groups * sizeof(binary_kanji_group_t));
+	for (size_t i = 0; i < dentry->num_kanji_groups; ++i)
+	{
+		const kanji_group_t* group = dentry->kanji_groups + i;
+		const uint32_t kanjis = binary_write_surfaces(b, group->kanjis, group->num_kanjis);
+
+		binary_kanji_group_t* out = at(b, offset + i * sizeof(binary_kanji_group_t));
+		*out = (binary_kanji_group_t){
+			.num_kanjis = (uint16_t)group->num_kanjis,
+			.num_reading_indices = (uint16_t)group->num_reading_indices,
+			.kanjis = kanjis,
+			.reading_indices = group->num_reading_indices > 0
+				? binary_text_offset(b, (const char*)group->reading_indices)
+				: 0,
+		};
+	}
+	return offset;
+}
+
+uint32_t binary_write_name_types(buffer_t* b, const i_promise_i_wont_overwrite_it_string_t* types, size_t num_types)
+{
+	// Descriptions live in static memory, which isn't guaranteed
+	// to be addressable relative to blob start, so we copy them
+	const uint32_t offset = binary_reserve(b, num_types * sizeof(binary_string_t));
+	for (size_t i = 0; i < num_types; ++i)
+	{
+		name_type_mapping_t* mapping = get_mapped_type(*types[i].text);
+		const binary_string_t type = mapping
+			? binary_copy_string(b, mapping->type, mapping->length)
+			: binary_copy_string(b, NULL, 0);
+
+		binary_string_t* out = at(b, offset + i * sizeof(binary_string_t));
+		*out = type;
+	}
+	return offset;
+}
+
+uint32_t binary_write_strings(buffer_t* b, const i_promise_i_wont_overwrite_it_string_t* strings, size_t num_strings)
+{
+	const uint32_t offset = binary_reserve(b, num_strings * sizeof(binary_string_t));
+	for (size_t i = 0; i < num_strings; ++i)
+	{
+		const char* text = strings[i].text;
+		// Interned strings live in static memory, like names types descriptions
+		const binary_string_t string = is_interned_string(text)
+			? binary_copy_string(b, text, strings[i].length)
+			: binary_string(b, text, strings[i].length);
+
+		binary_string_t* out = at(b, offset + i * sizeof(binary_string_t));
+		*out = string;
+	}
+	return offset;
+}
+
+uint32_t binary_write_sense_groups(buffer_t* b, const dentry_t* dentry, bool is_name)
+{
+	const uint32_t offset = binary_reserve(b, dentry->num_sense_groups * sizeof(binary_sense_group_t));
+	for (size_t i = 0; i < dentry->num_sense_groups; ++i)
+	{
+		const sense_group_t* group = dentry->sense_groups + i;
+		const uint32_t types = is_name
+			? binary_write_name_types(b, group->types, group->num_types)
+			: binary_write_strings(b, group->types, group->num_types);
+		const uint32_t senses = binary_write_strings(b, group->senses, group->num_senses);
+
+		binary_sense_group_t* out = at(b, offset + i * sizeof(binary_sense_group_t));
+		*out = (binary_sense_group_t){
+			.num_types = (uint16_t)group->num_types,
+			.num_senses = (uint16_t)group->num_senses,
+			.types = types,
+			.senses = senses,
+		};
+	}
+	return offset;
+}
+
+void binary_write_result(buffer_t* b, const uint32_t offset, word_result_t* wr)
+{
+	dentry_t* dentry = word_result_get_dentry(wr);
+	const bool is_name = word_result_is_name(wr);
+	get_and_parse_definition(wr);
+
+	// Copied like names types descriptions, see binary_copy_string()
+	const binary_string_t inflection_name = binary_copy_string(
+		b,
+		word_result_get_inflection_name(wr),
+		word_result_get_inflection_name_length(wr)
+	);
+
+	const uint32_t kanji_groups = binary_write_kanji_groups(b, dentry);
+	const uint32_t readings = binary_write_surfaces(b, dentry->readings, dentry->num_readings);
+	const uint32_t sense_groups = binary_write_sense_groups(b, dentry, is_name);
+
+	uint8_t flags = 0;
+	if (is_name)
+	{
+		flags |= BINARY_RESULT_NAME;
+	}
+	else if (in_review_list(dentry->entry_id))
+	{
+		flags |= BINARY_RESULT_REVIEWED;
+	}
+
+	binary_result_t* out = at(b, offset);
+	*out = (binary_result_t){
+		.entry_id = is_name ? 0 : dentry->entry_id,
+		.match_length = (uint8_t)word_result_get_match_length(wr),
+		.flags = flags,
+		.num_kanji_groups = (uint16_t)dentry->num_kanji_groups,
+		.num_readings = (uint16_t)dentry->num_readings,
+		.num_sense_groups = (uint16_t)dentry->num_sense_groups,
+		.inflection_name = inflection_name,
+		.definition = binary_string(
+			b,
+			dentry->definition_start,
+			dentry->definition_end - dentry->definition_start
+		),
+		.kanji_groups = kanji_groups,
+		.readings = readings,
+		.sense_groups = sense_groups,
+	};
+}
+
+void make_binary()
+{
+	get_and_parse_dentries(false);
+
+	buffer_t* b = state_get_html_buffer();
+	assert(b->size == 0);
+
+	const size_t num_results = vardata_array_num_elements(state_get_word_result_buffer());
+
+	// Text offsets are relative to blob start, so blob is rendered again,
+	// if html buffer was moved meanwhile (see enlarge_your_buffer()). By then
+	// definitions are parsed and buffer has room, so it isn't moved twice
+	void* blob_start;
+	do
+	{
+		blob_start = b->data;
+		b->size = 0;
+
+		binary_reserve(b, sizeof(binary_header_t));
+		const uint32_t results = binary_reserve(b, num_results * sizeof(binary_result_t));
+		word_result_iterator_t it = state_get_word_result_iterator();
+		for (size_t i = 0; it.current < it.end; word_result_iterator_next(&it), i += 1)
+		{
+			binary_write_result(b, results + i * sizeof(binary_result_t), it.current);
+		}
+	} while (b->data != blob_start);
+
+	binary_header_t* header = at(b, 0);
+	*header = (binary_header_t){
+		.magic = BINARY_RESULTS_MAGIC,
+		.version = BINARY_RESULTS_VERSION,
+		.flags = PRERENDERED_DEFINITIONS ? BINARY_FLAG_PRERENDERED_DEFINITIONS : 0,
+		.num_results = (uint32_t)num_results,
+		.size = (uint32_t)b->size,
+	};
+}
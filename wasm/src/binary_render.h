@@ -0,0 +1,3 @@
+#pragma once
+
+void make_binary(void);
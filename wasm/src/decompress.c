@@ -1,5 +1,6 @@
 #include "decompress.h"
 #include "imports.h"
+#include "state.h"
 
 #include "../generated/config.h"
 
@@ -10,36 +11,183 @@
 #pragma clang diagnostic pop
 
 compressed_file_t* currently_decompressed_file = NULL;
-uint8_t decompressed_chunk[CHUNK_SIZE];
+uint8_t decompressed_chunk[MAX_CHUNK_SIZE];
+size_t decompressed_chunk_size = 0;
+size_t num_decompressed_chunks = 0;
+size_t num_decompressed_bytes = 0;
+
+/*
+ * Files generated with `--external-data` aren't linked into the module,
+ * so they don't occupy wasm memory (which never shrinks) for the whole
+ * session. Their compressed chunks are asked with read_chunk() import and
+ * most recently used ones are kept in chunk cache buffer: a header, slots
+ * and then chunk data of every slot, allocated as slots get used. Once
+ * reservation is filled least recently used slot is reused, so resident
+ * part of external files is bounded by the reservation.
+ */
+
+#define max_compressed_chunk_size ((LZ4_COMPRESSBOUND(MAX_CHUNK_SIZE) + 7) & ~7)
+
+typedef struct {
+	uint32_t num_slots;
+	uint32_t num_used_slots;
+	uint32_t clock;
+	uint32_t padding;
+} chunk_cache_header_t;
+
+typedef struct {
+	uint32_t file_id;
+	uint32_t chunk_index;
+	uint32_t length;
+	uint32_t last_use;
+} chunk_cache_slot_t;
+
+// Lets JS fetch external files only for modules, which need them
+export uint32_t rikaigu_uses_external_data()
+{
+	return EXTERNAL_DATA;
+}
+
+chunk_cache_header_t* get_chunk_cache_header(void)
+{
+	buffer_t* b = state_get_chunk_cache_buffer();
+	if (b->size == 0)
+	{
+		const size_t num_slots = (b->capacity - sizeof(chunk_cache_header_t))
+			/ (sizeof(chunk_cache_slot_t) + max_compressed_chunk_size);
+		if (num_slots == 0)
+		{
+			take_a_trip("chunk cache reservation is too small");
+		}
+
+		chunk_cache_header_t* header = buffer_allocate(b, sizeof(chunk_cache_header_t));
+		*header = (chunk_cache_header_t){
+			.num_slots = (uint32_t)num_slots,
+			.num_used_slots = 0,
+			.clock = 0,
+			.padding = 0,
+		};
+		buffer_allocate(b, num_slots * sizeof(chunk_cache_slot_t));
+	}
+	return b->data;
+}
+
+const uint8_t* get_external_chunk(const compressed_file_t* file, size_t chunk_index, int* compressed_size)
+{
+	chunk_cache_header_t* header = get_chunk_cache_header();
+	chunk_cache_slot_t* slots = (chunk_cache_slot_t*)(header + 1);
+	uint8_t* const slots_data = (uint8_t*)(slots + header->num_slots);
+	header->clock += 1;
+
+	size_t lru = 0;
+	for (size_t i = 0; i < header->num_used_slots; ++i)
+	{
+		if (slots[i].file_id == file->file_id && slots[i].chunk_index == chunk_index)
+		{
+			slots[i].last_use = header->clock;
+			*compressed_size = (int)slots[i].length;
+			return slots_data + i * max_compressed_chunk_size;
+		}
+		if (slots[i].last_use < slots[lru].last_use)
+		{
+			lru = i;
+		}
+	}
+
+	const size_t slot = header->num_used_slots < header->num_slots ? header->num_used_slots : lru;
+	// Reservation covers all slots, so data is read before the slot
+	// is allocated and a failed read leaves cache consistent
+	uint8_t* const dst = slots_data + slot * max_compressed_chunk_size;
+	const uint32_t length = read_chunk(file->file_id, (uint32_t)chunk_index, dst, (uint32_t)max_compressed_chunk_size);
+	if (length == 0 || length > (uint32_t)LZ4_COMPRESSBOUND(MAX_CHUNK_SIZE))
+	{
+		take_a_trip("Can't read chunk");
+	}
+	if (slot == header->num_used_slots)
+	{
+		header->num_used_slots += 1;
+		buffer_allocate(state_get_chunk_cache_buffer(), max_compressed_chunk_size);
+	}
+
+	slots[slot] = (chunk_cache_slot_t){
+		.file_id = file->file_id,
+		.chunk_index = (uint32_t)chunk_index,
+		.length = length,
+		.last_use = header->clock,
+	};
+	*compressed_size = (int)length;
+	return dst;
+}
+
+/*
+ * Lookups usually need a single entry of a chunk, so chunks are
+ * decompressed only up to the entry (LZ4 decoder stops at target size)
+ * plus a margin, which covers most entries. decompressed_chunk_size records
+ * valid prefix of the current chunk, and a request beyond it decompresses
+ * longer prefix from the chunk start again (LZ4 can't resume decoding).
+ */
+
+// Multiple of 8, so decompressed prefix never ends inside
+// utf16 character or uint32 posting
+#define decompression_margin 256
 
 void decompress_chunk(compressed_file_t* file, size_t chunk_index)
 {
+	decompress_chunk_prefix(file, chunk_index, get_real_chunk_size(file, chunk_index));
+}
+
+void decompress_chunk_prefix(compressed_file_t* file, size_t chunk_index, size_t min_size)
+{
+	const size_t real_chunk_size = get_real_chunk_size(file, chunk_index);
+	const size_t padded_size = (min_size + decompression_margin + 7) & ~(size_t)7;
+	const size_t target_size = padded_size < real_chunk_size ? padded_size : real_chunk_size;
+
 	// NOTE there is place for further optimization:
 	// when we have following/previous chunk decompressed, we want to
 	// cache entry end/start, so in case after decompressing current chunk
 	// we find part of required entry is in following/previous chunk we
 	// won't decompress it again
-	if (file == currently_decompressed_file && chunk_index == file->currently_decompressed_chunk_index)
+	if (file == currently_decompressed_file && chunk_index == file->currently_decompressed_chunk_index
+		&& decompressed_chunk_size >= target_size)
 	{
 		return;
 	}
 
-	const int32_t chunk_start = file->chunks_offsets[chunk_index];
-	const int num_decompressed_bytes = LZ4_decompress_safe(
-		(const char*)(file->data + chunk_start),
-		(char*)decompressed_chunk,
+	const uint8_t* compressed;
+	int compressed_size;
+	if (file->data != NULL)
+	{
+		const int32_t chunk_start = file->chunks_offsets[chunk_index];
+		compressed = file->data + chunk_start;
 		// chunks_offsets have additional element at the end
 		// so this expression is valid for every valid `chunk_index`
-		file->chunks_offsets[chunk_index + 1] - chunk_start,
-		sizeof(decompressed_chunk)
+		compressed_size = file->chunks_offsets[chunk_index + 1] - chunk_start;
+	}
+	else
+	{
+		compressed = get_external_chunk(file, chunk_index, &compressed_size);
+	}
+
+	// Same as LZ4_decompress_safe_partial() when there is no dictionary
+	const int num_bytes = LZ4_decompress_safe_partial_usingDict(
+		(const char*)compressed,
+		(char*)decompressed_chunk,
+		compressed_size,
+		(int)target_size,
+		sizeof(decompressed_chunk),
+		(const char*)file->lz4_dict,
+		(int)file->lz4_dict_size
 	);
-	if (num_decompressed_bytes < 0)
+	if (num_bytes < (int)target_size)
 	{
 		take_a_trip("Error during decompression");
 	}
 
 	file->currently_decompressed_chunk_index = chunk_index;
 	currently_decompressed_file = file;
+	decompressed_chunk_size = (size_t)num_bytes;
+	num_decompressed_chunks += 1;
+	num_decompressed_bytes += (size_t)num_bytes;
 }
 
 size_t get_real_chunk_size(const compressed_file_t* file, size_t chunk_index)
@@ -50,6 +198,6 @@ size_t get_real_chunk_size(const compressed_file_t* file, size_t chunk_index)
 	}
 	else
 	{
-		return CHUNK_SIZE;
+		return file->chunk_size;
 	}
 }
@@ -6,17 +6,35 @@
 #include "../generated/config.h"
 
 typedef struct {
+	// Every chunk but the last one is of `chunk_size` (at most MAX_CHUNK_SIZE) bytes
+	size_t chunk_size;
 	size_t last_chunk_index;
 	size_t last_chunk_size;
 	size_t original_size;
 	const int32_t* chunks_offsets;
+	// NULL when file is kept out of the module, and its chunks
+	// are read with read_chunk() import, see decompress.c
 	const uint8_t* data;
+	// Dictionary every chunk is compressed against (see LZ4_DICT_SIZE
+	// in data/wasm_generator.py), NULL when chunks are independent
+	const uint8_t* lz4_dict;
+	size_t lz4_dict_size;
 	size_t currently_decompressed_chunk_index;
+	uint32_t file_id;
 } compressed_file_t;
 
-extern uint8_t decompressed_chunk[CHUNK_SIZE];
+extern uint8_t decompressed_chunk[MAX_CHUNK_SIZE];
+// Number of valid bytes at decompressed_chunk start, may be less than
+// chunk size after decompress_chunk_prefix()
+extern size_t decompressed_chunk_size;
 extern compressed_file_t* currently_decompressed_file;
+// Reported by benchmarks
+extern size_t num_decompressed_chunks;
+extern size_t num_decompressed_bytes;
 
 void decompress_chunk(compressed_file_t* file, size_t chunk_index);
+// Decompresses at least `min_size` bytes (plus a margin to finish an entry)
+// of the chunk, whole chunk when it's shorter
+void decompress_chunk_prefix(compressed_file_t* file, size_t chunk_index, size_t min_size);
 
 size_t get_real_chunk_size(const compressed_file_t* file, size_t chunk_index);
@@ -62,14 +62,17 @@ typedef struct {
 	size_t suffix_length;
 } deinflection_rule_search_context_t;
 
-int deinflection_rule_search_cmp(const void* key, const void* object)
+static inline int deinflection_rule_search_cmp(const deinflection_rule_search_context_t* c, const deinflection_rule_t* r)
 {
-	const deinflection_rule_search_context_t* c = key;
-	const deinflection_rule_t* r = object;
-
 	return utf16_compare(c->suffix, c->suffix_length, r->suffix, c->suffix_length);
 }
 
+define_binary_locate_bounds(
+	locate_rules_for_suffix,
+	const deinflection_rule_search_context_t*, const deinflection_rule_t,
+	deinflection_rule_search_cmp
+)
+
 bool rule_index_bounds_for_suffix(const char16_t* suffix, const size_t suffix_length, size_t* out_low, size_t* out_high)
 {
 	const size_t low = first_suffix_of_length_position[suffix_length];
@@ -79,10 +82,9 @@ bool rule_index_bounds_for_suffix(const char16_t* suffix, const size_t suffix_le
 		.suffix_length = suffix_length,
 	};
 
-	bool found = binary_locate_bounds(
+	bool found = locate_rules_for_suffix(
 		&c, rules + low,
-		high - low, sizeof(deinflection_rule_t),
-		deinflection_rule_search_cmp,
+		high - low,
 		out_low, out_high
 	);
 	if (found)
@@ -133,17 +135,22 @@ candidate_t* deinflect(const char16_t* word, size_t length)
 		return NULL;
 	}
 
+	// Buffer may be moved while deinflecting, so candidate is tracked by position.
+	// Words of candidates copied with buffer keep pointing into its old range,
+	// which stays valid
 	candidate_t* it = buffer->data;
 	for(; it != NULL; it = candidate_next(it))
 	{
+		const size_t position = (void*)it - buffer->data;
 		deinflect_one_word(buffer, it->type, it->word, it->word_length, it->inflection_name, it->inflection_name_length);
+		it = buffer->data + position;
 	}
 	return buffer->data;
 }
 
 candidate_t* candidate_next(candidate_t* it)
 {
-	void* next_pos = (void*)(it->inflection_name + it->inflection_name_length);
+	void* next_pos = (void*)(it + 1) + it->word_length * sizeof(char16_t) + it->inflection_name_length;
 	buffer_t* buffer = state_get_candidate_buffer();
 	assert(next_pos <= buffer->data + buffer->size);
 	if (buffer->data + buffer->size > next_pos)
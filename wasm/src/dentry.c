@@ -29,11 +29,11 @@ uint32_t parse_base62_uint(const char* s, const char* const end)
 		}
 		else if (c >= 'a' && c <= 'z')
 		{
-			res += c - 'a';
+			res += c - 'a' + 10;
 		}
 		else
 		{
-			res += c - 'A';
+			res += c - 'A' + 36;
 		}
 	}
 	return res;
@@ -59,25 +59,23 @@ dentry_t* dentry_make(const char* raw, size_t length, bool is_name)
 	{
 		assert(num_parts >= 3);
 		res->entry_id = MIN_ENTRY_ID + parse_base62_uint(parts_start[num_parts - 1], raw + length);
-		res->definition_end = parts_start[num_parts - 1] - 1;
+		length = (size_t)(parts_start[num_parts - 1] - 1 - raw);
 		num_parts -= 1;
 	}
-	else
-	{
-		res->definition_end = raw + length;
-	}
 
-	assert(num_parts == 2 || num_parts == 3);
-	if (num_parts == 3)
+	res->definition_offset = parse_base62_uint(parts_start[num_parts - 1], raw + length);
+	res->readings_end = parts_start[num_parts - 1] - 1;
+	num_parts -= 1;
+
+	assert(num_parts == 1 || num_parts == 2);
+	if (num_parts == 2)
 	{
 		res->kanjis_start = parts_start[0];
 		res->readings_start = parts_start[1];
-		res->definition_start = parts_start[2];
 	}
-	else if (num_parts == 2)
+	else
 	{
 		res->readings_start = parts_start[0];
-		res->definition_start = parts_start[1];
 	}
 
 	return res;
@@ -187,17 +185,25 @@ void dentry_parse_kanjis(dentry_t* dentry, buffer_t* dentry_buffer)
 void dentry_parse_readings(dentry_t* dentry, buffer_t* dentry_buffer)
 {
 	const char* start = dentry->readings_start;
-	const char* end = dentry->definition_start - 1;
+	const char* end = dentry->readings_end;
 	dentry->num_readings = count_parts(dentry->readings_start, end, ';');
 	dentry->readings = (reading_t*)buffer_allocate(dentry_buffer, sizeof(reading_t)*dentry->num_readings);
 
 	parse_surfaces(dentry->readings, start, end, ';');
 }
 
+void resolve_interned_string(i_promise_i_wont_overwrite_it_string_t* str, const string_table_t* strings)
+{
+	const uint32_t index = parse_base62_uint(str->text + 1, str->text + str->length);
+	assert(index < strings->num_strings);
+	str->text = (const char*)strings->data + strings->offsets[index];
+	str->length = strings->offsets[index + 1] - strings->offsets[index];
+}
+
 void parse_i_promise_i_wont_overwrite_it_strings(
 	size_t* num, i_promise_i_wont_overwrite_it_string_t** arr,
 	const char* start, const char* end, char sep,
-	buffer_t* dentry_buffer)
+	const string_table_t* strings, buffer_t* dentry_buffer)
 {
 	*num = count_parts(start, end, sep);
 	*arr = (i_promise_i_wont_overwrite_it_string_t*)buffer_allocate(
@@ -211,21 +217,25 @@ void parse_i_promise_i_wont_overwrite_it_strings(
 		(*arr)[str_index].text = start;
 		const char* str_end = find_char(start, end, sep);
 		(*arr)[str_index].length = (str_end - start);
+		if (strings != NULL && start < str_end && *start == interned_string_marker)
+		{
+			resolve_interned_string(*arr + str_index, strings);
+		}
 		start = str_end + 1;
 		str_index += 1;
 	}
 	while (start < end);
 }
 
-void sense_group_parse(sense_group_t* sense_group, const char* start, const char* end, buffer_t* dentry_buffer)
+void sense_group_parse(sense_group_t* sense_group, const char* start, const char* end, const string_table_t* strings, buffer_t* dentry_buffer)
 {
 	const char* sep = find_char(start, end, ';');
 
-	parse_i_promise_i_wont_overwrite_it_strings(&sense_group->num_types, &sense_group->types, start, sep, ',', dentry_buffer);
+	parse_i_promise_i_wont_overwrite_it_strings(&sense_group->num_types, &sense_group->types, start, sep, ',', strings, dentry_buffer);
 
 	if (sep + 1 < end)
 	{
-		parse_i_promise_i_wont_overwrite_it_strings(&sense_group->num_senses, &sense_group->senses, sep + 1, end, '`', dentry_buffer);
+		parse_i_promise_i_wont_overwrite_it_strings(&sense_group->num_senses, &sense_group->senses, sep + 1, end, '`', strings, dentry_buffer);
 	}
 	else
 	{
@@ -233,7 +243,7 @@ void sense_group_parse(sense_group_t* sense_group, const char* start, const char
 	}
 }
 
-void dentry_parse_definition(dentry_t* dentry, buffer_t* dentry_buffer)
+void dentry_parse_definition(dentry_t* dentry, const string_table_t* strings, buffer_t* dentry_buffer)
 {
 	dentry->num_sense_groups = count_parts(dentry->definition_start, dentry->definition_end, '\\');
 	dentry->sense_groups = (sense_group_t*)buffer_allocate(dentry_buffer, sizeof(sense_group_t)*dentry->num_sense_groups);
@@ -243,7 +253,7 @@ void dentry_parse_definition(dentry_t* dentry, buffer_t* dentry_buffer)
 	while (group_index != dentry->num_sense_groups)
 	{
 		const char* end = find_char(cur, dentry->definition_end, '\\');
-		sense_group_parse(dentry->sense_groups + group_index, cur, end, dentry_buffer);
+		sense_group_parse(dentry->sense_groups + group_index, cur, end, strings, dentry_buffer);
 		group_index += 1;
 		cur = end + 1;
 	}
@@ -257,7 +267,17 @@ void dentry_parse(dentry_t* dentry)
 		dentry_parse_kanjis(dentry, dentry_buffer);
 	}
 	dentry_parse_readings(dentry, dentry_buffer);
-	dentry_parse_definition(dentry, dentry_buffer);
+}
+
+void dentry_set_definition(dentry_t* dentry, const char* start, const char* end, const string_table_t* strings)
+{
+	dentry->definition_start = start;
+	dentry->definition_end = end;
+#if !PRERENDERED_DEFINITIONS
+	dentry_parse_definition(dentry, strings, state_get_dentry_buffer());
+#else
+	(void)strings;
+#endif
 }
 
 void dentry_drop_kanji_groups(dentry_t* dentry)
@@ -27,6 +27,17 @@ typedef struct i_promise_i_wont_overwrite_it_string {
 	size_t length;
 } i_promise_i_wont_overwrite_it_string_t;
 
+// Types and senses repeated across definitions are stored once (see
+// StringTable of data/wasm_generator.py). Definition refers to them with
+// marker followed by base62 string index, parsing resolves them to `data`.
+#define interned_string_marker '\x01'
+
+typedef struct {
+	const uint8_t* data;
+	const uint32_t* offsets;
+	size_t num_strings;
+} string_table_t;
+
 typedef struct {
 	size_t num_types;
 	i_promise_i_wont_overwrite_it_string_t* types;
@@ -38,8 +49,13 @@ typedef struct {
 typedef struct {
 	const char* kanjis_start;
 	const char* readings_start;
+	const char* readings_end;
+	// Definition lives in a separate file (see write_dictionaries() of
+	// data/wasm_generator.py) and is loaded only for rendered entries,
+	// NULL until get_and_parse_definition()
 	const char* definition_start;
 	const char* definition_end;
+	uint32_t definition_offset;
 	uint32_t entry_id;
 
 	size_t num_kanji_groups;
@@ -57,6 +73,7 @@ dentry_t* dentry_make(const char* raw, size_t length, bool is_name);
 void dentry_drop_kanji_groups(dentry_t* dentry);
 
 void dentry_parse(dentry_t* dentry);
+void dentry_set_definition(dentry_t* dentry, const char* start, const char* end, const string_table_t* strings);
 
 void dentry_filter_readings(dentry_t* dentry, const char16_t* key, const size_t key_length);
 void dentry_filter_kanji_groups(dentry_t* dentry, const char16_t* key, const size_t key_length);
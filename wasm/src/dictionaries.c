@@ -1,3 +1,5 @@
+#include "dictionaries.h"
+
 #include <stddef.h>
 #include <uchar.h>
 #include <stdbool.h>
@@ -12,32 +14,91 @@
 #include "word_results.h"
 #include "utf.h"
 #include "decompress.h"
+#include "render_cache.h"
 
 #include "../generated/config.h"
 #include "../generated/dictionary.h"
 
 compressed_file_t words_dictionary = {
+	.chunk_size = words_dictionary_chunk_size,
 	.last_chunk_index = words_dictionary_last_chunk_index,
 	.last_chunk_size = words_dictionary_last_chunk_size,
 	.original_size = words_dictionary_original_size,
 	.chunks_offsets = words_dictionary_chunks_offsets,
 	.data = words_dictionary_data,
+	.lz4_dict = words_dictionary_lz4_dict,
+	.lz4_dict_size = words_dictionary_lz4_dict_size,
 	.currently_decompressed_chunk_index = SIZE_MAX,
+	.file_id = words_dictionary_file_id,
 };
 
 compressed_file_t names_dictionary = {
+	.chunk_size = names_dictionary_chunk_size,
 	.last_chunk_index = names_dictionary_last_chunk_index,
 	.last_chunk_size = names_dictionary_last_chunk_size,
 	.original_size = names_dictionary_original_size,
 	.chunks_offsets = names_dictionary_chunks_offsets,
 	.data = names_dictionary_data,
+	.lz4_dict = names_dictionary_lz4_dict,
+	.lz4_dict_size = names_dictionary_lz4_dict_size,
 	.currently_decompressed_chunk_index = SIZE_MAX,
+	.file_id = names_dictionary_file_id,
+};
+
+compressed_file_t words_definitions = {
+	.chunk_size = words_definitions_chunk_size,
+	.last_chunk_index = words_definitions_last_chunk_index,
+	.last_chunk_size = words_definitions_last_chunk_size,
+	.original_size = words_definitions_original_size,
+	.chunks_offsets = words_definitions_chunks_offsets,
+	.data = words_definitions_data,
+	.lz4_dict = words_definitions_lz4_dict,
+	.lz4_dict_size = words_definitions_lz4_dict_size,
+	.currently_decompressed_chunk_index = SIZE_MAX,
+	.file_id = words_definitions_file_id,
+};
+
+compressed_file_t names_definitions = {
+	.chunk_size = names_definitions_chunk_size,
+	.last_chunk_index = names_definitions_last_chunk_index,
+	.last_chunk_size = names_definitions_last_chunk_size,
+	.original_size = names_definitions_original_size,
+	.chunks_offsets = names_definitions_chunks_offsets,
+	.data = names_definitions_data,
+	.lz4_dict = names_definitions_lz4_dict,
+	.lz4_dict_size = names_definitions_lz4_dict_size,
+	.currently_decompressed_chunk_index = SIZE_MAX,
+	.file_id = names_definitions_file_id,
+};
+
+const string_table_t words_string_table = {
+	.data = words_strings,
+	.offsets = words_strings_offsets,
+	.num_strings = words_strings_count,
 };
 
-static bool copy_until_newline(buffer_t* b, size_t position_in_chunk, size_t real_chunk_size)
+const string_table_t names_string_table = {
+	.data = names_strings,
+	.offsets = names_strings_offsets,
+	.num_strings = names_strings_count,
+};
+
+static bool string_table_contains(const string_table_t* strings, const char* text)
+{
+	return strings->num_strings > 0
+		&& text >= (const char*)strings->data
+		&& text < (const char*)strings->data + strings->offsets[strings->num_strings];
+}
+
+bool is_interned_string(const char* text)
+{
+	return string_table_contains(&words_string_table, text) || string_table_contains(&names_string_table, text);
+}
+
+static bool copy_until_newline(buffer_t* b, size_t position_in_chunk, size_t end_in_chunk)
 {
 	char* const start = (char*)(decompressed_chunk + position_in_chunk);
-	char* const end = (char*)(decompressed_chunk + real_chunk_size);
+	char* const end = (char*)(decompressed_chunk + end_in_chunk);
 	const size_t num_bytes_to_copy = find_char(start, end, '\n') - start;
 
 	char* const to = buffer_allocate(b, num_bytes_to_copy);
@@ -47,22 +108,32 @@ static bool copy_until_newline(buffer_t* b, size_t position_in_chunk, size_t rea
 
 const char* get_dentry_at(buffer_t* b, compressed_file_t* dictionary, size_t position)
 {
-	const char* const start = b->data + b->size;
+	const size_t start = b->size;
 
-	size_t chunk_index = position / CHUNK_SIZE;
-	decompress_chunk(dictionary, chunk_index);
+	size_t chunk_index = position / dictionary->chunk_size;
+	size_t position_in_chunk = position % dictionary->chunk_size;
+	decompress_chunk_prefix(dictionary, chunk_index, position_in_chunk);
 
-	size_t position_in_chunk = position % CHUNK_SIZE;
-	bool seen_newline = copy_until_newline(b, position_in_chunk, get_real_chunk_size(dictionary, chunk_index));
+	bool seen_newline = copy_until_newline(b, position_in_chunk, decompressed_chunk_size);
 	while (!seen_newline) {
-		chunk_index += 1;
-		decompress_chunk(dictionary, chunk_index);
+		position_in_chunk = decompressed_chunk_size;
+		if (position_in_chunk < get_real_chunk_size(dictionary, chunk_index))
+		{
+			// Entry is longer than decompression margin
+			decompress_chunk(dictionary, chunk_index);
+		}
+		else
+		{
+			chunk_index += 1;
+			position_in_chunk = 0;
+			decompress_chunk_prefix(dictionary, chunk_index, 0);
+		}
 
-		position_in_chunk = 0;
-		seen_newline = copy_until_newline(b, position_in_chunk, get_real_chunk_size(dictionary, chunk_index));
+		seen_newline = copy_until_newline(b, position_in_chunk, decompressed_chunk_size);
 	}
 
-	return start;
+	// Buffer may have been moved while copying
+	return b->data + start;
 }
 
 bool word_search(Dictionary d, const size_t input_length,
@@ -123,43 +194,129 @@ size_t input_search(const input_t* input, Dictionary dictionary)
 	return max_match_length;
 }
 
-void get_and_parse_dentries(const size_t num_word_results)
+static void get_and_parse_dentry(word_result_t* wr)
 {
+	// Moved buffers leave their old range intact, so dentry may point
+	// into raw dentry buffer right away, even if the latter grows later
 	buffer_t* b = state_get_raw_dentry_buffer();
-	const char** raw_dentries = buffer_allocate(b, sizeof(const char*) * (num_word_results + 1));
+	const bool is_name = word_result_is_name(wr);
+	const char* raw_dentry = get_dentry_at(
+		b,
+		is_name ? &names_dictionary : &words_dictionary,
+		word_result_get_offset(wr)
+	);
+	word_result_set_dentry(
+		wr,
+		dentry_make(raw_dentry, (size_t)((const char*)(b->data + b->size) - raw_dentry), is_name)
+	);
+}
+
+void get_and_parse_dentries(const bool use_render_cache)
+{
+	if (use_render_cache)
+	{
+		render_cache_begin();
+	}
 
-	// Loading and parsing dentries in two phases so that pointers in dentry buffer won't
-	// become invalid in case of raw dentry buffer enlargement
 	word_result_iterator_t it = state_get_word_result_iterator();
-	size_t raw_dentry_index = 0;
-	while (it.current < it.end)
+	for (; it.current < it.end; word_result_iterator_next(&it))
 	{
-		raw_dentries[raw_dentry_index] = get_dentry_at(
-			b,
-			word_result_is_name(it.current) ? &names_dictionary : &words_dictionary,
-			word_result_get_offset(it.current)
-		);
-		word_result_iterator_next(&it);
-		raw_dentry_index += 1;
+		if (use_render_cache && render_cache_lookup(it.current))
+		{
+			continue;
+		}
+
+		// Already got by rank_words_results_by_entry_id()
+		if (word_result_get_dentry(it.current) != NULL)
+		{
+			continue;
+		}
+
+		get_and_parse_dentry(it.current);
 	}
-	raw_dentries[raw_dentry_index] = b->data + b->size;
+}
 
-	it = state_get_word_result_iterator();
-	raw_dentry_index = 0;
-	while (it.current < it.end)
+#if LOCALITY_ORDERED_WORDS
+/*
+ * Words dictionary lines ordered by lookups locality (see
+ * data/locality.py) aren't in JMdict order, so offsets of results
+ * no longer rank them as unordered dictionary would. Entry ids do (as
+ * data/prepare-dict.py checks), but they are in dentries, so all words
+ * ones are got before results are limited.
+ */
+static void rank_words_results_by_entry_id(void)
+{
+	word_result_iterator_t it = state_get_word_result_iterator();
+	for (; it.current < it.end; word_result_iterator_next(&it))
 	{
-		word_result_set_dentry(
-			it.current,
-			dentry_make(
-				raw_dentries[raw_dentry_index],
-				raw_dentries[raw_dentry_index + 1] - raw_dentries[raw_dentry_index],
-				word_result_is_name(it.current)
-			)
-		);
-		word_result_iterator_next(&it);
-		raw_dentry_index += 1;
+		if (!word_result_is_name(it.current))
+		{
+			get_and_parse_dentry(it.current);
+			word_result_set_rank(it.current, word_result_get_dentry(it.current)->entry_id);
+		}
 	}
 }
+#endif
+
+void get_and_parse_definition(word_result_t* wr)
+{
+	dentry_t* dentry = word_result_get_dentry(wr);
+	if (dentry->definition_start != NULL)
+	{
+		return;
+	}
+
+	const bool is_name = word_result_is_name(wr);
+	buffer_t* b = state_get_raw_dentry_buffer();
+	const char* definition = get_dentry_at(
+		b,
+		is_name ? &names_definitions : &words_definitions,
+		dentry->definition_offset
+	);
+	dentry_set_definition(
+		dentry, definition, (const char*)(b->data + b->size),
+		is_name ? &names_string_table : &words_string_table
+	);
+}
+
+size_t kanji_words_search(const uint32_t code_point, size_t max_words)
+{
+	uint32_t offsets[KANJI_WORDS_MAX_RESULTS];
+	if (max_words > KANJI_WORDS_MAX_RESULTS)
+	{
+		max_words = KANJI_WORDS_MAX_RESULTS;
+	}
+	const size_t num_words = kanji_words_get_offsets(code_point, offsets, max_words);
+	if (num_words == 0)
+	{
+		return 0;
+	}
+
+	// Kanji is the input, so results are rendered as kanji (not reading) matches.
+	// As a key it matches only entry consisting of the kanji alone, other
+	// entries are rendered with all their writings.
+	input_t* input = state_get_input();
+	input->length = code_point > 0xFFFF ? 2 : 1;
+	if (input->length == 2)
+	{
+		input->data[0] = (char16_t)(0xD800 + ((code_point - 0x10000) >> 10));
+		input->data[1] = (char16_t)(0xDC00 + ((code_point - 0x10000) & 0x3FF));
+	}
+	else
+	{
+		input->data[0] = (char16_t)code_point;
+	}
+	for (size_t i = 0; i <= input->length; ++i)
+	{
+		input->length_mapping[i] = (uint8_t)i;
+	}
+
+	for (size_t i = 0; i < num_words; ++i)
+	{
+		state_append_word_result(WORDS, input->length, input->data, input->length, offsets[i]);
+	}
+	return num_words;
+}
 
 size_t search(size_t utf16_input_length)
 {
@@ -176,9 +333,10 @@ size_t search(size_t utf16_input_length)
 		return max_match_length;
 	}
 
-	const size_t num_word_results = state_sort_and_limit_word_results();
-
-	get_and_parse_dentries(num_word_results);
+#if LOCALITY_ORDERED_WORDS
+	rank_words_results_by_entry_id();
+#endif
+	state_sort_and_limit_word_results();
 
 	return max_match_length;
 }
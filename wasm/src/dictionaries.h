@@ -1,5 +1,29 @@
 #pragma once
 
 #include "state.h"
+#include "word_results.h"
+#include "decompress.h"
 
 size_t search(size_t utf16_input_length);
+
+#define KANJI_WORDS_MAX_RESULTS 32
+
+// Fills word results with at most `max_words` best entries containing kanji,
+// to be rendered like search() results. Returns number of entries.
+size_t kanji_words_search(const uint32_t code_point, size_t max_words);
+
+// Dentries are loaded only once output is requested, so that entries
+// already rendered into render cache don't have to be fetched at all
+void get_and_parse_dentries(const bool use_render_cache);
+
+// Definitions are in separate files (see split_definition() of
+// data/wasm_generator.py), so they are loaded only for rendered entries,
+// after all headers are, not to switch decompressed chunk back and forth
+void get_and_parse_definition(word_result_t* wr);
+
+// Whether `text` points into string table of a dictionary, i.e. into
+// static memory rather than raw dentry buffer
+bool is_interned_string(const char* text);
+
+// Copies dictionary line starting at `position` into `b`
+const char* get_dentry_at(buffer_t* b, compressed_file_t* dictionary, size_t position);
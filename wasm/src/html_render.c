@@ -8,6 +8,11 @@
 #include "word_results.h"
 #include "names_types_mapping.h"
 #include "review_list.h"
+#include "review_context.h"
+#include "kanji.h"
+#include "render_cache.h"
+#include "dictionaries.h"
+#include "../generated/config.h"
 
 void append(buffer_t* b, const char* str, size_t length)
 {
@@ -43,6 +48,35 @@ void append_uint(buffer_t* b, uint32_t v)
 		append(b, str, sizeof(str) - 1); \
 	} while(0)
 #define conditionally_append(cond, literal) if (cond) append_static(literal)
+
+// Context sentences come from pages, so they are escaped
+void append_escaped(buffer_t* b, const char* str, size_t length)
+{
+	const char* const end = str + length;
+	const char* start = str;
+	for (; str < end; ++str)
+	{
+		if (*str != '<' && *str != '>' && *str != '&')
+		{
+			continue;
+		}
+		append(b, start, str - start);
+		switch (*str)
+		{
+		case '<':
+			append_static("&lt;");
+			break;
+		case '>':
+			append_static("&gt;");
+			break;
+		default:
+			append_static("&amp;");
+		}
+		start = str + 1;
+	}
+	append(b, start, end - start);
+}
+
 #define MOAR_CUT 2
 
 void try_render_inflection_info(buffer_t* b, word_result_t* wr)
@@ -225,6 +259,44 @@ void render_sense_group(buffer_t* b, sense_group_t* sense_group, bool is_name, b
 	}
 }
 
+#if PRERENDERED_DEFINITIONS
+// Must be kept in sync with data/html_prerender.py
+static const char hidden_unless_reviewed_placeholder = '\x01';
+static const char hidden_if_reviewed_placeholder = '\x02';
+
+const char* find_placeholder(const char* start, const char* end)
+{
+	while (start < end)
+	{
+		if (*start == hidden_unless_reviewed_placeholder || *start == hidden_if_reviewed_placeholder)
+		{
+			return start;
+		}
+		start += 1;
+	}
+	return start;
+}
+
+void render_prerendered_definition(buffer_t* b, const char* start, const char* const end, bool from_review_list)
+{
+	while (start < end)
+	{
+		const char* placeholder = find_placeholder(start, end);
+		append(b, start, placeholder - start);
+		if (placeholder == end)
+		{
+			break;
+		}
+
+		conditionally_append(
+			(*placeholder == hidden_unless_reviewed_placeholder) != from_review_list,
+			" rikaigu-hidden"
+		);
+		start = placeholder + 1;
+	}
+}
+#endif
+
 void render_dentry(buffer_t* b, word_result_t* wr, dentry_t* dentry, const bool from_review_list)
 {
 	if (dentry->num_kanji_groups > 0)
@@ -246,17 +318,24 @@ void render_dentry(buffer_t* b, word_result_t* wr, dentry_t* dentry, const bool
 		append_static("\">");
 		if (from_review_list)
 		{
-			//append(b, review_list_entry->text, review_list_entry->length);
+			const char* context = NULL;
+			const size_t length = review_context_get(dentry->entry_id, &context);
+			append_escaped(b, context, length);
 		}
 		append_static("</p>");
 	}
 
+	get_and_parse_definition(wr);
 	append_static("<div class=\"rikaigu-pos-and-def\">");
 
+#if PRERENDERED_DEFINITIONS
+	render_prerendered_definition(b, dentry->definition_start, dentry->definition_end, from_review_list);
+#else
 	for (size_t i = 0; i < dentry->num_sense_groups; ++i)
 	{
 		render_sense_group(b, dentry->sense_groups + i, word_result_is_name(wr), from_review_list);
 	}
+#endif
 
 	append_static("</div>");
 }
@@ -267,14 +346,9 @@ void render_entry(buffer_t* b, word_result_t* wr, bool moar_cut)
 	conditionally_append(moar_cut, "rikaigu-second-and-further rikaigu-hidden");
 	append_static("\">");
 
-	dentry_t* dentry = word_result_get_dentry(wr);
-	/*
-	const auto& review_list_entry = config.review_list.find(result.data[i].dentry.id());
-	std::string* review_list_context = (
-		review_list_entry == config.review_list.end() ? nullptr : &review_list_entry->second
-	);
-	review_list_entry_t* review_list_entry = NULL;
-	*/
+	const bool cached = word_result_get_render_cache_position(wr) != RENDER_CACHE_MISS;
+	dentry_t* dentry = cached ? NULL : word_result_get_dentry(wr);
+	const uint32_t entry_id = cached ? render_cache_get_entry_id(wr) : dentry->entry_id;
 	bool from_review_list = false;
 
 	append_static("<td class=\"word");
@@ -284,14 +358,23 @@ void render_entry(buffer_t* b, word_result_t* wr, bool moar_cut)
 	}
 	else
 	{
-		from_review_list = in_review_list(dentry->entry_id);
+		from_review_list = in_review_list(entry_id);
 		conditionally_append(from_review_list, " reviewed");
 		append_static(" reviewable\" jmdict-id=\"");
-		append_uint(b, dentry->entry_id);
+		append_uint(b, entry_id);
 	}
 	append_static("\">");
 
-	render_dentry(b, wr, dentry, from_review_list);
+	if (cached)
+	{
+		render_cache_copy(b, wr);
+	}
+	else
+	{
+		const size_t fragment_start = b->size;
+		render_dentry(b, wr, dentry, from_review_list);
+		render_cache_insert(wr, entry_id, b->data + fragment_start, b->size - fragment_start);
+	}
 
 	append_static("</td></tr>");
 }
@@ -313,6 +396,135 @@ void render_entries(buffer_t* b)
 
 void make_html()
 {
+	get_and_parse_dentries(true);
+
 	buffer_t* buffer = state_get_html_buffer();
 	render_entries(buffer);
 }
+
+// Same order as kanjiInfoKeys in js/options.js, bit `i` of `info_mask` enables key `i`
+static const struct {
+	const char* code;
+	size_t code_length;
+	const char* name;
+	size_t name_length;
+} kanji_info_keys[] = {
+#define kanji_info_key(code, name) { code, sizeof(code) - 1, name, sizeof(name) - 1 }
+	kanji_info_key("H", "Halpern"),
+	kanji_info_key("L", "Heisig"),
+	kanji_info_key("E", "Henshall"),
+	kanji_info_key("DK", "Kanji Learners Dictionary"),
+	kanji_info_key("N", "Nelson"),
+	kanji_info_key("V", "New Nelson"),
+	kanji_info_key("Y", "PinYin"),
+	kanji_info_key("P", "Skip Pattern"),
+	kanji_info_key("IN", "Tuttle Kanji &amp; Kana"),
+	kanji_info_key("I", "Tuttle Kanji Dictionary"),
+	kanji_info_key("U", "Unicode"),
+#undef kanji_info_key
+};
+
+void append_hex(buffer_t* b, uint32_t v)
+{
+	static const char digits[] = "0123456789ABCDEF";
+	char buf[8];
+	size_t num_digits = 0;
+	do
+	{
+		num_digits += 1;
+		buf[sizeof(buf) - num_digits] = digits[v % 16];
+		v /= 16;
+	} while (v != 0);
+	append(b, buf + sizeof(buf) - num_digits, num_digits);
+}
+
+void append_kanji_code(buffer_t* b, const kanji_entry_t* entry, const char* code, size_t code_length)
+{
+	const i_promise_i_wont_overwrite_it_string_t value = kanji_get_code(entry, code, code_length);
+	if (value.length > 0)
+	{
+		append(b, value.text, value.length);
+	}
+	else
+	{
+		append_char(b, '-');
+	}
+}
+
+void render_kanji_info(buffer_t* b, const kanji_entry_t* entry, const uint32_t info_mask)
+{
+	append_static("<table class=\"k-mix-tb\">");
+	size_t row = 0;
+	for (size_t i = 0; i < sizeof(kanji_info_keys) / sizeof(kanji_info_keys[0]); ++i)
+	{
+		if ((info_mask & (1u << i)) == 0)
+		{
+			continue;
+		}
+		const char* const td = row % 2 == 0 ? "<td class=\"k-mix-td0\">" : "<td class=\"k-mix-td1\">";
+		const size_t td_length = sizeof("<td class=\"k-mix-td0\">") - 1;
+		append_static("<tr>");
+		append(b, td, td_length);
+		append(b, kanji_info_keys[i].name, kanji_info_keys[i].name_length);
+		append_static("</td>");
+		append(b, td, td_length);
+		if (kanji_info_keys[i].code[0] == 'U')
+		{
+			append_hex(b, entry->code_point);
+		}
+		else
+		{
+			append_kanji_code(b, entry, kanji_info_keys[i].code, kanji_info_keys[i].code_length);
+		}
+		append_static("</td></tr>");
+		row += 1;
+	}
+	append_static("</table>");
+}
+
+void render_kanji_readings(buffer_t* b, const kanji_entry_t* entry)
+{
+	const i_promise_i_wont_overwrite_it_string_t* fields = entry->fields;
+	append_static("<div class=\"k-yomi\">");
+	append(b, fields[KANJI_FIELD_READINGS].text, fields[KANJI_FIELD_READINGS].length);
+	if (fields[KANJI_FIELD_NANORI].length > 0)
+	{
+		append_static(u8"<br/><span class=\"k-yomi-ti\">名乗り</span> ");
+		append(b, fields[KANJI_FIELD_NANORI].text, fields[KANJI_FIELD_NANORI].length);
+	}
+	if (fields[KANJI_FIELD_RADICAL_NAME].length > 0)
+	{
+		append_static(u8"<br/><span class=\"k-yomi-ti\">部首名</span> ");
+		append(b, fields[KANJI_FIELD_RADICAL_NAME].text, fields[KANJI_FIELD_RADICAL_NAME].length);
+	}
+	append_static("</div>");
+}
+
+void make_kanji_html(const uint32_t info_mask)
+{
+	buffer_t* b = state_get_html_buffer();
+	const kanji_entry_t* entry = kanji_get_entry();
+	const i_promise_i_wont_overwrite_it_string_t* fields = entry->fields;
+
+	append_static("<table class=\"k-main-tb\"><tr><td valign=\"top\">");
+	append_static("<table class=\"k-abox-tb\"><tr><td class=\"k-abox-r\">radical<br/>");
+	append_kanji_code(b, entry, "B", 1);
+	append_static("</td><td class=\"k-abox-g\">grade<br/>");
+	append_kanji_code(b, entry, "G", 1);
+	append_static("</td></tr><tr><td class=\"k-abox-f\">freq<br/>");
+	append_kanji_code(b, entry, "F", 1);
+	append_static("</td><td class=\"k-abox-s\">strokes<br/>");
+	append_kanji_code(b, entry, "S", 1);
+	append_static("</td></tr></table>");
+	render_kanji_info(b, entry, info_mask);
+	append_static("</td></tr><tr><td>");
+
+	append_static("<span class=\"k-kanji\">");
+	append(b, fields[KANJI_FIELD_KANJI].text, fields[KANJI_FIELD_KANJI].length);
+	append_static("</span><br/><div class=\"k-eigo\">");
+	append(b, fields[KANJI_FIELD_MEANINGS].text, fields[KANJI_FIELD_MEANINGS].length);
+	append_static("</div>");
+	render_kanji_readings(b, entry);
+
+	append_static("</td></tr></table>");
+}
@@ -1,3 +1,8 @@
 #pragma once
 
+#include <stdint.h>
+
 void make_html(void);
+
+// Renders entry found by kanji_search()
+void make_kanji_html(const uint32_t info_mask);
@@ -9,3 +9,8 @@
 extern noreturn void take_a_trip(const char* message);
 
 extern void print(const char* message);
+
+// Writes compressed chunk `chunk_index` of external file `file_id` to `dst`,
+// returns number of bytes written. Chunk longer than `capacity` isn't written
+// and zero is returned
+extern uint32_t read_chunk(uint32_t file_id, uint32_t chunk_index, uint8_t* dst, uint32_t capacity);
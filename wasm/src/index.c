@@ -13,21 +13,68 @@
 #include "../generated/index.h"
 
 compressed_file_t words_index = {
+	.chunk_size = words_dictionary_index_chunk_size,
 	.last_chunk_index = words_dictionary_index_last_chunk_index,
 	.last_chunk_size = words_dictionary_index_last_chunk_size,
 	.original_size = words_dictionary_index_original_size,
 	.chunks_offsets = words_dictionary_index_chunks_offsets,
 	.data = words_dictionary_index_data,
+	.lz4_dict = words_dictionary_index_lz4_dict,
+	.lz4_dict_size = words_dictionary_index_lz4_dict_size,
 	.currently_decompressed_chunk_index = SIZE_MAX,
+	.file_id = words_dictionary_index_file_id,
 };
 
 compressed_file_t names_index = {
+	.chunk_size = names_dictionary_index_chunk_size,
 	.last_chunk_index = names_dictionary_index_last_chunk_index,
 	.last_chunk_size = names_dictionary_index_last_chunk_size,
 	.original_size = names_dictionary_index_original_size,
 	.chunks_offsets = names_dictionary_index_chunks_offsets,
 	.data = names_dictionary_index_data,
+	.lz4_dict = names_dictionary_index_lz4_dict,
+	.lz4_dict_size = names_dictionary_index_lz4_dict_size,
 	.currently_decompressed_chunk_index = SIZE_MAX,
+	.file_id = names_dictionary_index_file_id,
+};
+
+compressed_file_t words_postings = {
+	.chunk_size = words_dictionary_postings_chunk_size,
+	.last_chunk_index = words_dictionary_postings_last_chunk_index,
+	.last_chunk_size = words_dictionary_postings_last_chunk_size,
+	.original_size = words_dictionary_postings_original_size,
+	.chunks_offsets = words_dictionary_postings_chunks_offsets,
+	.data = words_dictionary_postings_data,
+	.lz4_dict = words_dictionary_postings_lz4_dict,
+	.lz4_dict_size = words_dictionary_postings_lz4_dict_size,
+	.currently_decompressed_chunk_index = SIZE_MAX,
+	.file_id = words_dictionary_postings_file_id,
+};
+
+compressed_file_t names_postings = {
+	.chunk_size = names_dictionary_postings_chunk_size,
+	.last_chunk_index = names_dictionary_postings_last_chunk_index,
+	.last_chunk_size = names_dictionary_postings_last_chunk_size,
+	.original_size = names_dictionary_postings_original_size,
+	.chunks_offsets = names_dictionary_postings_chunks_offsets,
+	.data = names_dictionary_postings_data,
+	.lz4_dict = names_dictionary_postings_lz4_dict,
+	.lz4_dict_size = names_dictionary_postings_lz4_dict_size,
+	.currently_decompressed_chunk_index = SIZE_MAX,
+	.file_id = names_dictionary_postings_file_id,
+};
+
+compressed_file_t kanji_words_index = {
+	.chunk_size = kanji_words_index_chunk_size,
+	.last_chunk_index = kanji_words_index_last_chunk_index,
+	.last_chunk_size = kanji_words_index_last_chunk_size,
+	.original_size = kanji_words_index_original_size,
+	.chunks_offsets = kanji_words_index_chunks_offsets,
+	.data = kanji_words_index_data,
+	.lz4_dict = kanji_words_index_lz4_dict,
+	.lz4_dict_size = kanji_words_index_lz4_dict_size,
+	.currently_decompressed_chunk_index = SIZE_MAX,
+	.file_id = kanji_words_index_file_id,
 };
 
 struct dictionary_index_entry {
@@ -48,6 +95,17 @@ struct {
 } current_index_entry = {0};
 
 uint8_t index_entry_buffer[dictionary_index_max_entry_length];
+uint32_t shared_postings_buffer[dictionary_index_max_shared_postings];
+
+// Chunk size is a multiple of 8, so words never cross chunks
+static uint32_t read_uint32_at(compressed_file_t* file, size_t position)
+{
+	const size_t chunk_size = file->chunk_size;
+	decompress_chunk_prefix(file, position / chunk_size, position % chunk_size + sizeof(uint32_t));
+	uint32_t res;
+	memcpy(&res, decompressed_chunk + position % chunk_size, sizeof(uint32_t));
+	return res;
+}
 
 inline bool is_offset_or_type(char16_t v)
 {
@@ -70,24 +128,24 @@ ptrdiff_t find_index_entry_start_offset(size_t position_in_chunk)
 	return current >= begin ? ((const uint8_t*)(current + 1) - decompressed_chunk) : -1;
 }
 
-ptrdiff_t find_index_entry_start_offset_in_previous_chunk(char16_t index_entry_second_part_first_char16)
+ptrdiff_t find_index_entry_start_offset_in_previous_chunk(size_t chunk_size, char16_t index_entry_second_part_first_char16)
 {
-	// previous chunk is always of CHUNK_SIZE
-	const char16_t last_char16 = *(char16_t*)(decompressed_chunk + CHUNK_SIZE - 2);
+	// previous chunk is always of `chunk_size`
+	const char16_t last_char16 = *(char16_t*)(decompressed_chunk + chunk_size - 2);
 	if (!is_offset_or_type(index_entry_second_part_first_char16) && is_offset_or_type(last_char16))
 	{
 		// edge case when previous entry ended on chunk boundary
-		return CHUNK_SIZE;
+		return (ptrdiff_t)chunk_size;
 	}
 
 	// -2 because find_index_entry_start_offset(pos) iterates backward and start reading
 	// at `decompressed_chunk[pos]`
-	return find_index_entry_start_offset(CHUNK_SIZE - 2);
+	return find_index_entry_start_offset(chunk_size - 2);
 }
 
-ptrdiff_t find_index_entry_end_offset(size_t real_chunk_size, size_t position_in_chunk)
+ptrdiff_t find_index_entry_end_offset(size_t end_in_chunk, size_t position_in_chunk)
 {
-	const char16_t* const end = (char16_t*)(decompressed_chunk + real_chunk_size);
+	const char16_t* const end = (char16_t*)(decompressed_chunk + end_in_chunk);
 	const char16_t* current = (char16_t*)(decompressed_chunk + position_in_chunk);
 	while (current < end && !is_offset_or_type(*current))
 	{
@@ -101,7 +159,20 @@ ptrdiff_t find_index_entry_end_offset(size_t real_chunk_size, size_t position_in
 	return current < end ? ((const uint8_t*)current - decompressed_chunk) : -1;
 }
 
-ptrdiff_t find_index_entry_end_offset_in_next_chunk(size_t real_chunk_size, char16_t index_entry_first_part_last_char16)
+// Same as find_index_entry_end_offset() over decompressed prefix of the chunk,
+// but decompresses the whole chunk when the entry doesn't end in the prefix
+ptrdiff_t find_index_entry_end_offset_in_chunk(compressed_file_t* index, size_t chunk_index, size_t position_in_chunk)
+{
+	ptrdiff_t entry_end_offset = find_index_entry_end_offset(decompressed_chunk_size, position_in_chunk);
+	if (entry_end_offset == -1 && decompressed_chunk_size < get_real_chunk_size(index, chunk_index))
+	{
+		decompress_chunk(index, chunk_index);
+		entry_end_offset = find_index_entry_end_offset(decompressed_chunk_size, position_in_chunk);
+	}
+	return entry_end_offset;
+}
+
+ptrdiff_t find_index_entry_end_offset_in_next_chunk(compressed_file_t* index, size_t chunk_index, char16_t index_entry_first_part_last_char16)
 {
 	const char16_t first_char16 = *(char16_t*)decompressed_chunk;
 	if (is_offset_or_type(index_entry_first_part_last_char16) && !is_offset_or_type(first_char16))
@@ -109,7 +180,7 @@ ptrdiff_t find_index_entry_end_offset_in_next_chunk(size_t real_chunk_size, char
 		// edge case when entry ended on chunk boundary
 		return 0;
 	}
-	return find_index_entry_end_offset(real_chunk_size, 0);
+	return find_index_entry_end_offset_in_chunk(index, chunk_index, 0);
 }
 
 size_t find_index_entry_offsets_start_position(const uint8_t* index_entry_start, const size_t index_entry_length)
@@ -148,14 +219,16 @@ void get_index_entry_at(compressed_file_t* index, size_t position)
 	// so we can always start at 2-aligned position
 	position -= (position % 2);
 
-	const size_t chunk_index = position / CHUNK_SIZE;
-	decompress_chunk(index, chunk_index);
+	const size_t chunk_size = index->chunk_size;
+	const size_t chunk_index = position / chunk_size;
+	const size_t position_in_chunk = position % chunk_size;
+	decompress_chunk_prefix(index, chunk_index, position_in_chunk);
 
-	const size_t position_in_chunk = position % CHUNK_SIZE;
 	ptrdiff_t entry_start_offset = find_index_entry_start_offset(position_in_chunk);
 
-	size_t real_chunk_size = get_real_chunk_size(index, chunk_index);
-	ptrdiff_t entry_end_offset = find_index_entry_end_offset(real_chunk_size, position_in_chunk);
+	const size_t real_chunk_size = get_real_chunk_size(index, chunk_index);
+	// Whole chunk is decompressed when it's -1
+	ptrdiff_t entry_end_offset = find_index_entry_end_offset_in_chunk(index, chunk_index, position_in_chunk);
 
 	assert(entry_start_offset != -1 || entry_end_offset != -1);
 	if (entry_start_offset == -1 && chunk_index == 0)
@@ -179,15 +252,15 @@ void get_index_entry_at(compressed_file_t* index, size_t position)
 		decompress_chunk(index, chunk_index - 1);
 
 		const char16_t index_entry_second_part_first_char16 = *(char16_t*)(index_entry_buffer + sizeof(index_entry_buffer) - entry_end_offset);
-		entry_start_offset = find_index_entry_start_offset_in_previous_chunk(index_entry_second_part_first_char16);
+		entry_start_offset = find_index_entry_start_offset_in_previous_chunk(chunk_size, index_entry_second_part_first_char16);
 		assert(entry_start_offset != -1);
 
-		// Previous chunk is always of CHUNK_SIZE
-		size_t prefix_length = CHUNK_SIZE - entry_start_offset;
+		// Previous chunk is always of `chunk_size`
+		size_t prefix_length = chunk_size - entry_start_offset;
 
 		index_entry_start = index_entry_buffer + sizeof(index_entry_buffer) - entry_end_offset - prefix_length;
 		index_entry_length = prefix_length + entry_end_offset;
-		start_position_in_index = (chunk_index - 1)*CHUNK_SIZE + entry_start_offset;
+		start_position_in_index = (chunk_index - 1)*chunk_size + entry_start_offset;
 
 		memcpy(index_entry_start, decompressed_chunk + entry_start_offset, prefix_length);
 	}
@@ -198,16 +271,15 @@ void get_index_entry_at(compressed_file_t* index, size_t position)
 		size_t prefix_length = real_chunk_size - entry_start_offset;
 		memcpy(index_entry_buffer, decompressed_chunk + entry_start_offset, prefix_length);
 
-		decompress_chunk(index, chunk_index + 1);
+		decompress_chunk_prefix(index, chunk_index + 1, 0);
 
-		real_chunk_size = get_real_chunk_size(index, chunk_index + 1);
 		const char16_t index_entry_first_part_last_char16 = *(char16_t*)(index_entry_buffer + prefix_length - 2);
-		entry_end_offset = find_index_entry_end_offset_in_next_chunk(real_chunk_size, index_entry_first_part_last_char16);
+		entry_end_offset = find_index_entry_end_offset_in_next_chunk(index, chunk_index + 1, index_entry_first_part_last_char16);
 		assert(entry_end_offset != -1);
 
 		index_entry_start = index_entry_buffer;
 		index_entry_length = prefix_length + entry_end_offset;
-		start_position_in_index = chunk_index*CHUNK_SIZE + entry_start_offset;
+		start_position_in_index = chunk_index*chunk_size + entry_start_offset;
 
 		memcpy(index_entry_buffer + prefix_length, decompressed_chunk, entry_end_offset);
 	}
@@ -215,7 +287,7 @@ void get_index_entry_at(compressed_file_t* index, size_t position)
 	{
 		index_entry_start = index_entry_buffer;
 		index_entry_length = entry_end_offset - entry_start_offset;
-		start_position_in_index = chunk_index*CHUNK_SIZE + entry_start_offset;
+		start_position_in_index = chunk_index*chunk_size + entry_start_offset;
 
 		memcpy(index_entry_buffer, decompressed_chunk + entry_start_offset, index_entry_length);
 	}
@@ -242,6 +314,31 @@ void current_index_entry_decode_offsets()
 	}
 }
 
+/*
+ * Identical posting lists of several keys are stored once in postings
+ * file (see share_postings() of data/wasm_generator.py), and entry has
+ * reference to it instead: type 0 and position of the list in words.
+ * Must be called after current_index_entry_decode_offsets().
+ */
+void current_index_entry_resolve_shared_postings(compressed_file_t* postings)
+{
+	if (current_index_entry.num_offsets != 2 || current_index_entry.offsets[0] != dictionary_index_type_bit)
+	{
+		return;
+	}
+
+	size_t position = current_index_entry.offsets[1] * sizeof(uint32_t);
+	const size_t num_offsets = read_uint32_at(postings, position);
+	assert(num_offsets <= dictionary_index_max_shared_postings);
+	for (size_t i = 0; i < num_offsets; ++i)
+	{
+		position += sizeof(uint32_t);
+		shared_postings_buffer[i] = read_uint32_at(postings, position);
+	}
+	current_index_entry.offsets = shared_postings_buffer;
+	current_index_entry.num_offsets = num_offsets;
+}
+
 bool dictionary_index_search_for_offsets(
 	compressed_file_t* index, const char16_t* needle, size_t search_length,
 	size_t low, size_t high
@@ -285,17 +382,20 @@ typedef struct {
 	const void* data_start;
 } index_entries_cache_search_context_t;
 
-int index_entries_cache_cmp(const void* key, const void* object)
+static inline int index_entries_cache_cmp(const index_entries_cache_search_context_t* c, const dictionary_index_entry_t* e)
 {
-	const index_entries_cache_search_context_t* c = key;
-	const dictionary_index_entry_t* e = object;
-
 	return utf16_compare(
 		c->needle, c->needle_length,
 		(const char16_t*)(c->data_start + e->vardata_start_offset), e->key_length
 	);
 }
 
+define_binary_locate(
+	locate_cached_index_entry,
+	const index_entries_cache_search_context_t*, dictionary_index_entry_t,
+	index_entries_cache_cmp
+)
+
 dictionary_index_entry_t* index_entries_cache_locate_entry(
 	buffer_t* b, const char16_t* needle, size_t needle_length,
 	size_t* low, size_t* high, bool* found
@@ -309,10 +409,10 @@ dictionary_index_entry_t* index_entries_cache_locate_entry(
 
 	dictionary_index_entry_t* array = vardata_array_elements_start(b);
 	const size_t num_elements = vardata_array_num_elements(b);
-	dictionary_index_entry_t* it = binary_locate(
+	dictionary_index_entry_t* it = locate_cached_index_entry(
 		&c, array,
-		num_elements, sizeof(dictionary_index_entry_t),
-		index_entries_cache_cmp, found
+		num_elements,
+		found
 	);
 	if (*found)
 	{
@@ -342,12 +442,15 @@ size_t index_entries_cache_copy_current_data(buffer_t* b)
 	return new_entry_vardata_start - vardata_array_vardata_start(b);
 }
 
-void index_entries_cache_add_current(buffer_t* b, dictionary_index_entry_t* it)
+dictionary_index_entry_t* index_entries_cache_add_current(buffer_t* b, dictionary_index_entry_t* it)
 {
+	const size_t index = it - (dictionary_index_entry_t*)vardata_array_elements_start(b);
 	const size_t vardata_start_offset = index_entries_cache_copy_current_data(b);
 
+	// Buffer may have been moved by copying
 	dictionary_index_entry_t* array = vardata_array_elements_start(b);
 	const size_t num_elements = vardata_array_num_elements(b);
+	it = array + index;
 
 	vardata_array_increment_size(b);
 	memmove(it + 1, it, (array + num_elements - it) * sizeof(dictionary_index_entry_t));
@@ -357,6 +460,7 @@ void index_entries_cache_add_current(buffer_t* b, dictionary_index_entry_t* it)
 	it->key_length = current_index_entry.key_length;
 	it->num_offsets = current_index_entry.num_offsets;
 	it->vardata_start_offset = vardata_start_offset;
+	return it;
 }
 
 dictionary_index_entry_t* dictionary_index_get_entry(compressed_file_t* d, const char16_t* needle, size_t needle_length)
@@ -366,12 +470,13 @@ dictionary_index_entry_t* dictionary_index_get_entry(compressed_file_t* d, const
 	size_t low = 0;
 	dictionary_index_entry_t* it = NULL;
 	size_t high = d->original_size;
-	if (d != currently_decompressed_file)
+	compressed_file_t* postings = d == &names_index ? &names_postings : &words_postings;
+	if (d != currently_decompressed_file && postings != currently_decompressed_file)
 	{
 		// we search indices separately (only words, then only names)
 		// and assume cache contains only words OR only names
-		// if d != currently_decompressed_file, then we switched index
-		// and need to clear cache
+		// if neither d nor its postings is currently_decompressed_file,
+		// then we switched index and need to clear cache
 		it = index_entries_cache_clear(buf);
 	}
 	else
@@ -392,8 +497,8 @@ dictionary_index_entry_t* dictionary_index_get_entry(compressed_file_t* d, const
 		return NULL;
 	}
 
-	index_entries_cache_add_current(buf, it);
-	return it;
+	current_index_entry_resolve_shared_postings(postings);
+	return index_entries_cache_add_current(buf, it);
 }
 
 dictionary_index_entry_t* get_index_entry(Dictionary d, const char16_t* needle, size_t needle_length)
@@ -445,3 +550,31 @@ bool offsets_iterator_read_next(offsets_iterator_t* it, uint32_t* type, uint32_t
 	}
 	return true;
 }
+
+static inline int code_point_cmp(const uint32_t key, const uint32_t* element)
+{
+	return key < *element ? -1 : (key > *element ? 1 : 0);
+}
+
+define_binary_locate(locate_kanji_words, const uint32_t, const uint32_t, code_point_cmp)
+
+size_t kanji_words_get_offsets(const uint32_t code_point, uint32_t* offsets, size_t max_offsets)
+{
+	const size_t num_kanjis = sizeof(kanji_words_code_points) / sizeof(kanji_words_code_points[0]);
+	bool found;
+	const uint32_t* it = locate_kanji_words(code_point, kanji_words_code_points, num_kanjis, &found);
+	if (!found)
+	{
+		return 0;
+	}
+
+	const size_t i = (size_t)(it - kanji_words_code_points);
+	const size_t num_postings = kanji_words_starts[i + 1] - kanji_words_starts[i];
+	const size_t num_offsets = num_postings < max_offsets ? num_postings : max_offsets;
+	size_t position = kanji_words_starts[i] * sizeof(uint32_t);
+	for (size_t j = 0; j < num_offsets; ++j, position += sizeof(uint32_t))
+	{
+		offsets[j] = read_uint32_at(&kanji_words_index, position);
+	}
+	return num_offsets;
+}
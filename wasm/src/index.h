@@ -18,3 +18,7 @@ typedef struct {
 offsets_iterator_t dictionary_index_entry_get_offsets_iterator(dictionary_index_entry_t* entry);
 
 bool offsets_iterator_read_next(offsets_iterator_t* it, uint32_t* type, uint32_t* offset);
+
+// Writes at most `max_offsets` words dictionary offsets of entries containing
+// kanji, best first (see rank_kanji_words() in data/prepare-dict.py)
+size_t kanji_words_get_offsets(const uint32_t code_point, uint32_t* offsets, size_t max_offsets);
@@ -0,0 +1,187 @@
+#include "kanji.h"
+
+#include <assert.h>
+
+#include "state.h"
+#include "libc.h"
+#include "decompress.h"
+#include "dictionaries.h"
+#include "vector.h"
+
+#include "../generated/kanji.h"
+
+/*
+ * Kanji dictionary is data/kanji.dat, LZ4-chunked like words and names
+ * dictionaries, but no record crosses a chunk boundary. Record position
+ * is found with two level direct-indexed table (see write_kanji_table()
+ * in data/wasm_generator.py), so a lookup takes two array reads and
+ * at most one chunk decompression.
+ */
+
+compressed_file_t kanji_dictionary = {
+	.chunk_size = kanji_dictionary_chunk_size,
+	.last_chunk_index = kanji_dictionary_last_chunk_index,
+	.last_chunk_size = kanji_dictionary_last_chunk_size,
+	.original_size = kanji_dictionary_original_size,
+	.chunks_offsets = kanji_dictionary_chunks_offsets,
+	.data = kanji_dictionary_data,
+	.lz4_dict = kanji_dictionary_lz4_dict,
+	.lz4_dict_size = kanji_dictionary_lz4_dict_size,
+	.currently_decompressed_chunk_index = SIZE_MAX,
+	.file_id = kanji_dictionary_file_id,
+};
+
+#define kanji_page_size (1u << KANJI_PAGE_BITS)
+
+// Returns record position plus one, zero when there is no such kanji
+uint32_t kanji_position(const uint32_t code_point)
+{
+	const uint32_t page_slot = code_point >> KANJI_PAGE_BITS;
+	if (page_slot >= sizeof(kanji_pages) / sizeof(kanji_pages[0]) || kanji_pages[page_slot] == 0)
+	{
+		return 0;
+	}
+	return kanji_positions[(kanji_pages[page_slot] - 1u) * kanji_page_size + (code_point & (kanji_page_size - 1))];
+}
+
+size_t kanji_search(const uint32_t code_point)
+{
+	const uint32_t position = kanji_position(code_point);
+	if (position == 0)
+	{
+		return 0;
+	}
+
+	buffer_t* b = state_get_raw_dentry_buffer();
+	const char* raw = get_dentry_at(b, &kanji_dictionary, position - 1);
+	const char* const end = b->data + b->size;
+	assert(kanji_dictionary.currently_decompressed_chunk_index == (position - 1) / kanji_dictionary.chunk_size);
+
+	kanji_entry_t* entry = buffer_allocate(state_get_dentry_buffer(), sizeof(kanji_entry_t));
+	memzero(entry, sizeof(kanji_entry_t));
+	entry->code_point = code_point;
+	for (size_t i = 0; i < KANJI_NUM_FIELDS && raw <= end; ++i)
+	{
+		const char* field_end = find_char(raw, end, '|');
+		entry->fields[i].text = raw;
+		entry->fields[i].length = (size_t)(field_end - raw);
+		raw = field_end + 1;
+	}
+
+	return code_point > 0xFFFF ? 2 : 1;
+}
+
+kanji_entry_t* kanji_get_entry()
+{
+	buffer_t* b = state_get_dentry_buffer();
+	assert(b->size >= sizeof(kanji_entry_t));
+	return b->data;
+}
+
+bool code_has_prefix(const char* s, const char* prefix, const size_t prefix_length)
+{
+	for (size_t i = 0; i < prefix_length; ++i)
+	{
+		if (s[i] != prefix[i])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+i_promise_i_wont_overwrite_it_string_t kanji_get_code(const kanji_entry_t* entry, const char* code, const size_t code_length)
+{
+	const i_promise_i_wont_overwrite_it_string_t* codes = &entry->fields[KANJI_FIELD_CODES];
+	const char* const end = codes->text + codes->length;
+	for (const char* start = codes->text; start < end;)
+	{
+		const char* code_end = find_char(start, end, ' ');
+		// Code letters are followed by digits or pinyin, which is lowercase
+		if ((size_t)(code_end - start) > code_length
+			&& code_has_prefix(start, code, code_length)
+			&& !(start[code_length] >= 'A' && start[code_length] <= 'Z'))
+		{
+			return (i_promise_i_wont_overwrite_it_string_t){
+				.text = start + code_length,
+				.length = (size_t)(code_end - start) - code_length,
+			};
+		}
+		start = code_end + 1;
+	}
+	return (i_promise_i_wont_overwrite_it_string_t){ .text = NULL, .length = 0 };
+}
+
+/*
+ * Component search: kanjis are numbered in frequency order and every
+ * radical has a bitset of kanjis containing it (see write_radicals() in
+ * data/wasm_generator.py). Matching kanjis are intersection of selected
+ * radicals' bitsets, and walking its bits yields them already sorted.
+ * Bitsets are under 1KiB, so intersection is accumulated on stack
+ * 128 bits at a time.
+ */
+
+static_assert(NUM_RADICALS <= max_radicals, "Radicals are passed as uint8_t");
+static_assert(RADICAL_BITSET_WORDS % 2 == 0, "Bitsets are whole vectors");
+
+void radical_get_names(buffer_t* b)
+{
+	memcpy(buffer_allocate(b, sizeof(radical_names)), radical_names, sizeof(radical_names));
+}
+
+uint32_t* append_radical_kanjis(uint32_t* out, const size_t word_index, uint64_t word, const uint32_t min_strokes, const uint32_t max_strokes)
+{
+	while (word != 0)
+	{
+		const size_t i = word_index * 64 + (size_t)__builtin_ctzll(word);
+		word &= word - 1;
+		if (radical_kanji_strokes[i] >= min_strokes && radical_kanji_strokes[i] <= max_strokes)
+		{
+			*out++ = radical_kanjis[i];
+		}
+	}
+	return out;
+}
+
+void radical_search(buffer_t* b, const uint8_t* radicals, const size_t num_radicals, const uint32_t min_strokes, const uint32_t max_strokes)
+{
+	if (num_radicals == 0)
+	{
+		return;
+	}
+
+	uint64_t matches[RADICAL_BITSET_WORDS] __attribute__((aligned(16)));
+	assert(radicals[0] < NUM_RADICALS);
+	memcpy(matches, radical_bitsets + radicals[0] * RADICAL_BITSET_WORDS, sizeof(matches));
+	for (size_t r = 1; r < num_radicals; ++r)
+	{
+		assert(radicals[r] < NUM_RADICALS);
+		const uint64_t* bitset = radical_bitsets + radicals[r] * RADICAL_BITSET_WORDS;
+		size_t i = 0;
+#if defined(HAVE_VECTORS)
+		for (; i < RADICAL_BITSET_WORDS; i += 2)
+		{
+			*(u64x2_t*)(matches + i) &= *(const u64x2_t*)(bitset + i);
+		}
+#endif
+		for (; i < RADICAL_BITSET_WORDS; ++i)
+		{
+			matches[i] &= bitset[i];
+		}
+	}
+
+	size_t num_matches = 0;
+	for (size_t i = 0; i < RADICAL_BITSET_WORDS; ++i)
+	{
+		num_matches += (size_t)__builtin_popcountll(matches[i]);
+	}
+
+	uint32_t* const start = buffer_allocate(b, num_matches * sizeof(uint32_t));
+	uint32_t* end = start;
+	for (size_t i = 0; i < RADICAL_BITSET_WORDS; ++i)
+	{
+		end = append_radical_kanjis(end, i, matches[i], min_strokes, max_strokes);
+	}
+	// Returns place of kanjis filtered out by stroke count
+	b->size -= (num_matches - (size_t)(end - start)) * sizeof(uint32_t);
+}
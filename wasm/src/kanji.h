@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dentry.h"
+#include "state.h"
+
+// Fields of data/kanji.dat line, separated by '|'
+typedef enum {
+	KANJI_FIELD_KANJI,
+	// Space separated index codes: B - radical, G - grade, S - strokes, F - frequency, etc.
+	KANJI_FIELD_CODES,
+	KANJI_FIELD_READINGS,
+	KANJI_FIELD_NANORI,
+	KANJI_FIELD_RADICAL_NAME,
+	KANJI_FIELD_MEANINGS,
+
+	KANJI_NUM_FIELDS,
+} kanji_field_t;
+
+typedef struct {
+	uint32_t code_point;
+	i_promise_i_wont_overwrite_it_string_t fields[KANJI_NUM_FIELDS];
+} kanji_entry_t;
+
+// Returns utf16 length of found kanji (zero if there is no such kanji)
+size_t kanji_search(const uint32_t code_point);
+
+kanji_entry_t* kanji_get_entry(void);
+
+// Returns value of index code (e.g. "DK") or zero length string
+i_promise_i_wont_overwrite_it_string_t kanji_get_code(const kanji_entry_t* entry, const char* code, const size_t code_length);
+
+// Radicals are passed as uint8_t
+#define max_radicals (UINT8_MAX + 1)
+
+// Writes names of radicals (utf-8, newline separated), radicals are
+// referred to by their position in the list
+void radical_get_names(buffer_t* b);
+
+// Writes code points (uint32_t) of kanjis containing every one of `radicals`
+// and having stroke count in [min_strokes, max_strokes], most frequent first
+void radical_search(buffer_t* b, const uint8_t* radicals, const size_t num_radicals, const uint32_t min_strokes, const uint32_t max_strokes);
@@ -6,6 +6,143 @@
 
 #include "utf.h"
 #include "imports.h"
+#include "vector.h"
+
+/*
+ * Block memory functions sit under every buffer_allocate() copy, so there
+ * are three backends, chosen at compile time by target features:
+ *
+ *   - bulk memory: memory.copy/memory.fill instructions (clang lowers
+ *     builtins to them when -mbulk-memory is on);
+ *   - 16-byte vectors: wasm simd128 or SSE2/NEON in native builds;
+ *   - 8-byte scalar loops, which run everywhere.
+ *
+ * wasm can't check features at runtime, so js/background.js picks one of
+ * rikai.wasm variants built by wasm/Makefile instead. Define
+ * RIKAIGU_SCALAR_MEMORY to force scalar backend (tests and benchmarks).
+ */
+#if defined(RIKAIGU_SCALAR_MEMORY)
+#define MEMORY_BACKEND_SCALAR
+#elif defined(__wasm_bulk_memory__)
+#define MEMORY_BACKEND_BULK
+#elif defined(HAVE_VECTORS)
+#define MEMORY_BACKEND_VECTOR
+#else
+#define MEMORY_BACKEND_SCALAR
+#endif
+
+#if defined(MEMORY_BACKEND_BULK)
+
+void* memcpy(void *dest, const void *src, size_t n)
+{
+	return __builtin_memcpy(dest, src, n);
+}
+
+void* memcpy_backward(void *dest, const void *src, size_t n)
+{
+	// memory.copy handles overlapping ranges in both directions
+	return __builtin_memmove(dest, src, n);
+}
+
+void* memmove(void* dest, const void* src, size_t n)
+{
+	return __builtin_memmove(dest, src, n);
+}
+
+void memzero(void* dest, size_t n)
+{
+	__builtin_memset(dest, 0, n);
+}
+
+#elif defined(MEMORY_BACKEND_VECTOR)
+
+typedef u8x16_t chunk_t;
+
+/*
+ * Tails are handled with one more chunk overlapping the last full one.
+ * It's loaded before the main loop, so memmove() through these
+ * functions stays correct for overlapping ranges.
+ */
+
+void* memcpy(void *dest, const void *src, size_t n)
+{
+	uint8_t* to = dest;
+	const uint8_t* from = src;
+	if (n < sizeof(chunk_t))
+	{
+		for (size_t i = 0; i < n; ++i)
+		{
+			to[i] = from[i];
+		}
+		return dest;
+	}
+
+	const chunk_t last = *(const chunk_t*)(from + n - sizeof(chunk_t));
+	for (size_t i = 0; i + sizeof(chunk_t) <= n; i += sizeof(chunk_t))
+	{
+		*(chunk_t*)(to + i) = *(const chunk_t*)(from + i);
+	}
+	*(chunk_t*)(to + n - sizeof(chunk_t)) = last;
+
+	return dest;
+}
+
+void* memcpy_backward(void *dest, const void *src, size_t n)
+{
+	uint8_t* to = dest;
+	const uint8_t* from = src;
+	if (n < sizeof(chunk_t))
+	{
+		for (size_t i = n; i > 0; --i)
+		{
+			to[i - 1] = from[i - 1];
+		}
+		return dest;
+	}
+
+	const chunk_t first = *(const chunk_t*)from;
+	for (size_t i = n; i >= sizeof(chunk_t); i -= sizeof(chunk_t))
+	{
+		*(chunk_t*)(to + i - sizeof(chunk_t)) = *(const chunk_t*)(from + i - sizeof(chunk_t));
+	}
+	*(chunk_t*)to = first;
+
+	return dest;
+}
+
+void* memmove(void* dest, const void* src, size_t n)
+{
+	if (dest < src)
+	{
+		return memcpy(dest, src, n);
+	}
+	else
+	{
+		return memcpy_backward(dest, src, n);
+	}
+}
+
+void memzero(void* dest, size_t n)
+{
+	uint8_t* to = dest;
+	if (n < sizeof(chunk_t))
+	{
+		for (size_t i = 0; i < n; ++i)
+		{
+			to[i] = 0;
+		}
+		return;
+	}
+
+	const chunk_t zero = {0};
+	for (size_t i = 0; i + sizeof(chunk_t) <= n; i += sizeof(chunk_t))
+	{
+		*(chunk_t*)(to + i) = zero;
+	}
+	*(chunk_t*)(to + n - sizeof(chunk_t)) = zero;
+}
+
+#else
 
 void* memcpy(void *dest, const void *src, size_t n)
 {
@@ -93,6 +230,35 @@ void memzero(void* dest, size_t n)
 	}
 }
 
+#endif
+
+/*
+ * Generic versions take element size and comparator at runtime, they are
+ * kept for callers outside of hot paths. Hot paths use specializations
+ * from define_binary_locate() and friends (see libc.h), which follow
+ * the same loop.
+ */
+size_t partition_point(
+	const void *key, const void *array,
+	size_t num_elements, size_t element_size,
+	int (*compar)(const void*, const void*), int threshold
+	)
+{
+	if (num_elements == 0)
+	{
+		return 0;
+	}
+	size_t base = 0;
+	size_t n = num_elements;
+	while (n > 1)
+	{
+		const size_t half = n / 2;
+		base = compar(key, array + (base + half) * element_size) > threshold ? base + half : base;
+		n -= half;
+	}
+	return base + (compar(key, array + base * element_size) > threshold);
+}
+
 void* binary_locate(
 	const void *key, const void *array,
 	size_t num_elements, size_t element_size,
@@ -103,29 +269,9 @@ void* binary_locate(
 #pragma clang diagnostic ignored "-Wcast-qual"
 
 	assert(found != NULL);
-	*found = false;
-
-	size_t low = 0;
-	size_t high = num_elements;
-	while (low < high)
-	{
-		const size_t mid = (low + high) / 2;
-		int order = compar(key, array + mid * element_size);
-		if (order > 0)
-		{
-			low = mid + 1;
-		}
-		else if (order < 0)
-		{
-			high = mid;
-		}
-		else
-		{
-			*found = true;
-			return (void*)(array + mid * element_size);
-		}
-	}
-	return (void*)(array + low * element_size);
+	const size_t index = partition_point(key, array, num_elements, element_size, compar, 0);
+	*found = index < num_elements && compar(key, array + index * element_size) == 0;
+	return (void*)(array + index * element_size);
 #pragma clang diagnostic pop
 }
 
@@ -136,69 +282,13 @@ bool binary_locate_bounds(
 	size_t* lower, size_t* upper
 	)
 {
-	size_t low = 0;
-	size_t high = num_elements;
-	size_t match = -1;
-	while (low < high)
-	{
-		const size_t mid = (low + high) / 2;
-		int order = compar(key, array + mid * element_size);
-		if (order > 0)
-		{
-			low = mid + 1;
-		}
-		else if (order < 0)
-		{
-			high = mid;
-		}
-		else
-		{
-			match = mid;
-			break;
-		}
-	}
-	if (low == high)
-	{
-		*lower = low;
-		*upper = high;
-		return false;
-	}
-
-	const size_t match_high = high;
-	high = match;
-	while (low < high)
-	{
-		const size_t mid = (low + high) / 2;
-		int order = compar(key, array + mid * element_size);
-		if (order > 0)
-		{
-			low = mid + 1;
-		}
-		else
-		{
-			high = mid;
-		}
-	}
-	*lower = low;
-
-	high = match_high;
-	low = match;
-	while (low < high)
-	{
-		const size_t mid = (low + high) / 2;
-		int order = compar(key, array + mid * element_size);
-		if (order < 0)
-		{
-			high = mid;
-		}
-		else
-		{
-			low = mid + 1;
-		}
-	}
-	*upper = high;
-
-	return true;
+	*lower = partition_point(key, array, num_elements, element_size, compar, 0);
+	*upper = *lower + partition_point(
+		key, array + *lower * element_size,
+		num_elements - *lower, element_size,
+		compar, -1
+	);
+	return *lower != *upper;
 }
 
 const char* find_char(const char* start, const char* end, const char c)
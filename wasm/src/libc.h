@@ -18,6 +18,72 @@ bool binary_locate_bounds(
 	size_t* lower, size_t* upper
 );
 
+/*
+ * Type-specialized counterparts of binary_locate() and binary_locate_bounds().
+ * `compar(key, element)` is called directly, so it's inlined, and the loop
+ * has no data-dependent branches: range halves every step and its start
+ * moves with a conditional select.
+ *
+ * define_lower_bound/define_upper_bound generate
+ *     element_type* name(key_type key, element_type* array, size_t num_elements)
+ * returning first element not less (greater) than key.
+ */
+#define define_partition_point(name, key_type, element_type, compar, op) \
+	static inline element_type* name(key_type key, element_type* array, size_t num_elements) \
+	{ \
+		if (num_elements == 0) \
+		{ \
+			return array; \
+		} \
+		element_type* base = array; \
+		size_t n = num_elements; \
+		while (n > 1) \
+		{ \
+			const size_t half = n / 2; \
+			base = compar(key, base + half) op 0 ? base + half : base; \
+			n -= half; \
+		} \
+		return base + (compar(key, base) op 0); \
+	}
+
+#define define_lower_bound(name, key_type, element_type, compar) \
+	define_partition_point(name, key_type, element_type, compar, >)
+
+#define define_upper_bound(name, key_type, element_type, compar) \
+	define_partition_point(name, key_type, element_type, compar, >=)
+
+/*
+ * Generates
+ *     element_type* name(key_type key, element_type* array, size_t num_elements, bool* found)
+ * Same contract as binary_locate(), except first of equal elements is returned.
+ */
+#define define_binary_locate(name, key_type, element_type, compar) \
+	define_lower_bound(name##_lower_bound, key_type, element_type, compar) \
+	static inline element_type* name(key_type key, element_type* array, size_t num_elements, bool* found) \
+	{ \
+		element_type* it = name##_lower_bound(key, array, num_elements); \
+		*found = it != array + num_elements && compar(key, it) == 0; \
+		return it; \
+	}
+
+/*
+ * Generates
+ *     bool name(key_type key, element_type* array, size_t num_elements, size_t* lower, size_t* upper)
+ * Same contract as binary_locate_bounds().
+ */
+#define define_binary_locate_bounds(name, key_type, element_type, compar) \
+	define_lower_bound(name##_lower_bound, key_type, element_type, compar) \
+	define_upper_bound(name##_upper_bound, key_type, element_type, compar) \
+	static inline bool name(key_type key, element_type* array, size_t num_elements, size_t* lower, size_t* upper) \
+	{ \
+		element_type* first = name##_lower_bound(key, array, num_elements); \
+		element_type* end = array + num_elements; \
+		element_type* last = name##_upper_bound(key, first, (size_t)(end - first)); \
+		*lower = (size_t)(first - array); \
+		*upper = (size_t)(last - array); \
+		return first != last; \
+	}
+
 const char* find_char(const char* start, const char* end, const char c);
 
 // __attribute__((__format__(__printf__, 1, 2)))
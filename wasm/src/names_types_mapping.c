@@ -17,24 +17,23 @@ static name_type_mapping_t map[] = {
 	{ .type = "full name of a particular person", .length = 32, .key = 'p' },
 	{ .type = "railway station", .length = 15, .key = 's' },
 	{ .type = "unclassified name", .length = 17, .key = 'u' },
-	{ .type = "work of art, literature, music, etc. name", .length = 31, .key = 'w' },
+	{ .type = "work of art, literature, music, etc. name", .length = 41, .key = 'w' },
 };
 
-int name_type_comparator(const void* key, const void* object)
+static inline int name_type_comparator(char key, const name_type_mapping_t* mapping)
 {
-	int key_char = (int)(size_t)key;
-	const name_type_mapping_t* mapping = object;
-
-	return key_char - (int)mapping->key;
+	return (int)key - (int)mapping->key;
 }
 
+define_binary_locate(locate_name_type, char, name_type_mapping_t, name_type_comparator)
+
 name_type_mapping_t* get_mapped_type(char key)
 {
 	bool found = false;
-	name_type_mapping_t* it = binary_locate(
-		(void*)(size_t)key, map,
-		sizeof(map) / sizeof(name_type_mapping_t), sizeof(name_type_mapping_t),
-		name_type_comparator, &found
+	name_type_mapping_t* it = locate_name_type(
+		key, map,
+		sizeof(map) / sizeof(name_type_mapping_t),
+		&found
 	);
 	assert(found || key == ';');
 	return found ? it : NULL;
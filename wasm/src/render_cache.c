@@ -0,0 +1,198 @@
+#include "render_cache.h"
+
+#include <assert.h>
+
+#include "libc.h"
+
+/*
+ * Hovering over a page hits the same entries again and again, so rendered
+ * dentries (contents of `<td>`) are kept between searches in their own
+ * buffer, which is never cleared by state_clear().
+ *
+ * Buffer is a sequence of records, each followed by key, inflection name
+ * and fragment itself. Lookup is a linear scan, because buffer holds only
+ * dozens of entries. Cache is never modified in the middle of rendering:
+ * when a fragment doesn't fit, cache is flushed before the next search,
+ * so positions found by render_cache_lookup() stay valid until then.
+ */
+
+#define max_fragment_length UINT16_MAX
+
+enum {
+	RENDER_CACHE_NAME = 0x1,
+	RENDER_CACHE_READING_KEY = 0x2,
+	RENDER_CACHE_VALID = 0x4,
+};
+
+typedef struct {
+	uint32_t offset;
+	uint32_t entry_id;
+	uint16_t fragment_length;
+	uint8_t key_length;
+	uint8_t inflection_name_length;
+	uint8_t flags;
+	uint8_t padding[3];
+} render_cache_record_t;
+
+static bool render_cache_overflown = false;
+
+size_t record_size(const render_cache_record_t* record)
+{
+	const size_t size = sizeof(render_cache_record_t)
+		+ record->key_length * sizeof(char16_t)
+		+ record->inflection_name_length
+		+ record->fragment_length;
+	return (size + 3) & ~(size_t)3;
+}
+
+bool bytes_equal(const char* a, const char* b, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		if (a[i] != b[i])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+uint8_t word_result_cache_flags(word_result_t* wr)
+{
+	uint8_t flags = 0;
+	if (word_result_is_name(wr))
+	{
+		flags |= RENDER_CACHE_NAME;
+	}
+	if (word_result_is_reading_key(wr))
+	{
+		flags |= RENDER_CACHE_READING_KEY;
+	}
+	return flags;
+}
+
+bool record_matches(const render_cache_record_t* record, word_result_t* wr, uint8_t flags)
+{
+	const uint8_t mask = RENDER_CACHE_NAME | RENDER_CACHE_READING_KEY | RENDER_CACHE_VALID;
+	if (record->offset != word_result_get_offset(wr)
+		|| (record->flags & mask) != (flags | RENDER_CACHE_VALID)
+		|| record->key_length != word_result_get_key_length(wr)
+		|| record->inflection_name_length != word_result_get_inflection_name_length(wr))
+	{
+		return false;
+	}
+
+	const char* data = (const char*)(record + 1);
+	const size_t key_size = record->key_length * sizeof(char16_t);
+	return bytes_equal(data, (const char*)word_result_get_key(wr), key_size)
+		&& bytes_equal(data + key_size, word_result_get_inflection_name(wr), record->inflection_name_length);
+}
+
+render_cache_record_t* get_record(word_result_t* wr)
+{
+	const uint32_t position = word_result_get_render_cache_position(wr);
+	assert(position != RENDER_CACHE_MISS);
+	return state_get_render_cache_buffer()->data + position;
+}
+
+void render_cache_begin()
+{
+	if (!render_cache_overflown)
+	{
+		return;
+	}
+	render_cache_flush();
+}
+
+void render_cache_flush()
+{
+	render_cache_overflown = false;
+	state_get_render_cache_buffer()->size = 0;
+}
+
+bool render_cache_lookup(word_result_t* wr)
+{
+	buffer_t* b = state_get_render_cache_buffer();
+	const uint8_t flags = word_result_cache_flags(wr);
+
+	size_t position = 0;
+	while (position < b->size)
+	{
+		const render_cache_record_t* record = b->data + position;
+		if (record_matches(record, wr, flags))
+		{
+			word_result_set_render_cache_position(wr, (uint32_t)position);
+			return true;
+		}
+		position += record_size(record);
+	}
+
+	word_result_set_render_cache_position(wr, RENDER_CACHE_MISS);
+	return false;
+}
+
+uint32_t render_cache_get_entry_id(word_result_t* wr)
+{
+	return get_record(wr)->entry_id;
+}
+
+void render_cache_copy(buffer_t* b, word_result_t* wr)
+{
+	const render_cache_record_t* record = get_record(wr);
+	const char* fragment = (const char*)(record + 1)
+		+ record->key_length * sizeof(char16_t)
+		+ record->inflection_name_length;
+	memcpy(buffer_allocate(b, record->fragment_length), fragment, record->fragment_length);
+}
+
+void render_cache_insert(word_result_t* wr, uint32_t entry_id, const char* fragment, size_t length)
+{
+	if (length > max_fragment_length)
+	{
+		return;
+	}
+
+	render_cache_record_t record = {
+		.offset = word_result_get_offset(wr),
+		.entry_id = entry_id,
+		.fragment_length = (uint16_t)length,
+		.key_length = (uint8_t)word_result_get_key_length(wr),
+		.inflection_name_length = (uint8_t)word_result_get_inflection_name_length(wr),
+		.flags = word_result_cache_flags(wr) | RENDER_CACHE_VALID,
+		.padding = {0},
+	};
+	const size_t size = record_size(&record);
+
+	buffer_t* b = state_get_render_cache_buffer();
+	if (b->capacity - b->size < size)
+	{
+		render_cache_overflown = true;
+		return;
+	}
+
+	void* out = buffer_allocate(b, size);
+	memcpy(out, &record, sizeof(render_cache_record_t));
+	out += sizeof(render_cache_record_t);
+
+	const size_t key_size = record.key_length * sizeof(char16_t);
+	memcpy(out, word_result_get_key(wr), key_size);
+	out += key_size;
+	memcpy(out, word_result_get_inflection_name(wr), record.inflection_name_length);
+	out += record.inflection_name_length;
+	memcpy(out, fragment, length);
+}
+
+void render_cache_invalidate(uint32_t entry_id)
+{
+	buffer_t* b = state_get_render_cache_buffer();
+	size_t position = 0;
+	while (position < b->size)
+	{
+		render_cache_record_t* record = b->data + position;
+		if (record->entry_id == entry_id && (record->flags & RENDER_CACHE_NAME) == 0)
+		{
+			record->flags &= ~RENDER_CACHE_VALID;
+		}
+		position += record_size(record);
+	}
+}
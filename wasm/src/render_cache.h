@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "state.h"
+#include "word_results.h"
+
+void render_cache_begin(void);
+
+bool render_cache_lookup(word_result_t* wr);
+
+uint32_t render_cache_get_entry_id(word_result_t* wr);
+void render_cache_copy(buffer_t* b, word_result_t* wr);
+
+void render_cache_insert(word_result_t* wr, uint32_t entry_id, const char* fragment, size_t length);
+
+void render_cache_invalidate(uint32_t entry_id);
+void render_cache_flush(void);
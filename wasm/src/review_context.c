@@ -0,0 +1,229 @@
+#include "review_context.h"
+
+#include <assert.h>
+
+#include "state.h"
+#include "libc.h"
+
+/*
+ * Context sentences of review list entries, so reviewed entries are rendered
+ * without asking JS storage for them.
+ *
+ * Buffer starts with a header and an index of live contexts sorted by entry
+ * id, which grows up. Texts (raw utf-8) are appended from the end of reserved
+ * range down. Replaced and removed texts are abandoned, and once abandoned
+ * bytes outweigh live ones, live texts are compacted through the html buffer,
+ * so memory stays proportional to the live context text.
+ *
+ * When live texts don't fit even after compaction, buffer is enlarged and
+ * texts are moved to its new end. Only contexts longer than
+ * `max_context_length` are dropped: entry stays in the review list and is
+ * rendered without context.
+ */
+
+#define max_context_length (1 << 12)
+
+typedef struct {
+	uint32_t num_contexts;
+	// Relative to review context buffer start
+	uint32_t text_start;
+	uint32_t garbage_size;
+	uint32_t padding;
+} context_header_t;
+
+typedef struct {
+	uint32_t entry_id;
+	uint32_t offset;
+	uint32_t length;
+} context_index_entry_t;
+
+context_header_t* get_context_header(void)
+{
+	buffer_t* b = state_get_review_context_buffer();
+	if (b->size == 0)
+	{
+		context_header_t* header = buffer_allocate(b, sizeof(context_header_t));
+		*header = (context_header_t){
+			.num_contexts = 0,
+			.text_start = (uint32_t)b->capacity,
+			.garbage_size = 0,
+			.padding = 0,
+		};
+	}
+	return b->data;
+}
+
+context_index_entry_t* get_context_index(context_header_t* header)
+{
+	return (context_index_entry_t*)(header + 1);
+}
+
+size_t context_free_space(const context_header_t* header)
+{
+	return header->text_start - sizeof(context_header_t) - header->num_contexts * sizeof(context_index_entry_t);
+}
+
+void update_context_buffer_size(context_header_t* header)
+{
+	// Reported by rikaigu_get_arena_stats(), garbage included
+	buffer_t* b = state_get_review_context_buffer();
+	buffer_set_size(b, b->capacity - context_free_space(header));
+}
+
+static inline int context_cmp(uint32_t key, const context_index_entry_t* entry)
+{
+	return key < entry->entry_id ? -1 : (key > entry->entry_id ? 1 : 0);
+}
+
+define_binary_locate(locate_context, uint32_t, context_index_entry_t, context_cmp)
+
+void compact_contexts(context_header_t* header)
+{
+	buffer_t* b = state_get_review_context_buffer();
+	// Html buffer is free between searches, and whatever it holds
+	// (e.g. text being stored) is left intact
+	buffer_t* scratch = state_get_html_buffer();
+	const size_t scratch_start = scratch->size;
+
+	context_index_entry_t* index = get_context_index(header);
+	for (size_t i = 0; i < header->num_contexts; ++i)
+	{
+		memcpy(buffer_allocate(scratch, index[i].length), b->data + index[i].offset, index[i].length);
+	}
+
+	const size_t live_size = scratch->size - scratch_start;
+	header->text_start = (uint32_t)(b->capacity - live_size);
+	memcpy(b->data + header->text_start, scratch->data + scratch_start, live_size);
+
+	uint32_t offset = header->text_start;
+	for (size_t i = 0; i < header->num_contexts; ++i)
+	{
+		index[i].offset = offset;
+		offset += index[i].length;
+	}
+
+	header->garbage_size = 0;
+	scratch->size = scratch_start;
+}
+
+context_header_t* enlarge_context_buffer(const size_t required)
+{
+	buffer_t* b = state_get_review_context_buffer();
+	const size_t old_capacity = b->capacity;
+	// Whole range is in use, so texts are moved along if buffer is moved
+	b->size = old_capacity;
+	buffer_allocate(b, required);
+
+	context_header_t* header = b->data;
+	const size_t shift = b->capacity - old_capacity;
+	memmove(b->data + header->text_start + shift, b->data + header->text_start, old_capacity - header->text_start);
+	header->text_start += (uint32_t)shift;
+
+	context_index_entry_t* index = get_context_index(header);
+	for (size_t i = 0; i < header->num_contexts; ++i)
+	{
+		index[i].offset += (uint32_t)shift;
+	}
+	return header;
+}
+
+void compact_contexts_if_mostly_garbage(context_header_t* header)
+{
+	const size_t text_size = state_get_review_context_buffer()->capacity - header->text_start;
+	if (header->garbage_size > text_size - header->garbage_size)
+	{
+		compact_contexts(header);
+	}
+}
+
+void remove_context_at(context_header_t* header, context_index_entry_t* it)
+{
+	context_index_entry_t* index = get_context_index(header);
+	header->garbage_size += it->length;
+	memmove(it, it + 1, (size_t)(index + header->num_contexts - it - 1) * sizeof(context_index_entry_t));
+	header->num_contexts -= 1;
+}
+
+// `text` must not point into review context buffer
+bool review_context_store(const uint32_t entry_id, const char* text, const size_t length)
+{
+	context_header_t* header = get_context_header();
+	bool found;
+	context_index_entry_t* it = locate_context(entry_id, get_context_index(header), header->num_contexts, &found);
+	if (found)
+	{
+		remove_context_at(header, it);
+	}
+
+	const size_t required = length + sizeof(context_index_entry_t);
+	const bool stored = length <= max_context_length;
+	if (length > 0 && stored)
+	{
+		// Compaction moves texts only, so `it` stays valid
+		if (context_free_space(header) < required && header->garbage_size > 0)
+		{
+			compact_contexts(header);
+		}
+		if (context_free_space(header) < required)
+		{
+			// But enlargement may move the whole buffer
+			const size_t position = (size_t)(it - get_context_index(header));
+			header = enlarge_context_buffer(required);
+			it = get_context_index(header) + position;
+		}
+
+		buffer_t* b = state_get_review_context_buffer();
+		header->text_start -= (uint32_t)length;
+		memcpy(b->data + header->text_start, text, length);
+
+		context_index_entry_t* index = get_context_index(header);
+		memmove(it + 1, it, (size_t)(index + header->num_contexts - it) * sizeof(context_index_entry_t));
+		*it = (context_index_entry_t){
+			.entry_id = entry_id,
+			.offset = header->text_start,
+			.length = (uint32_t)length,
+		};
+		header->num_contexts += 1;
+	}
+
+	compact_contexts_if_mostly_garbage(header);
+	update_context_buffer_size(header);
+	return stored;
+}
+
+size_t review_context_get(const uint32_t entry_id, const char** text)
+{
+	buffer_t* b = state_get_review_context_buffer();
+	if (b->size == 0)
+	{
+		return 0;
+	}
+
+	context_header_t* header = b->data;
+	bool found;
+	const context_index_entry_t* it = locate_context(entry_id, get_context_index(header), header->num_contexts, &found);
+	if (!found)
+	{
+		return 0;
+	}
+	*text = b->data + it->offset;
+	return it->length;
+}
+
+void review_context_remove(const uint32_t entry_id)
+{
+	if (state_get_review_context_buffer()->size == 0)
+	{
+		return;
+	}
+
+	context_header_t* header = get_context_header();
+	bool found;
+	context_index_entry_t* it = locate_context(entry_id, get_context_index(header), header->num_contexts, &found);
+	if (found)
+	{
+		remove_context_at(header, it);
+		compact_contexts_if_mostly_garbage(header);
+		update_context_buffer_size(header);
+	}
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Replaces stored context, empty text removes it. Returns false,
+// if text is too long to be stored (and stored one is removed)
+bool review_context_store(const uint32_t entry_id, const char* text, const size_t length);
+void review_context_remove(const uint32_t entry_id);
+
+// Returns context length, `text` is valid until the next store or remove
+size_t review_context_get(const uint32_t entry_id, const char** text);
@@ -1,66 +1,454 @@
 #include "review_list.h"
 
+#include <assert.h>
+
 #include "state.h"
 #include "libc.h"
+#include "render_cache.h"
+#include "review_context.h"
+#include "srs.h"
+#include "../generated/config.h"
+
+/*
+ * Review list is a Roaring-style bitmap over `entry_id - MIN_ENTRY_ID`.
+ * High 16 bits select one of containers in a directory at the start of
+ * review list buffer, low 16 bits are stored in the container either as
+ * a sorted array (up to `max_array_cardinality` ids) or as a plain bitmap.
+ * Tens of thousands of ids take at most a few dozen kilobytes, and
+ * membership test is a bit test or a short binary search.
+ *
+ * Container storage is allocated at the end of the buffer. Outgrown
+ * storage is abandoned and reclaimed by compaction, when buffer runs out
+ * of reserved space. If even that isn't enough, buffer is moved elsewhere
+ * (see enlarge_your_buffer()), so containers are addressed by their keys
+ * and are located anew after every allocation.
+ */
+
+#define num_containers 256
+#define container_bits 16
+#define container_range (1 << container_bits)
+#define bitmap_num_words (container_range / 64)
+#define bitmap_size (bitmap_num_words * sizeof(uint64_t))
+#define max_array_cardinality 4096
+#define min_array_capacity 4
+
+typedef enum {
+	CONTAINER_EMPTY = 0,
+	CONTAINER_ARRAY,
+	CONTAINER_BITMAP,
+} container_kind_t;
+
+typedef struct {
+	// Relative to review list buffer start
+	uint32_t offset;
+	uint32_t cardinality;
+	// In ids for arrays
+	uint16_t capacity;
+	uint16_t kind;
+} container_t;
 
-int entry_id_cmp(const void* key, const void* object)
+_Static_assert(sizeof(container_t) * num_containers % sizeof(uint64_t) == 0, "Containers must stay aligned");
+
+// Scratch space for container conversions and bulk import
+static uint64_t import_bitmap[bitmap_num_words];
+
+container_t* get_directory(void)
 {
-	int32_t a = (int32_t)(size_t)key;
-	int32_t b = *(const int32_t*)object;
-	return a - b;
+	buffer_t* b = state_get_review_list_buffer();
+	if (b->size == 0)
+	{
+		memzero(buffer_allocate(b, num_containers * sizeof(container_t)), num_containers * sizeof(container_t));
+	}
+	return b->data;
 }
 
-bool in_review_list(const uint32_t entry_id)
+void* container_data(const container_t* c)
+{
+	return state_get_review_list_buffer()->data + c->offset;
+}
+
+size_t container_storage_size(const container_t* c)
+{
+	switch (c->kind)
+	{
+	case CONTAINER_ARRAY:
+		return c->capacity * sizeof(uint16_t);
+	case CONTAINER_BITMAP:
+		return bitmap_size;
+	default:
+		return 0;
+	}
+}
+
+bool split_entry_id(const uint32_t entry_id, size_t* key, uint16_t* low)
 {
+	if (entry_id < MIN_ENTRY_ID || ((entry_id - MIN_ENTRY_ID) >> container_bits) >= num_containers)
+	{
+		return false;
+	}
+	*key = (entry_id - MIN_ENTRY_ID) >> container_bits;
+	*low = (uint16_t)(entry_id - MIN_ENTRY_ID);
+	return true;
+}
+
+container_t* get_container(const size_t key)
+{
+	return get_directory() + key;
+}
+
+void compact(void)
+{
+	container_t* directory = get_directory();
+	// Slide live containers down in order of their offsets
+	uint8_t order[num_containers];
+	size_t num_live = 0;
+	for (size_t i = 0; i < num_containers; ++i)
+	{
+		if (directory[i].kind == CONTAINER_EMPTY)
+		{
+			continue;
+		}
+		size_t j = num_live;
+		for (; j > 0 && directory[order[j - 1]].offset > directory[i].offset; --j)
+		{
+			order[j] = order[j - 1];
+		}
+		order[j] = (uint8_t)i;
+		num_live += 1;
+	}
+
 	buffer_t* b = state_get_review_list_buffer();
+	size_t end = num_containers * sizeof(container_t);
+	for (size_t i = 0; i < num_live; ++i)
+	{
+		container_t* c = directory + order[i];
+		const size_t size = container_storage_size(c);
+		memmove(b->data + end, container_data(c), size);
+		c->offset = (uint32_t)end;
+		end += size;
+	}
+	b->size = end;
+}
 
-	bool found;
-	binary_locate(
-		(void*)(size_t)entry_id, b->data,
-		b->size / sizeof(int32_t), sizeof(int32_t),
-		entry_id_cmp, &found
-	);
-	return found;
+void* allocate_storage(size_t size)
+{
+	buffer_t* b = state_get_review_list_buffer();
+	if (b->capacity - b->size < size)
+	{
+		compact();
+	}
+	// Buffer grows, if compaction didn't free enough
+	return buffer_allocate(b, size);
+}
+
+void store_array(const size_t key, size_t capacity)
+{
+	container_t* c = get_container(key);
+	if (c->kind == CONTAINER_ARRAY && c->capacity >= capacity)
+	{
+		return;
+	}
+	const size_t old_cardinality = c->kind == CONTAINER_ARRAY ? c->cardinality : 0;
+	// Compaction may move old data, so it's located only after allocation
+	void* data = allocate_storage(capacity * sizeof(uint16_t));
+	c = get_container(key);
+	memcpy(data, container_data(c), old_cardinality * sizeof(uint16_t));
+	c->offset = (uint32_t)(data - state_get_review_list_buffer()->data);
+	c->capacity = (uint16_t)capacity;
+	c->kind = CONTAINER_ARRAY;
+	c->cardinality = (uint32_t)old_cardinality;
+}
+
+static inline int uint16_cmp(uint16_t key, const uint16_t* element)
+{
+	return (int)key - (int)*element;
+}
+
+define_binary_locate(locate_low, uint16_t, uint16_t, uint16_cmp)
+
+void bitmap_from_container(const container_t* c, uint64_t* bitmap)
+{
+	if (c->kind == CONTAINER_BITMAP)
+	{
+		memcpy(bitmap, container_data(c), bitmap_size);
+		return;
+	}
+
+	memzero(bitmap, bitmap_size);
+	if (c->kind == CONTAINER_ARRAY)
+	{
+		const uint16_t* array = container_data(c);
+		for (size_t i = 0; i < c->cardinality; ++i)
+		{
+			bitmap[array[i] / 64] |= (uint64_t)1 << (array[i] % 64);
+		}
+	}
+}
+
+size_t bitmap_cardinality(const uint64_t* bitmap)
+{
+	size_t cardinality = 0;
+	for (size_t i = 0; i < bitmap_num_words; ++i)
+	{
+		cardinality += (size_t)__builtin_popcountll(bitmap[i]);
+	}
+	return cardinality;
+}
+
+// Replaces container contents with given bitmap, picking representation by cardinality
+void container_from_bitmap(const size_t key, const uint64_t* bitmap)
+{
+	const size_t cardinality = bitmap_cardinality(bitmap);
+	container_t* c = get_container(key);
+	if (cardinality == 0)
+	{
+		c->kind = CONTAINER_EMPTY;
+		c->cardinality = 0;
+		return;
+	}
+
+	if (cardinality > max_array_cardinality)
+	{
+		if (c->kind != CONTAINER_BITMAP)
+		{
+			void* data = allocate_storage(bitmap_size);
+			c = get_container(key);
+			c->offset = (uint32_t)(data - state_get_review_list_buffer()->data);
+			c->kind = CONTAINER_BITMAP;
+		}
+		memcpy(container_data(c), bitmap, bitmap_size);
+	}
+	else
+	{
+		if (c->kind != CONTAINER_ARRAY || c->capacity < cardinality)
+		{
+			c->kind = CONTAINER_EMPTY;
+			store_array(key, (cardinality + min_array_capacity - 1) & ~(size_t)(min_array_capacity - 1));
+			c = get_container(key);
+		}
+		uint16_t* array = container_data(c);
+		size_t n = 0;
+		for (size_t i = 0; i < bitmap_num_words; ++i)
+		{
+			for (uint64_t word = bitmap[i]; word != 0; word &= word - 1)
+			{
+				array[n++] = (uint16_t)(i * 64 + (size_t)__builtin_ctzll(word));
+			}
+		}
+	}
+	c->cardinality = (uint32_t)cardinality;
+}
+
+bool in_review_list(const uint32_t entry_id)
+{
+	size_t key;
+	uint16_t low;
+	if (state_get_review_list_buffer()->size == 0 || !split_entry_id(entry_id, &key, &low))
+	{
+		return false;
+	}
+
+	const container_t* c = get_container(key);
+	switch (c->kind)
+	{
+	case CONTAINER_BITMAP:
+		return (((const uint64_t*)container_data(c))[low / 64] >> (low % 64)) & 1;
+	case CONTAINER_ARRAY:
+	{
+		bool found;
+		locate_low(low, container_data(c), c->cardinality, &found);
+		return found;
+	}
+	default:
+		return false;
+	}
 }
 
 export void review_list_add_entry(const uint32_t entry_id)
 {
-	buffer_t* b = state_get_review_list_buffer();
+	size_t key;
+	uint16_t low;
+	if (!split_entry_id(entry_id, &key, &low) || in_review_list(entry_id))
+	{
+		return;
+	}
+	render_cache_invalidate(entry_id);
+	srs_add_card(entry_id);
 
-	bool found;
-	const size_t num_elements = b->size / sizeof(uint32_t);
-	uint32_t* it = binary_locate(
-		(void*)(size_t)entry_id, b->data,
-		num_elements, sizeof(uint32_t),
-		entry_id_cmp, &found
-	);
-	if (found)
+	container_t* c = get_container(key);
+	if (c->kind == CONTAINER_BITMAP)
+	{
+		((uint64_t*)container_data(c))[low / 64] |= (uint64_t)1 << (low % 64);
+		c->cardinality += 1;
+		return;
+	}
+
+	if (c->cardinality == max_array_cardinality)
 	{
+		bitmap_from_container(c, import_bitmap);
+		import_bitmap[low / 64] |= (uint64_t)1 << (low % 64);
+		container_from_bitmap(key, import_bitmap);
 		return;
 	}
 
+	if (c->kind == CONTAINER_EMPTY || c->cardinality == c->capacity)
+	{
+		const size_t capacity = c->kind == CONTAINER_EMPTY ? min_array_capacity : 2 * (size_t)c->capacity;
+		store_array(key, capacity < max_array_cardinality ? capacity : max_array_cardinality);
+		c = get_container(key);
+	}
 
-	buffer_allocate(b, sizeof(uint32_t));
-	memmove(it + 1, it, num_elements - (it - (uint32_t*)b->data));
-	*it = entry_id;
+	uint16_t* array = container_data(c);
+	bool found;
+	uint16_t* it = locate_low(low, array, c->cardinality, &found);
+	memmove(it + 1, it, (size_t)(array + c->cardinality - it) * sizeof(uint16_t));
+	*it = low;
+	c->cardinality += 1;
 }
 
 export void review_list_remove_entry(const uint32_t entry_id)
 {
-	buffer_t* b = state_get_review_list_buffer();
+	size_t key;
+	uint16_t low;
+	if (!split_entry_id(entry_id, &key, &low) || !in_review_list(entry_id))
+	{
+		return;
+	}
+	render_cache_invalidate(entry_id);
+	review_context_remove(entry_id);
+	srs_remove_card(entry_id);
 
-	bool found;
-	const size_t num_elements = b->size / sizeof(uint32_t);
-	uint32_t* it = binary_locate(
-		(void*)(size_t)entry_id, b->data,
-		num_elements, sizeof(uint32_t),
-		entry_id_cmp, &found
-	);
-	if (!found)
+	container_t* c = get_container(key);
+	if (c->kind == CONTAINER_BITMAP)
 	{
+		bitmap_from_container(c, import_bitmap);
+		import_bitmap[low / 64] &= ~((uint64_t)1 << (low % 64));
+		// Converts back to array once small enough
+		container_from_bitmap(key, import_bitmap);
 		return;
 	}
 
-	memmove(it, it + 1, num_elements - (it + 1 - (uint32_t*)b->data));
-	b->size -= sizeof(uint32_t);
+	uint16_t* array = container_data(c);
+	bool found;
+	uint16_t* it = locate_low(low, array, c->cardinality, &found);
+	assert(found);
+	memmove(it, it + 1, (size_t)(array + c->cardinality - it - 1) * sizeof(uint16_t));
+	c->cardinality -= 1;
+	if (c->cardinality == 0)
+	{
+		c->kind = CONTAINER_EMPTY;
+	}
+}
+
+export uint32_t* review_list_import_buffer(const size_t num_entries)
+{
+	// Ids are passed through html buffer, which is free between searches
+	buffer_t* b = state_get_html_buffer();
+	b->size = 0;
+	return buffer_allocate(b, num_entries * sizeof(uint32_t));
+}
+
+export void review_list_import(const size_t num_entries)
+{
+	buffer_t* b = state_get_html_buffer();
+	assert(b->size >= num_entries * sizeof(uint32_t));
+	const uint32_t* entry_ids = b->data;
+
+	uint32_t counts[num_containers] = {0};
+	for (size_t i = 0; i < num_entries; ++i)
+	{
+		size_t key;
+		uint16_t low;
+		if (split_entry_id(entry_ids[i], &key, &low))
+		{
+			counts[key] += 1;
+		}
+	}
+
+	// Every touched container is merged with new ids through a bitmap once
+	for (size_t key = 0; key < num_containers; ++key)
+	{
+		if (counts[key] == 0)
+		{
+			continue;
+		}
+		bitmap_from_container(get_container(key), import_bitmap);
+		for (size_t i = 0; i < num_entries; ++i)
+		{
+			size_t entry_key;
+			uint16_t low;
+			if (split_entry_id(entry_ids[i], &entry_key, &low) && entry_key == key)
+			{
+				import_bitmap[low / 64] |= (uint64_t)1 << (low % 64);
+			}
+		}
+		container_from_bitmap(key, import_bitmap);
+
+		// In ascending order, which is the cheapest for scheduler
+		for (size_t i = 0; i < bitmap_num_words; ++i)
+		{
+			for (uint64_t word = import_bitmap[i]; word != 0; word &= word - 1)
+			{
+				srs_add_card(MIN_ENTRY_ID + (uint32_t)(key << container_bits) + (uint32_t)(i * 64) + (uint32_t)__builtin_ctzll(word));
+			}
+		}
+	}
+
+	render_cache_flush();
+	b->size = 0;
+}
+
+export char* review_list_context_buffer(const size_t num_bytes)
+{
+	// Same as for ids, contexts are passed through html buffer
+	buffer_t* b = state_get_html_buffer();
+	b->size = 0;
+	return buffer_allocate(b, num_bytes);
+}
+
+// Empty context removes stored one. Returns false, if entry isn't
+// in review list or context is too long to be stored
+export bool review_list_set_context(const uint32_t entry_id, const size_t length)
+{
+	buffer_t* b = state_get_html_buffer();
+	assert(b->size >= length);
+	bool stored = false;
+	if (in_review_list(entry_id))
+	{
+		stored = review_context_store(entry_id, b->data, length);
+		render_cache_invalidate(entry_id);
+	}
+	b->size = 0;
+	return stored;
+}
+
+/*
+ * Buffer holds records of `uint32_t entry_id, uint32_t length` followed
+ * by utf-8 text, every record 4-byte aligned. Contexts of entries not in
+ * review list are skipped. Import is fastest with ids in ascending order.
+ * Returns number of contexts too long to be stored.
+ */
+export size_t review_list_import_contexts(const size_t num_bytes)
+{
+	buffer_t* b = state_get_html_buffer();
+	assert(b->size >= num_bytes);
+
+	size_t num_dropped = 0;
+	size_t position = 0;
+	while (position + 2 * sizeof(uint32_t) <= num_bytes)
+	{
+		const uint32_t* record = b->data + position;
+		const uint32_t entry_id = record[0];
+		const uint32_t length = record[1];
+		assert(position + 2 * sizeof(uint32_t) + length <= num_bytes);
+		if (in_review_list(entry_id) && !review_context_store(entry_id, (const char*)(record + 2), length))
+		{
+			num_dropped += 1;
+		}
+		position += (2 * sizeof(uint32_t) + length + 3) & ~(size_t)3;
+	}
+
+	render_cache_flush();
+	b->size = 0;
+	return num_dropped;
 }
@@ -1,4 +1,14 @@
+#include <stddef.h>
 #include <stdbool.h>
 #include <stdint.h>
 
 bool in_review_list(const uint32_t entry_id);
+
+// Bulk import: fill buffer returned by the first function with ids, then call the second one
+uint32_t* review_list_import_buffer(const size_t num_entries);
+void review_list_import(const size_t num_entries);
+
+// Context sentences are passed through buffer returned by review_list_context_buffer()
+char* review_list_context_buffer(const size_t num_bytes);
+bool review_list_set_context(const uint32_t entry_id, const size_t length);
+size_t review_list_import_contexts(const size_t num_bytes);
@@ -0,0 +1,487 @@
+#include "srs.h"
+
+#include <assert.h>
+
+#include "libc.h"
+
+/*
+ * Spaced repetition scheduler over review list entries, SM-2 flavoured.
+ *
+ * Cards are stored as a struct of arrays in srs buffer, so a scan touches
+ * only fields it needs. Cards are kept in a binary min-heap by due time
+ * (ties broken by entry id), which gives the earliest card in O(1) and
+ * reschedules one in O(log n). Entry id to card mapping is a sorted array.
+ * Removed card is replaced by the last one, so arrays stay dense.
+ *
+ * Capacity follows buffer reservation. Once it is full, buffer is enlarged
+ * and arrays are spread over it anew.
+ */
+
+#define minute 60
+#define day (24 * 60 * minute)
+#define relearn_interval (10 * minute)
+#define max_interval (36500u * day)
+#define default_ease 2500
+#define min_ease 1300
+#define ease_step 150
+#define lapse_ease_penalty 200
+
+typedef struct {
+	uint32_t num_cards;
+	uint32_t max_cards;
+} srs_header_t;
+
+typedef struct {
+	uint32_t entry_id;
+	uint32_t card;
+} srs_lookup_entry_t;
+
+typedef struct {
+	srs_header_t* header;
+	// Per card
+	uint32_t* entry_ids;
+	uint32_t* due;
+	// Seconds, zero for new cards
+	uint32_t* intervals;
+	// Permille
+	uint16_t* eases;
+	uint16_t* repetitions;
+	uint32_t* heap_positions;
+	// Per heap slot
+	uint32_t* heap;
+	// Sorted by entry id
+	srs_lookup_entry_t* lookup;
+} srs_cards_t;
+
+#define card_size (6 * sizeof(uint32_t) + 2 * sizeof(uint16_t) + sizeof(srs_lookup_entry_t))
+
+// Layout of srs_import() and srs_write_state() records
+typedef struct {
+	uint32_t entry_id;
+	uint32_t due;
+	uint32_t interval;
+	uint16_t ease;
+	uint16_t repetitions;
+} srs_record_t;
+
+_Static_assert(sizeof(srs_record_t) == 16, "Layout is part of the format");
+
+srs_cards_t get_cards(void)
+{
+	buffer_t* b = state_get_srs_buffer();
+	if (b->size == 0)
+	{
+		srs_header_t* header = buffer_allocate(b, sizeof(srs_header_t));
+		header->num_cards = 0;
+		// Even number of cards keeps every array 4-byte aligned
+		header->max_cards = (uint32_t)((b->capacity - sizeof(srs_header_t)) / card_size) & ~(uint32_t)1;
+		buffer_allocate(b, header->max_cards * card_size);
+	}
+
+	srs_header_t* header = b->data;
+	const size_t n = header->max_cards;
+	srs_cards_t cards;
+	cards.header = header;
+	cards.entry_ids = (uint32_t*)(header + 1);
+	cards.due = cards.entry_ids + n;
+	cards.intervals = cards.due + n;
+	cards.eases = (uint16_t*)(cards.intervals + n);
+	cards.repetitions = cards.eases + n;
+	cards.heap_positions = (uint32_t*)(cards.repetitions + n);
+	cards.heap = cards.heap_positions + n;
+	cards.lookup = (srs_lookup_entry_t*)(cards.heap + n);
+	return cards;
+}
+
+static inline int lookup_cmp(uint32_t key, const srs_lookup_entry_t* entry)
+{
+	return key < entry->entry_id ? -1 : (key > entry->entry_id ? 1 : 0);
+}
+
+define_binary_locate(locate_card, uint32_t, srs_lookup_entry_t, lookup_cmp)
+
+static inline uint64_t heap_key(const srs_cards_t* cards, uint32_t card)
+{
+	return ((uint64_t)cards->due[card] << 32) | cards->entry_ids[card];
+}
+
+static inline void heap_set(srs_cards_t* cards, size_t slot, uint32_t card)
+{
+	cards->heap[slot] = card;
+	cards->heap_positions[card] = (uint32_t)slot;
+}
+
+void heap_sift_up(srs_cards_t* cards, size_t slot)
+{
+	const uint32_t card = cards->heap[slot];
+	const uint64_t key = heap_key(cards, card);
+	while (slot > 0)
+	{
+		const size_t parent = (slot - 1) / 2;
+		if (heap_key(cards, cards->heap[parent]) <= key)
+		{
+			break;
+		}
+		heap_set(cards, slot, cards->heap[parent]);
+		slot = parent;
+	}
+	heap_set(cards, slot, card);
+}
+
+void heap_sift_down(srs_cards_t* cards, size_t slot)
+{
+	const size_t n = cards->header->num_cards;
+	const uint32_t card = cards->heap[slot];
+	const uint64_t key = heap_key(cards, card);
+	for (size_t child = 2 * slot + 1; child < n; child = 2 * slot + 1)
+	{
+		if (child + 1 < n && heap_key(cards, cards->heap[child + 1]) < heap_key(cards, cards->heap[child]))
+		{
+			child += 1;
+		}
+		if (key <= heap_key(cards, cards->heap[child]))
+		{
+			break;
+		}
+		heap_set(cards, slot, cards->heap[child]);
+		slot = child;
+	}
+	heap_set(cards, slot, card);
+}
+
+// Restores heap property after due time of the card changed
+void heap_update(srs_cards_t* cards, uint32_t card)
+{
+	const size_t slot = cards->heap_positions[card];
+	heap_sift_up(cards, slot);
+	heap_sift_down(cards, cards->heap_positions[card]);
+}
+
+srs_cards_t enlarge_cards(void)
+{
+	buffer_t* b = state_get_srs_buffer();
+	const srs_cards_t old = get_cards();
+	const void* const old_data = b->data;
+	const size_t old_max_cards = old.header->max_cards;
+	buffer_allocate(b, b->capacity - b->size + card_size);
+
+	// Buffer may have been moved, so old arrays are found by their offsets
+#define old_array(name) (b->data + ((const void*)old.name - old_data))
+	srs_header_t* header = b->data;
+	header->max_cards = (uint32_t)((b->capacity - sizeof(srs_header_t)) / card_size) & ~(uint32_t)1;
+	buffer_set_size(b, sizeof(srs_header_t) + header->max_cards * card_size);
+	assert(header->max_cards > old_max_cards);
+
+	// Every array but the first one moves up, so the last one is moved first
+	const srs_cards_t cards = get_cards();
+	const size_t n = header->num_cards;
+	memmove(cards.lookup, old_array(lookup), n * sizeof(srs_lookup_entry_t));
+	memmove(cards.heap, old_array(heap), n * sizeof(uint32_t));
+	memmove(cards.heap_positions, old_array(heap_positions), n * sizeof(uint32_t));
+	memmove(cards.repetitions, old_array(repetitions), n * sizeof(uint16_t));
+	memmove(cards.eases, old_array(eases), n * sizeof(uint16_t));
+	memmove(cards.intervals, old_array(intervals), n * sizeof(uint32_t));
+	memmove(cards.due, old_array(due), n * sizeof(uint32_t));
+#undef old_array
+	return cards;
+}
+
+void srs_add_card(const uint32_t entry_id)
+{
+	srs_cards_t cards = get_cards();
+	srs_header_t* header = cards.header;
+	bool found;
+	srs_lookup_entry_t* it = locate_card(entry_id, cards.lookup, header->num_cards, &found);
+	if (found)
+	{
+		return;
+	}
+	if (header->num_cards == header->max_cards)
+	{
+		const size_t position = (size_t)(it - cards.lookup);
+		cards = enlarge_cards();
+		header = cards.header;
+		it = cards.lookup + position;
+	}
+
+	const uint32_t card = header->num_cards;
+	header->num_cards += 1;
+	cards.entry_ids[card] = entry_id;
+	cards.due[card] = 0;
+	cards.intervals[card] = 0;
+	cards.eases[card] = default_ease;
+	cards.repetitions[card] = 0;
+
+	// Ascending ids are appended without moving anything
+	memmove(it + 1, it, (size_t)(cards.lookup + card - it) * sizeof(srs_lookup_entry_t));
+	*it = (srs_lookup_entry_t){ .entry_id = entry_id, .card = card };
+
+	heap_set(&cards, card, card);
+	heap_sift_up(&cards, card);
+}
+
+void srs_remove_card(const uint32_t entry_id)
+{
+	if (state_get_srs_buffer()->size == 0)
+	{
+		return;
+	}
+
+	srs_cards_t cards = get_cards();
+	srs_header_t* header = cards.header;
+	bool found;
+	srs_lookup_entry_t* it = locate_card(entry_id, cards.lookup, header->num_cards, &found);
+	if (!found)
+	{
+		return;
+	}
+	const uint32_t card = it->card;
+	memmove(it, it + 1, (size_t)(cards.lookup + header->num_cards - it - 1) * sizeof(srs_lookup_entry_t));
+
+	// Last heap slot takes place of removed card
+	const size_t slot = cards.heap_positions[card];
+	const uint32_t last_slot_card = cards.heap[header->num_cards - 1];
+	header->num_cards -= 1;
+	if (slot < header->num_cards)
+	{
+		heap_set(&cards, slot, last_slot_card);
+		heap_update(&cards, last_slot_card);
+	}
+
+	// And last card takes its place in arrays
+	const uint32_t last = header->num_cards;
+	if (card != last)
+	{
+		cards.entry_ids[card] = cards.entry_ids[last];
+		cards.due[card] = cards.due[last];
+		cards.intervals[card] = cards.intervals[last];
+		cards.eases[card] = cards.eases[last];
+		cards.repetitions[card] = cards.repetitions[last];
+		heap_set(&cards, cards.heap_positions[last], card);
+
+		srs_lookup_entry_t* moved = locate_card(cards.entry_ids[card], cards.lookup, header->num_cards, &found);
+		assert(found);
+		moved->card = card;
+	}
+}
+
+uint32_t scale_interval(uint32_t interval, uint32_t permille)
+{
+	const uint64_t scaled = (uint64_t)interval * permille / 1000;
+	return scaled < max_interval ? (uint32_t)scaled : max_interval;
+}
+
+void schedule(srs_cards_t* cards, const uint32_t card, const srs_grade_t grade, const uint32_t now)
+{
+	int ease = cards->eases[card];
+	uint32_t interval = cards->intervals[card];
+	if (grade == SRS_AGAIN)
+	{
+		ease -= lapse_ease_penalty;
+		interval = relearn_interval;
+		cards->repetitions[card] = 0;
+	}
+	else
+	{
+		if (cards->repetitions[card] == 0)
+		{
+			interval = grade == SRS_EASY ? 4 * day : day;
+		}
+		else
+		{
+			const uint32_t previous = interval;
+			switch (grade)
+			{
+			case SRS_HARD:
+				interval = scale_interval(interval, 1200);
+				break;
+			case SRS_GOOD:
+				interval = scale_interval(interval, (uint32_t)ease);
+				break;
+			default:
+				interval = scale_interval(scale_interval(interval, (uint32_t)ease), 1300);
+			}
+			// Successful review never shortens interval
+			if (interval < previous + day && previous + day <= max_interval)
+			{
+				interval = previous + day;
+			}
+		}
+
+		if (grade == SRS_HARD)
+		{
+			ease -= ease_step;
+		}
+		else if (grade == SRS_EASY)
+		{
+			ease += ease_step;
+		}
+		if (cards->repetitions[card] < UINT16_MAX)
+		{
+			cards->repetitions[card] += 1;
+		}
+	}
+
+	cards->eases[card] = (uint16_t)(ease < min_ease ? min_ease : ease);
+	cards->intervals[card] = interval;
+	cards->due[card] = now <= UINT32_MAX - interval ? now + interval : UINT32_MAX;
+	heap_update(cards, card);
+}
+
+export uint32_t srs_grade(const uint32_t entry_id, const uint32_t grade, const uint32_t now)
+{
+	if (grade > SRS_EASY || state_get_srs_buffer()->size == 0)
+	{
+		return 0;
+	}
+
+	srs_cards_t cards = get_cards();
+	bool found;
+	const srs_lookup_entry_t* it = locate_card(entry_id, cards.lookup, cards.header->num_cards, &found);
+	if (!found)
+	{
+		return 0;
+	}
+	schedule(&cards, it->card, (srs_grade_t)grade, now);
+	return cards.due[it->card];
+}
+
+/*
+ * Children of a heap slot are never due earlier than the slot itself, so
+ * slots are visited best-first with a small heap of candidate slots, which
+ * holds at most `max_cards + 1` of them. Takes O(max_cards log max_cards).
+ */
+static inline bool candidate_less(const srs_cards_t* cards, uint32_t a, uint32_t b)
+{
+	return heap_key(cards, cards->heap[a]) < heap_key(cards, cards->heap[b]);
+}
+
+void candidates_push(const srs_cards_t* cards, uint32_t* candidates, size_t* n, uint32_t slot)
+{
+	size_t i = (*n)++;
+	for (; i > 0 && candidate_less(cards, slot, candidates[(i - 1) / 2]); i = (i - 1) / 2)
+	{
+		candidates[i] = candidates[(i - 1) / 2];
+	}
+	candidates[i] = slot;
+}
+
+uint32_t candidates_pop(const srs_cards_t* cards, uint32_t* candidates, size_t* n)
+{
+	const uint32_t top = candidates[0];
+	const uint32_t last = candidates[--(*n)];
+	size_t i = 0;
+	for (size_t child = 1; child < *n; child = 2 * i + 1)
+	{
+		if (child + 1 < *n && candidate_less(cards, candidates[child + 1], candidates[child]))
+		{
+			child += 1;
+		}
+		if (!candidate_less(cards, candidates[child], last))
+		{
+			break;
+		}
+		candidates[i] = candidates[child];
+		i = child;
+	}
+	candidates[i] = last;
+	return top;
+}
+
+void srs_write_due(buffer_t* b, const uint32_t now, const size_t max_cards)
+{
+	b->size = 0;
+	if (state_get_srs_buffer()->size == 0)
+	{
+		return;
+	}
+
+	srs_cards_t cards = get_cards();
+	const size_t num_cards = cards.header->num_cards;
+	const size_t limit = max_cards < num_cards ? max_cards : num_cards;
+	uint32_t* out = buffer_allocate(b, (2 * limit + 1) * sizeof(uint32_t));
+	uint32_t* candidates = out + limit;
+
+	size_t num_out = 0;
+	size_t num_candidates = 0;
+	if (limit > 0)
+	{
+		candidates_push(&cards, candidates, &num_candidates, 0);
+	}
+	while (num_out < limit && num_candidates > 0)
+	{
+		const uint32_t slot = candidates_pop(&cards, candidates, &num_candidates);
+		const uint32_t card = cards.heap[slot];
+		if (cards.due[card] > now)
+		{
+			break;
+		}
+		out[num_out++] = cards.entry_ids[card];
+		for (size_t child = 2 * (size_t)slot + 1; child <= 2 * (size_t)slot + 2 && child < num_cards; ++child)
+		{
+			candidates_push(&cards, candidates, &num_candidates, (uint32_t)child);
+		}
+	}
+	b->size = num_out * sizeof(uint32_t);
+}
+
+void srs_write_state(buffer_t* b)
+{
+	b->size = 0;
+	if (state_get_srs_buffer()->size == 0)
+	{
+		return;
+	}
+
+	srs_cards_t cards = get_cards();
+	srs_record_t* out = buffer_allocate(b, cards.header->num_cards * sizeof(srs_record_t));
+	for (size_t card = 0; card < cards.header->num_cards; ++card)
+	{
+		out[card] = (srs_record_t){
+			.entry_id = cards.entry_ids[card],
+			.due = cards.due[card],
+			.interval = cards.intervals[card],
+			.ease = cards.eases[card],
+			.repetitions = cards.repetitions[card],
+		};
+	}
+}
+
+export void* srs_import_buffer(const size_t num_cards)
+{
+	// Records are passed through html buffer, which is free between searches
+	buffer_t* b = state_get_html_buffer();
+	b->size = 0;
+	return buffer_allocate(b, num_cards * sizeof(srs_record_t));
+}
+
+// Records of entries without cards are skipped
+export void srs_import(const size_t num_cards)
+{
+	buffer_t* b = state_get_html_buffer();
+	assert(b->size >= num_cards * sizeof(srs_record_t));
+	const srs_record_t* records = b->data;
+
+	srs_cards_t cards = get_cards();
+	const size_t n = cards.header->num_cards;
+	for (size_t i = 0; i < num_cards; ++i)
+	{
+		bool found;
+		const srs_lookup_entry_t* it = locate_card(records[i].entry_id, cards.lookup, n, &found);
+		if (!found)
+		{
+			continue;
+		}
+		cards.due[it->card] = records[i].due;
+		cards.intervals[it->card] = records[i].interval < max_interval ? records[i].interval : max_interval;
+		cards.eases[it->card] = records[i].ease < min_ease ? min_ease : records[i].ease;
+		cards.repetitions[it->card] = records[i].repetitions;
+	}
+
+	// Heap is rebuilt at once
+	for (size_t slot = n / 2; slot > 0; --slot)
+	{
+		heap_sift_down(&cards, slot - 1);
+	}
+	b->size = 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "state.h"
+
+typedef enum {
+	SRS_AGAIN = 0,
+	SRS_HARD,
+	SRS_GOOD,
+	SRS_EASY,
+} srs_grade_t;
+
+// Cards follow review list: every reviewed entry gets a new card, due immediately
+void srs_add_card(const uint32_t entry_id);
+void srs_remove_card(const uint32_t entry_id);
+
+// Returns new due time or 0, when entry has no card. Times are in seconds.
+uint32_t srs_grade(const uint32_t entry_id, const uint32_t grade, const uint32_t now);
+
+// Writes ids of at most `max_cards` entries due at `now`, earliest first
+void srs_write_due(buffer_t* b, const uint32_t now, const size_t max_cards);
+
+// Writes state of every card, see srs_import() for the layout
+void srs_write_state(buffer_t* b);
+
+// Restores state written by srs_write_state(): fill buffer returned by the
+// first function with records, then call the second one
+void* srs_import_buffer(const size_t num_cards);
+void srs_import(const size_t num_cards);
@@ -10,44 +10,72 @@
 
 typedef enum {
 	REVIEW_LIST_BUFFER,
+	RENDER_CACHE_BUFFER,
 	CANDIDATE_BUFFER,
 	INDEX_ENTRY_BUFFER,
 	WORD_RESULT_BUFFER,
 	RAW_DENTRY_BUFFER,
 	DENTRY_BUFFER,
+	REVIEW_CONTEXT_BUFFER,
+	SRS_BUFFER,
+	CHUNK_CACHE_BUFFER,
 	HTML_BUFFER,
 
 	NUM_BUFFER_TOKENS,
 } BUFFER_TOKENS;
 
-const size_t initial_sizes[NUM_BUFFER_TOKENS] = {1<<10, 1<<10, 1<<12, 1<<12, 1<<14, 1<<14, 1<<16};
+// Saved arena profiles (see rikaigu_get_arena_stats()) list peak sizes by
+// buffer index, so they are kept only for the same layout version. Bump
+// it whenever buffers are added, removed or reordered
+#define ARENA_LAYOUT_VERSION 1
+static_assert(NUM_BUFFER_TOKENS == 11, "Bump ARENA_LAYOUT_VERSION");
+
+// Every buffer but the last one gets its own fixed range of memory, so
+// buffers may freely reference each other. Unused pages of wasm memory aren't
+// backed by physical memory until touched, so generous reservations cost only
+// address space. HTML buffer takes the rest of memory. Buffer at the end of
+// memory grows in place, any other one outgrowing its range is copied to the
+// end (see enlarge_your_buffer()).
+size_t reserved_sizes[NUM_BUFFER_TOKENS] = {1<<19, 1<<18, 1<<16, 1<<18, 1<<16, 1<<20, 1<<20, 1<<20, 1<<21, 1<<18, 1<<16};
 
 typedef struct {
 	input_t input;
-	// NOTE if buffer `i` cross-references buffer `j` (which may be equal `i`),
-	// all buffers < `j` mustn't grow
-	// Now we have two cross-references:
-	// 1. DENTRY -> RAW_DENTRY (at point of referencing all previous buffers are frozen)
-	// 2. WORD_RESULT -> DENTY (the same)
 	buffer_t buffers[NUM_BUFFER_TOKENS];
 } state_t;
 
 state_t* state = NULL;
+// Relocated buffers are placed here
+void* memory_end = NULL;
+
+static struct {
+	size_t num_buffers;
+	buffer_stats_t buffers[NUM_BUFFER_TOKENS];
+} arena_stats = { .num_buffers = NUM_BUFFER_TOKENS };
+
+buffer_stats_t* get_buffer_stats(const buffer_t* buffer)
+{
+	// Tests allocate from standalone buffers as well
+	if (state == NULL || buffer < state->buffers || buffer >= state->buffers + NUM_BUFFER_TOKENS)
+	{
+		return NULL;
+	}
+	return &arena_stats.buffers[buffer - state->buffers];
+}
 
 void split_memory_into_buffers(void* start, size_t capacity_left)
 {
 	capacity_left -= 8 - ((size_t)start % 8);
 	start += 8 - ((size_t)start % 8);
 
-	static_assert(NUM_BUFFER_TOKENS == 7, "Update split_memory_into_buffers()");
+	static_assert(NUM_BUFFER_TOKENS == 11, "Update split_memory_into_buffers()");
 	for (size_t i = 0; i < NUM_BUFFER_TOKENS - 1; ++i)
 	{
-		state->buffers[i].capacity = initial_sizes[i];
+		state->buffers[i].capacity = reserved_sizes[i];
 		state->buffers[i].size = 0;
 		state->buffers[i].data = start;
 
-		capacity_left -= initial_sizes[i];
-		start += initial_sizes[i];
+		capacity_left -= reserved_sizes[i];
+		start += reserved_sizes[i];
 	}
 
 	static_assert(HTML_BUFFER == NUM_BUFFER_TOKENS - 1, "wut");
@@ -59,10 +87,10 @@ void split_memory_into_buffers(void* start, size_t capacity_left)
 #define PAGE_SIZE_BYTES (1<<16)
 void init(size_t heap_base, size_t free_size)
 {
-	size_t required_size = sizeof(state_t);
+	size_t required_size = sizeof(state_t) + 8;
 	for (size_t i = 0; i < NUM_BUFFER_TOKENS; ++i)
 	{
-		required_size += initial_sizes[i];
+		required_size += reserved_sizes[i];
 	}
 	if (free_size < required_size)
 	{
@@ -76,7 +104,9 @@ void init(size_t heap_base, size_t free_size)
 		free_size += diff_pages * PAGE_SIZE_BYTES;
 	}
 	state = (state_t*)heap_base;
+	memzero(arena_stats.buffers, sizeof(arena_stats.buffers));
 
+	memory_end = (void*)heap_base + free_size;
 	split_memory_into_buffers(state + 1, free_size - sizeof(state_t));
 }
 
@@ -88,24 +118,41 @@ void enlarge_your_buffer(buffer_t* buffer, size_t required_place_bytes)
 		take_a_trip("huge allocation asked");
 	}
 
-	const size_t buffer_index = buffer - state->buffers;
 	// NOTE not effective when allocationg ~PAGE_SIZE_BYTES - 1, but we won't have such huge allocations
 	size_t diff_pages = (buffer->capacity > required_place_bytes ? buffer->capacity : required_place_bytes) / PAGE_SIZE_BYTES + 1;
+	const bool in_place = buffer->data + buffer->capacity == memory_end;
+	if (!in_place)
+	{
+		diff_pages += buffer->capacity / PAGE_SIZE_BYTES + 1;
+	}
 	const size_t old_num_pages = __builtin_wasm_memory_grow(0, diff_pages);
 	if (old_num_pages == (size_t)-1)
 	{
 		take_a_trip("Can't grow memory");
 	}
 
-	const size_t offset = diff_pages * PAGE_SIZE_BYTES;
-	for (size_t i = NUM_BUFFER_TOKENS - 1; i > buffer_index; --i)
+	void* const new_pages = memory_end;
+	memory_end += diff_pages * PAGE_SIZE_BYTES;
+	if (in_place)
 	{
-		buffer_t* moved_buffer = &state->buffers[i];
-		memcpy_backward(moved_buffer->data + offset, moved_buffer->data, moved_buffer->size);
-		moved_buffer->data = moved_buffer->data + offset;
+		buffer->capacity += diff_pages * PAGE_SIZE_BYTES;
+	}
+	else
+	{
+		// Old range is abandoned, not reused, so pointers into it stay
+		// valid (e.g. dentries point into raw dentry buffer), but don't see
+		// later writes. Users of buffer locate its data anew after allocations
+		memcpy(new_pages, buffer->data, buffer->size);
+		buffer->data = new_pages;
+		buffer->capacity = diff_pages * PAGE_SIZE_BYTES;
 	}
 
-	buffer->capacity += offset;
+	buffer_stats_t* stats = get_buffer_stats(buffer);
+	if (stats != NULL)
+	{
+		stats->num_enlargements += 1;
+		stats->enlarged_bytes += diff_pages * PAGE_SIZE_BYTES;
+	}
 }
 
 void* buffer_allocate(buffer_t* buffer, size_t num_bytes)
@@ -120,10 +167,55 @@ void* buffer_allocate(buffer_t* buffer, size_t num_bytes)
 		enlarge_your_buffer(buffer, num_bytes - (buffer->capacity - buffer->size));
 	}
 	void* res = buffer->data + buffer->size;
-	buffer->size += num_bytes;
+	buffer_set_size(buffer, buffer->size + num_bytes);
 	return res;
 }
 
+void buffer_set_size(buffer_t* buffer, size_t size)
+{
+	assert(size <= buffer->capacity);
+	buffer->size = size;
+
+	buffer_stats_t* stats = get_buffer_stats(buffer);
+	if (stats != NULL && buffer->size > stats->peak_size)
+	{
+		stats->peak_size = buffer->size;
+	}
+}
+
+// Lets reservations recorded by previous runs (see rikaigu_get_arena_stats())
+// be applied before initialization. Buffers are never shrunk below defaults,
+// because running out of reservation moves buffer and wastes its old range.
+export void rikaigu_set_reserved_size(uint32_t buffer_index, uint32_t num_bytes)
+{
+	if (state != NULL || buffer_index >= NUM_BUFFER_TOKENS)
+	{
+		take_a_trip("can't change reservations now");
+	}
+
+	const size_t aligned = ((size_t)num_bytes + 7) & ~(size_t)7;
+	if (aligned > reserved_sizes[buffer_index])
+	{
+		reserved_sizes[buffer_index] = aligned;
+	}
+}
+
+export arena_stats_t* rikaigu_get_arena_stats()
+{
+	for (size_t i = 0; i < NUM_BUFFER_TOKENS; ++i)
+	{
+		// Nothing is allocated before initialization
+		arena_stats.buffers[i].capacity = state != NULL ? state->buffers[i].capacity : 0;
+		arena_stats.buffers[i].size = state != NULL ? state->buffers[i].size : 0;
+	}
+	return (arena_stats_t*)&arena_stats;
+}
+
+export uint32_t rikaigu_get_arena_layout_version()
+{
+	return ARENA_LAYOUT_VERSION;
+}
+
 export void* rikaigu_set_config(uint32_t heap_base, uint32_t current_memory_size)
 {
 	if (state == NULL)
@@ -141,7 +233,8 @@ input_t* state_get_input()
 
 void state_clear()
 {
-	// REVIEW_LIST_BUFFER does not reset
+	// REVIEW_LIST_BUFFER, RENDER_CACHE_BUFFER, REVIEW_CONTEXT_BUFFER, SRS_BUFFER
+	// and CHUNK_CACHE_BUFFER do not reset
 	state->buffers[CANDIDATE_BUFFER].size = 0;
 	state->buffers[INDEX_ENTRY_BUFFER].size = 0;
 	state->buffers[WORD_RESULT_BUFFER].size = 0;
@@ -155,6 +248,11 @@ buffer_t* state_get_review_list_buffer()
 	return &state->buffers[REVIEW_LIST_BUFFER];
 }
 
+buffer_t* state_get_render_cache_buffer()
+{
+	return &state->buffers[RENDER_CACHE_BUFFER];
+}
+
 buffer_t* state_get_candidate_buffer()
 {
 	return &state->buffers[CANDIDATE_BUFFER];
@@ -180,6 +278,21 @@ buffer_t* state_get_dentry_buffer()
 	return &state->buffers[DENTRY_BUFFER];
 }
 
+buffer_t* state_get_review_context_buffer()
+{
+	return &state->buffers[REVIEW_CONTEXT_BUFFER];
+}
+
+buffer_t* state_get_srs_buffer()
+{
+	return &state->buffers[SRS_BUFFER];
+}
+
+buffer_t* state_get_chunk_cache_buffer()
+{
+	return &state->buffers[CHUNK_CACHE_BUFFER];
+}
+
 buffer_t* state_get_html_buffer()
 {
 	return &state->buffers[HTML_BUFFER];
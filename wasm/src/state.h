@@ -29,16 +29,40 @@ typedef struct {
 	void* data;
 } buffer_t;
 
+typedef struct {
+	size_t capacity;
+	size_t size;
+	size_t peak_size;
+	size_t num_enlargements;
+	size_t enlarged_bytes;
+} buffer_stats_t;
+
+// Buffers are listed in order of state.c BUFFER_TOKENS
+typedef struct {
+	size_t num_buffers;
+	buffer_stats_t buffers[];
+} arena_stats_t;
+
 input_t* state_get_input(void);
 
 void* buffer_allocate(buffer_t* buffer, size_t num_bytes);
+// For buffers managing their space themselves. Size counts towards
+// peak size, like allocated one
+void buffer_set_size(buffer_t* buffer, size_t size);
 
 void state_clear(void);
 
+arena_stats_t* rikaigu_get_arena_stats(void);
+uint32_t rikaigu_get_arena_layout_version(void);
+
 buffer_t* state_get_review_list_buffer(void);
+buffer_t* state_get_render_cache_buffer(void);
 buffer_t* state_get_candidate_buffer(void);
 buffer_t* state_get_index_entry_buffer(void);
 buffer_t* state_get_word_result_buffer(void);
 buffer_t* state_get_raw_dentry_buffer(void);
 buffer_t* state_get_dentry_buffer(void);
+buffer_t* state_get_review_context_buffer(void);
+buffer_t* state_get_srs_buffer(void);
+buffer_t* state_get_chunk_cache_buffer(void);
 buffer_t* state_get_html_buffer(void);
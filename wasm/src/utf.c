@@ -1,8 +1,11 @@
 #include "utf.h"
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <assert.h>
 
+#include "vector.h"
+
 wchar_t decode_utf16_wchar(const char16_t** pText)
 {
 	const char16_t* text = *pText;
@@ -23,11 +26,56 @@ wchar_t decode_utf16_wchar(const char16_t** pText)
 	}
 }
 
+size_t utf16_common_prefix_length(const char16_t* a, const char16_t* b, const size_t length)
+{
+	size_t i = 0;
+#if defined(HAVE_VECTORS)
+	for (; i + 8 <= length; i += 8)
+	{
+		const u64x2_t diff = *(const u64x2_t*)(a + i) ^ *(const u64x2_t*)(b + i);
+		if ((diff[0] | diff[1]) != 0)
+		{
+			break;
+		}
+	}
+#endif
+	while (i < length && a[i] == b[i])
+	{
+		i += 1;
+	}
+	return i;
+}
+
+static inline bool is_surrogate(const char16_t c)
+{
+	return (c & 0xF800) == 0xD800;
+}
+
 int utf16_compare(const char16_t* a, const size_t alen, const char16_t* b, const size_t blen)
 {
-	const char16_t* ait = a;
+	/*
+	 * Equal code units are equal code points, so common prefix is skipped
+	 * without decoding. For BMP characters at the first difference
+	 * code unit order is code point order. Otherwise decoding restarts
+	 * from the code point containing the difference.
+	 */
+	size_t start = utf16_common_prefix_length(a, b, alen < blen ? alen : blen);
+	if (start == alen || start == blen)
+	{
+		return (int)alen - (int)blen;
+	}
+	if (!is_surrogate(a[start]) && !is_surrogate(b[start]))
+	{
+		return a[start] < b[start] ? -1 : 1;
+	}
+	if (start > 0 && (a[start - 1] & 0xFC00) == 0xD800)
+	{
+		start -= 1;
+	}
+
+	const char16_t* ait = a + start;
 	const char16_t* const aend = a + alen;
-	const char16_t* bit = b;
+	const char16_t* bit = b + start;
 	const char16_t* const bend = b + blen;
 	while (ait != aend && bit != bend)
 	{
@@ -207,29 +255,82 @@ uint32_t kata_to_hira_character(const char16_t c, const char16_t previous)
 	return c;
 }
 
-void input_kata_to_hira(input_t* input)
+static inline void kata_to_hira_one(
+	char16_t* data, const size_t i,
+	size_t* out_length, uint32_t* length_mapping, char16_t* previous
+	)
 {
-	size_t previous = 0;
+	uint32_t converted = kata_to_hira_character(data[i], *previous);
+	if ((converted & replace_flag) != 0)
+	{
+		assert(*out_length > 0);
+		data[*out_length - 1] = (converted & 0xFFFF);
+		length_mapping[*out_length] = i + 1;
+	}
+	else
+	{
+		data[*out_length] = (char16_t)converted;
+		length_mapping[*out_length + 1] = i + 1;
+		*out_length += 1;
+	}
+	*previous = (char16_t)converted;
+}
 
+size_t utf16_kata_to_hira(char16_t* data, const size_t length, uint32_t* length_mapping)
+{
+	char16_t previous = 0;
 	size_t out_length = 0;
-	for (size_t i = 0; i < input->length; ++i)
+	length_mapping[0] = 0;
+
+	size_t i = 0;
+#if defined(HAVE_VECTORS)
+	/*
+	 * Only full-width katakana block is converted with vectors. Chunks
+	 * containing long vowel marks or half-width katakana (conversion
+	 * depends on previous character or merges characters) go through
+	 * scalar path.
+	 */
+	for (; i + 8 <= length; i += 8)
 	{
-		uint32_t converted = kata_to_hira_character(input->data[i], previous);
-		if ((converted & replace_flag) != 0)
+		const u16x8_t c = *(const u16x8_t*)(data + i);
+		const i16x8_t needs_context = (c == u'ー') | ((c >= u'ｦ') & (c <= u'ﾟ'));
+		const u64x2_t any = (u64x2_t)needs_context;
+		if ((any[0] | any[1]) != 0)
 		{
-			assert(out_length > 0);
-			input->data[out_length - 1] = (converted & 0xFFFF);
-			input->length_mapping[out_length] = i + 1;
+			for (size_t j = i; j < i + 8; ++j)
+			{
+				kata_to_hira_one(data, j, &out_length, length_mapping, &previous);
+			}
+			continue;
 		}
-		else
+
+		const i16x8_t is_katakana = (c >= u'ァ') & (c <= u'ヶ');
+		const u16x8_t converted = c - ((u16x8_t)is_katakana & (u'ァ' - u'ぁ'));
+		*(u16x8_t*)(data + out_length) = converted;
+		for (size_t j = 0; j < 8; ++j)
 		{
-			input->data[out_length] = (char16_t)converted;
-			input->length_mapping[out_length + 1] = i + 1;
-			out_length += 1;
+			length_mapping[out_length + j + 1] = i + j + 1;
 		}
-		previous = converted;
+		out_length += 8;
+		previous = converted[7];
+	}
+#endif
+	for (; i < length; ++i)
+	{
+		kata_to_hira_one(data, i, &out_length, length_mapping, &previous);
+	}
+	return out_length;
+}
+
+void input_kata_to_hira(input_t* input)
+{
+	uint32_t length_mapping[sizeof(input->data) / sizeof(char16_t) + 1];
+	const size_t length = utf16_kata_to_hira(input->data, input->length, length_mapping);
+	for (size_t i = 0; i <= length && i < sizeof(input->length_mapping); ++i)
+	{
+		input->length_mapping[i] = (uint8_t)length_mapping[i];
 	}
-	input->length = out_length;
+	input->length = (uint8_t)length;
 }
 
 wchar_t decode_utf8_wchar(const char** pUtf8)
@@ -5,10 +5,20 @@
 
 wchar_t decode_utf16_wchar(const char16_t** pText);
 
+size_t utf16_common_prefix_length(const char16_t* a, const char16_t* b, const size_t length);
+
 int utf16_compare(const char16_t* a, const size_t alen, const char16_t* b, const size_t blen);
 
 size_t utf16_drop_code_point(const char16_t* data, size_t pos);
 
+/*
+ * Converts katakana (full and half-width) to hiragana in place.
+ * `length_mapping` (length + 1 entries) receives for every prefix of
+ * converted text the length of source text it came from.
+ * Returns converted length.
+ */
+size_t utf16_kata_to_hira(char16_t* data, const size_t length, uint32_t* length_mapping);
+
 void input_kata_to_hira(input_t* input);
 
 bool utf16_utf8_kata_to_hira_eq(
@@ -82,6 +82,8 @@ void* vardata_array_enlarge(buffer_t* b, vardata_array_t* array, const size_t ad
 {
 	const size_t elements_array_diff_size = additional_elements * array->header.element_size;
 	void* current_vardata_end = buffer_allocate(b, elements_array_diff_size + additional_vardata_size);
+	// Buffer may have been moved by allocation
+	array = b->data;
 	void* current_vardata_start = vardata_array_vardata_start(b);
 	void* new_vardata_start = current_vardata_start + elements_array_diff_size;
 	memmove(new_vardata_start, current_vardata_start, current_vardata_end - current_vardata_start);
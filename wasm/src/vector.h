@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * 128-bit vectors through compiler vector extensions: lowered to simd128
+ * in wasm and to SSE2/NEON in native builds. Elsewhere they would be
+ * split into scalar operations, so code uses them only under HAVE_VECTORS
+ * and keeps a scalar path.
+ *
+ * Types are unaligned and may alias anything, so any pointer into
+ * buffers can be cast to them.
+ */
+#if defined(__wasm_simd128__) || defined(__SSE2__) || defined(__ARM_NEON)
+#define HAVE_VECTORS
+#endif
+
+typedef uint8_t u8x16_t __attribute__((__vector_size__(16), __aligned__(1), __may_alias__));
+typedef uint16_t u16x8_t __attribute__((__vector_size__(16), __aligned__(1), __may_alias__));
+typedef int16_t i16x8_t __attribute__((__vector_size__(16), __aligned__(1), __may_alias__));
+typedef uint64_t u64x2_t __attribute__((__vector_size__(16), __aligned__(1), __may_alias__));
@@ -10,6 +10,8 @@
 
 typedef struct word_result {
 	uint32_t offset;
+	// Breaks ties of sort_cmp(), JMdict order of entries
+	uint32_t rank;
 
 	size_t vardata_start_offset;
 	uint8_t key_length;
@@ -19,6 +21,7 @@ typedef struct word_result {
 	bool is_name;
 
 	dentry_t* dentry;
+	uint32_t render_cache_position;
 } word_result_t;
 
 size_t word_result_copy_new_data(
@@ -35,11 +38,8 @@ size_t word_result_copy_new_data(
 	return new_element_vardata_start - vardata_array_vardata_start(b);
 }
 
-int uniq_dentry_cmp(const void* key, const void* object)
+static inline int uniq_dentry_cmp(const word_result_t* a, const word_result_t* b)
 {
-	const word_result_t* a = key;
-	const word_result_t* b = object;
-
 	if (a->is_name != b->is_name)
 	{
 		return (int)a->is_name - (int)b->is_name;
@@ -47,6 +47,8 @@ int uniq_dentry_cmp(const void* key, const void* object)
 	return (int)a->offset - (int)b->offset;
 }
 
+define_binary_locate(locate_uniq_dentry, const word_result_t*, word_result_t, uniq_dentry_cmp)
+
 bool state_try_add_word_result(
 	Dictionary d, const size_t input_length,
 	const char16_t* word, const size_t word_length,
@@ -63,26 +65,30 @@ bool state_try_add_word_result(
 	const size_t num_elements = vardata_array_num_elements(b);
 	word_result_t new_wr = {
 		.offset = offset,
+		.rank = offset,
 		.match_utf16_length = input_length,
 		.is_name = d == NAMES,
 		.key_length = word_length,
 		.inflection_name_length = inflection_name_length,
 		.vardata_start_offset = 0,
 		.dentry = NULL,
+		.render_cache_position = RENDER_CACHE_MISS,
 	};
 	bool found;
-	word_result_t* it = binary_locate(
+	word_result_t* it = locate_uniq_dentry(
 		&new_wr, array,
-		num_elements, sizeof(word_result_t),
-		uniq_dentry_cmp, &found
+		num_elements,
+		&found
 	);
 	if (found)
 	{
 		return false;
 	}
 
-	new_wr.vardata_start_offset = word_result_copy_new_data(b, word, word_length, inflection_name, inflection_name_length);
 	const size_t index = it - array;
+	new_wr.vardata_start_offset = word_result_copy_new_data(b, word, word_length, inflection_name, inflection_name_length);
+	// Buffer may have been moved by copying
+	it = (word_result_t*)vardata_array_elements_start(b) + index;
 	vardata_array_increment_size(b);
 	memmove(it + 1, it, (num_elements - index) * sizeof(word_result_t));
 	memcpy(it, &new_wr, sizeof(word_result_t));
@@ -90,11 +96,36 @@ bool state_try_add_word_result(
 	return true;
 }
 
-int sort_cmp(const void* key, const void* object)
+void state_append_word_result(
+	Dictionary d, const size_t input_length,
+	const char16_t* word, const size_t word_length,
+	const uint32_t offset)
 {
-       const word_result_t* a = key;
-       const word_result_t* b = object;
+	buffer_t* b = state_get_word_result_buffer();
+	if (b->size == 0)
+	{
+		vardata_array_make(b, sizeof(word_result_t));
+	}
 
+	word_result_t new_wr = {
+		.offset = offset,
+		.rank = offset,
+		.match_utf16_length = input_length,
+		.is_name = d == NAMES,
+		.key_length = word_length,
+		.inflection_name_length = 0,
+		.vardata_start_offset = word_result_copy_new_data(b, word, word_length, "", 0),
+		.dentry = NULL,
+		.render_cache_position = RENDER_CACHE_MISS,
+	};
+	word_result_t* array = vardata_array_elements_start(b);
+	const size_t num_elements = vardata_array_num_elements(b);
+	vardata_array_increment_size(b);
+	memcpy(array + num_elements, &new_wr, sizeof(word_result_t));
+}
+
+static inline int sort_cmp(const word_result_t* a, const word_result_t* b)
+{
        if (a->match_utf16_length != b->match_utf16_length)
        {
                return -((int)a->match_utf16_length - (int)b->match_utf16_length);
@@ -103,18 +134,19 @@ int sort_cmp(const void* key, const void* object)
        {
                return (int)a->is_name - (int)b->is_name;
        }
-       return -((int)a->inflection_name_length - (int)b->inflection_name_length);
+       if (a->inflection_name_length != b->inflection_name_length)
+       {
+               return -((int)a->inflection_name_length - (int)b->inflection_name_length);
+       }
+       return a->rank < b->rank ? -1 : (a->rank > b->rank ? 1 : 0);
 }
 
+// Upper bound keeps equal results in the order they were found
+define_upper_bound(locate_sorted_upper_bound, const word_result_t*, word_result_t, sort_cmp)
+
 size_t locate_sorted(word_result_t* array, const size_t i)
 {
-       bool found;
-       word_result_t* it = binary_locate(
-               array + i, array,
-               i, sizeof(word_result_t),
-               sort_cmp, &found
-       );
-       return it - array;
+       return locate_sorted_upper_bound(array + i, array, i) - array;
 }
 
 void sort_results(word_result_t* array, const size_t num_elements)
@@ -153,8 +185,7 @@ void word_result_set_dentry(word_result_t* wr, dentry_t* dentry)
 {
 	wr->dentry = dentry;
 
-	const input_t* input = state_get_input();
-	const bool reading_key = is_hiragana(input->data, wr->match_utf16_length);
+	const bool reading_key = word_result_is_reading_key(wr);
 	if (wr->is_name && reading_key)
 	{
 		dentry_drop_kanji_groups(dentry);
@@ -162,9 +193,7 @@ void word_result_set_dentry(word_result_t* wr, dentry_t* dentry)
 
 	dentry_parse(dentry);
 
-	buffer_t* b = state_get_word_result_buffer();
-	const void* const vardata_start = vardata_array_vardata_start(b);
-	const char16_t* key = vardata_start + wr->vardata_start_offset;
+	const char16_t* key = word_result_get_key(wr);
 	if (reading_key)
 	{
 		dentry_filter_readings(dentry, key, wr->key_length);
@@ -194,6 +223,11 @@ void word_result_iterator_next(word_result_iterator_t* it)
 	it->current += 1;
 }
 
+void word_result_set_rank(word_result_t* wr, uint32_t rank)
+{
+	wr->rank = rank;
+}
+
 uint32_t word_result_get_offset(word_result_t* wr)
 {
 	return wr->offset;
@@ -209,6 +243,23 @@ bool word_result_is_name(word_result_t* wr)
 	return wr->is_name;
 }
 
+const char16_t* word_result_get_key(word_result_t* wr)
+{
+	buffer_t* b = state_get_word_result_buffer();
+	return vardata_array_vardata_start(b) + wr->vardata_start_offset;
+}
+
+size_t word_result_get_key_length(word_result_t* wr)
+{
+	return wr->key_length;
+}
+
+bool word_result_is_reading_key(word_result_t* wr)
+{
+	const input_t* input = state_get_input();
+	return is_hiragana(input->data, wr->match_utf16_length);
+}
+
 size_t word_result_get_inflection_name_length(word_result_t* wr)
 {
 	return wr->inflection_name_length;
@@ -228,3 +279,13 @@ dentry_t* word_result_get_dentry(word_result_t* wr)
 {
 	return wr->dentry;
 }
+
+void word_result_set_render_cache_position(word_result_t* wr, uint32_t position)
+{
+	wr->render_cache_position = position;
+}
+
+uint32_t word_result_get_render_cache_position(word_result_t* wr)
+{
+	return wr->render_cache_position;
+}
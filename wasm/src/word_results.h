@@ -11,6 +11,13 @@ bool state_try_add_word_result(
 	const char* inflection_name, const size_t inflection_name_length,
 	const uint32_t offset);
 
+// Appends result keeping insertion order. Results are no longer sorted by
+// offset, so it must not be mixed with state_try_add_word_result()
+void state_append_word_result(
+	Dictionary d, const size_t input_length,
+	const char16_t* word, const size_t word_length,
+	const uint32_t offset);
+
 size_t state_sort_and_limit_word_results(void);
 
 typedef struct word_result_iterator {
@@ -23,16 +30,29 @@ word_result_iterator_t state_get_word_result_iterator(void);
 void word_result_iterator_next(word_result_iterator_t* it);
 
 
+// Rank is dictionary offset, unless set. Results ordered equally
+// otherwise are sorted by it
+void word_result_set_rank(word_result_t* wr, uint32_t rank);
+
 uint32_t word_result_get_offset(word_result_t* wr);
 
 size_t word_result_get_match_length(word_result_t* wr);
 
 bool word_result_is_name(word_result_t* wr);
 
+const char16_t* word_result_get_key(word_result_t* wr);
+size_t word_result_get_key_length(word_result_t* wr);
+// Whether dentry is filtered by readings rather than kanjis
+bool word_result_is_reading_key(word_result_t* wr);
+
 size_t word_result_get_inflection_name_length(word_result_t* wr);
 char* word_result_get_inflection_name(word_result_t* wr);
 
 void word_result_set_dentry(word_result_t* wr, dentry_t* dentry);
 dentry_t* word_result_get_dentry(word_result_t* wr);
 
+#define RENDER_CACHE_MISS UINT32_MAX
+void word_result_set_render_cache_position(word_result_t* wr, uint32_t position);
+uint32_t word_result_get_render_cache_position(word_result_t* wr);
+
 
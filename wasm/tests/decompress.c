@@ -1,44 +1,178 @@
+#include <string.h>
+
 #include "fake-memory.h"
 
+#include "../src/state.c"
+#include "../src/libc.c"
+#include "../src/utf.c"
 #include "../src/decompress.c"
 #include "../generated/index.test.c"
 
 compressed_file_t test_index = {
+	.chunk_size = test_dictionary_index_chunk_size,
 	.last_chunk_index = test_dictionary_index_last_chunk_index,
 	.last_chunk_size = test_dictionary_index_last_chunk_size,
 	.original_size = test_dictionary_index_original_size,
 	.chunks_offsets = test_dictionary_index_chunks_offsets,
 	.data = test_dictionary_index_data,
+	.lz4_dict = test_dictionary_index_lz4_dict,
+	.lz4_dict_size = test_dictionary_index_lz4_dict_size,
 	.currently_decompressed_chunk_index = -1,
 };
 
 void test_decompress_chunk()
 {
 	decompress_chunk(&test_index, 0);
-	assert(0 == memcmp(decompressed_chunk, test_dictionary_index_original_data, CHUNK_SIZE));
+	assert(0 == memcmp(decompressed_chunk, test_dictionary_index_original_data, test_dictionary_index_chunk_size));
 
 	decompress_chunk(&test_index, 1);
 	assert(0 == memcmp(
 		decompressed_chunk,
-		test_dictionary_index_original_data + CHUNK_SIZE, CHUNK_SIZE
+		test_dictionary_index_original_data + test_dictionary_index_chunk_size, test_dictionary_index_chunk_size
 	));
 
 	decompress_chunk(&test_index, 2);
 	assert(0 == memcmp(
 		decompressed_chunk,
-		test_dictionary_index_original_data + 2*CHUNK_SIZE, CHUNK_SIZE
+		test_dictionary_index_original_data + 2*test_dictionary_index_chunk_size, test_dictionary_index_chunk_size
 	));
 
 	decompress_chunk(&test_index, 3);
 	assert(0 == memcmp(
 		decompressed_chunk,
-		test_dictionary_index_original_data + 3*CHUNK_SIZE, test_dictionary_index_last_chunk_size
+		test_dictionary_index_original_data + 3*test_dictionary_index_chunk_size, test_dictionary_index_last_chunk_size
+	));
+}
+
+void test_decompress_chunk_prefix()
+{
+	compressed_file_t index = test_index;
+	index.currently_decompressed_chunk_index = SIZE_MAX;
+	const size_t initial_decompressed_chunks = num_decompressed_chunks;
+
+	decompress_chunk_prefix(&index, 1, 0);
+	assert(decompressed_chunk_size == decompression_margin);
+	assert(0 == memcmp(
+		decompressed_chunk,
+		test_dictionary_index_original_data + test_dictionary_index_chunk_size, decompressed_chunk_size
+	));
+
+	// Decompressed prefix is long enough
+	decompress_chunk_prefix(&index, 1, 0);
+	assert(num_decompressed_chunks == initial_decompressed_chunks + 1);
+
+	// Rounded up to keep char16_t and uint32_t whole
+	decompress_chunk_prefix(&index, 1, 1001);
+	assert(num_decompressed_chunks == initial_decompressed_chunks + 2);
+	assert(decompressed_chunk_size == 1008 + decompression_margin);
+
+	decompress_chunk(&index, 1);
+	assert(num_decompressed_chunks == initial_decompressed_chunks + 3);
+	assert(decompressed_chunk_size == test_dictionary_index_chunk_size);
+	assert(0 == memcmp(
+		decompressed_chunk,
+		test_dictionary_index_original_data + test_dictionary_index_chunk_size, test_dictionary_index_chunk_size
+	));
+
+	// Never beyond the chunk
+	decompress_chunk_prefix(&index, 3, test_dictionary_index_last_chunk_size - 1);
+	assert(decompressed_chunk_size == test_dictionary_index_last_chunk_size);
+	decompress_chunk_prefix(&index, 3, 0);
+	assert(num_decompressed_chunks == initial_decompressed_chunks + 4);
+}
+
+void test_decompress_chunk_with_dictionary()
+{
+	compressed_file_t dict_index = {
+		.chunk_size = test_dict_index_chunk_size,
+		.last_chunk_index = test_dict_index_last_chunk_index,
+		.last_chunk_size = test_dict_index_last_chunk_size,
+		.original_size = test_dict_index_original_size,
+		.chunks_offsets = test_dict_index_chunks_offsets,
+		.data = test_dict_index_data,
+		.lz4_dict = test_dict_index_lz4_dict,
+		.lz4_dict_size = test_dict_index_lz4_dict_size,
+		.currently_decompressed_chunk_index = SIZE_MAX,
+	};
+
+	// Dictionary is the first chunk itself
+	assert(test_dict_index_chunks_offsets[1] < 32);
+	for (size_t i = 0; i <= dict_index.last_chunk_index; ++i)
+	{
+		decompress_chunk(&dict_index, i);
+		assert(0 == memcmp(
+			decompressed_chunk,
+			test_dictionary_index_original_data + i*test_dictionary_index_chunk_size, get_real_chunk_size(&dict_index, i)
+		));
+	}
+}
+
+extern uint32_t (*read_chunk_impl)(uint32_t, uint32_t, uint8_t*, uint32_t);
+size_t num_chunks_read = 0;
+
+uint32_t read_test_index_chunk(uint32_t file_id, uint32_t chunk_index, uint8_t* dst, uint32_t capacity)
+{
+	assert(file_id == 7);
+	num_chunks_read += 1;
+	const int32_t start = test_dictionary_index_chunks_offsets[chunk_index];
+	const uint32_t length = (uint32_t)(test_dictionary_index_chunks_offsets[chunk_index + 1] - start);
+	assert(length <= capacity);
+	memcpy(dst, test_dictionary_index_data + start, length);
+	return length;
+}
+
+void test_decompress_external_chunk()
+{
+	setup_memory();
+	// Room for two chunks
+	reserved_sizes[CHUNK_CACHE_BUFFER] = sizeof(chunk_cache_header_t)
+		+ 2 * (sizeof(chunk_cache_slot_t) + max_compressed_chunk_size);
+	init((size_t)wasm_memory, wasm_memory_size_pages * (1<<16));
+	read_chunk_impl = read_test_index_chunk;
+
+	compressed_file_t external_index = test_index;
+	external_index.data = NULL;
+	external_index.chunks_offsets = NULL;
+	external_index.file_id = 7;
+	external_index.currently_decompressed_chunk_index = SIZE_MAX;
+
+	decompress_chunk(&external_index, 0);
+	assert(0 == memcmp(decompressed_chunk, test_dictionary_index_original_data, test_dictionary_index_chunk_size));
+	decompress_chunk(&external_index, 1);
+	assert(num_chunks_read == 2);
+
+	// Cached
+	decompress_chunk(&external_index, 0);
+	assert(num_chunks_read == 2);
+	assert(0 == memcmp(decompressed_chunk, test_dictionary_index_original_data, test_dictionary_index_chunk_size));
+
+	// Evicts least recently used chunk 1
+	decompress_chunk(&external_index, 3);
+	assert(num_chunks_read == 3);
+	assert(0 == memcmp(
+		decompressed_chunk,
+		test_dictionary_index_original_data + 3*test_dictionary_index_chunk_size, test_dictionary_index_last_chunk_size
 	));
+	decompress_chunk(&external_index, 0);
+	assert(num_chunks_read == 3);
+	decompress_chunk(&external_index, 1);
+	assert(num_chunks_read == 4);
+	assert(0 == memcmp(
+		decompressed_chunk,
+		test_dictionary_index_original_data + test_dictionary_index_chunk_size, test_dictionary_index_chunk_size
+	));
+
+	assert(state->buffers[CHUNK_CACHE_BUFFER].size == reserved_sizes[CHUNK_CACHE_BUFFER]);
+
+	clear_memory();
 }
 
 int main()
 {
 	test_decompress_chunk();
+	test_decompress_chunk_prefix();
+	test_decompress_chunk_with_dictionary();
+	test_decompress_external_chunk();
 
 	return 0;
 }
@@ -15,6 +15,9 @@ void test_parse_base62_uint()
 {
 	const char number[] = "123";
 	assert(parse_base62_uint(number, number + 3) == 62*62 + 2 * 62 + 3);
+
+	const char letters[] = "aZ";
+	assert(parse_base62_uint(letters, letters + 2) == 10 * 62 + 61);
 }
 
 void test_dentry_make()
@@ -22,47 +25,48 @@ void test_dentry_make()
 	setup_memory();
 	init((size_t)wasm_memory, wasm_memory_size_pages * (1<<16));
 
-	const char case1[] = "kanji\tkana\tdefinition\t123";
+	const char case1[] = "kanji\tkana\tz\t123";
 	const dentry_t* d = dentry_make(case1, strlen(case1), false);
 	assert(state->buffers[DENTRY_BUFFER].size == sizeof(dentry_t));
 	assert(state->buffers[DENTRY_BUFFER].data == d);
 	assert(d->kanjis_start == case1);
 	assert(d->readings_start == case1 + 6);
-	assert(d->definition_start == case1 + 6 + 5);
-	assert(d->definition_end == case1 + 6 + 5 + 10);
+	assert(d->readings_end == case1 + 6 + 4);
+	assert(d->definition_start == NULL);
+	assert(d->definition_offset == 35);
 	assert(d->entry_id == MIN_ENTRY_ID + 1 * 62*62 + 2 * 62 + 3);
 
 	state->buffers[DENTRY_BUFFER].size = 0;
-	const char case2[] = "kana\tdefinition";
+	const char case2[] = "kana\t10";
 	d = dentry_make(case2, strlen(case2), true);
 	assert(state->buffers[DENTRY_BUFFER].size == sizeof(dentry_t));
 	assert(state->buffers[DENTRY_BUFFER].data == d);
 	assert(d->kanjis_start == NULL);
 	assert(d->readings_start == case2);
-	assert(d->definition_start == case2 + 5);
-	assert(d->definition_end == case2 + strlen(case2));
+	assert(d->readings_end == case2 + 4);
+	assert(d->definition_offset == 62);
 	assert(d->entry_id == 0);
 
 	state->buffers[DENTRY_BUFFER].size = 0;
-	const char case3[] = "kana\tdefinition\t456";
+	const char case3[] = "kana\t0\t456";
 	d = dentry_make(case3, strlen(case3), false);
 	assert(state->buffers[DENTRY_BUFFER].size == sizeof(dentry_t));
 	assert(state->buffers[DENTRY_BUFFER].data == d);
 	assert(d->kanjis_start == NULL);
 	assert(d->readings_start == case3);
-	assert(d->definition_start == case3 + 5);
-	assert(d->definition_end == case3 + 5 + 10);
+	assert(d->readings_end == case3 + 4);
+	assert(d->definition_offset == 0);
 	assert(d->entry_id == MIN_ENTRY_ID + 4 * 62*62 + 5 * 62 + 6);
 
 	state->buffers[DENTRY_BUFFER].size = 0;
-	const char case4[] = "kanji\tkana\tdefinition";
+	const char case4[] = "kanji\tkana\tA";
 	d = dentry_make(case4, strlen(case4), true);
 	assert(state->buffers[DENTRY_BUFFER].size == sizeof(dentry_t));
 	assert(state->buffers[DENTRY_BUFFER].data == d);
 	assert(d->kanjis_start == case4);
 	assert(d->readings_start == case4 + 6);
-	assert(d->definition_start == case4 + 6 + 5);
-	assert(d->definition_end == case4 + 6 + 5 + 10);
+	assert(d->readings_end == case4 + 6 + 4);
+	assert(d->definition_offset == 36);
 	assert(d->entry_id == 0);
 
 	clear_memory();
@@ -216,7 +220,7 @@ void test_dentry_parse_readings()
 	const char test[] = u8"うとうと;ウトウトU;うとっとU;ウトッとU;ウトっとU";
 	dentry_t d;
 	d.readings_start = test;
-	d.definition_start = test + sizeof(test);
+	d.readings_end = test + sizeof(test) - 1;
 	dentry_parse_readings(&d, state->buffers + DENTRY_BUFFER);
 	assert(state->buffers[DENTRY_BUFFER].size == 5*sizeof(reading_t));
 	assert(d.num_readings == 5);
@@ -252,7 +256,7 @@ void test_parse_i_promise_i_wont_overwrite_it_strings()
 	size_t num;
 	i_promise_i_wont_overwrite_it_string_t* arr;
 	const char s[] = "a`b`dcdsf`dsfs;sdf:Jjksf`sflk1 01h`asd n";
-	parse_i_promise_i_wont_overwrite_it_strings(&num, &arr, s, s + strlen(s), '`', state->buffers + DENTRY_BUFFER);
+	parse_i_promise_i_wont_overwrite_it_strings(&num, &arr, s, s + strlen(s), '`', NULL, state->buffers + DENTRY_BUFFER);
 	assert(state->buffers[DENTRY_BUFFER].size == 6 * sizeof(i_promise_i_wont_overwrite_it_string_t));
 	assert(num == 6);
 	assert(arr == state->buffers[DENTRY_BUFFER].data);
@@ -280,7 +284,7 @@ void test_sense_group_parse()
 	const char s[] = "n;pitch (i.e. pace, speed, angle, space, field, sound, etc.)`pitch (from distilling petroleum, tar, etc.)`pitch (football, rugby); playing field`PHS portable phone";
 	sense_group_t sg;
 	memset(&sg, 0xff, sizeof(sg));
-	sense_group_parse(&sg, s, s + strlen(s), state->buffers + DENTRY_BUFFER);
+	sense_group_parse(&sg, s, s + strlen(s), NULL, state->buffers + DENTRY_BUFFER);
 	assert(state->buffers[DENTRY_BUFFER].size == (1 + 4) * sizeof(i_promise_i_wont_overwrite_it_string_t));
 
 	assert(sg.num_types == 1);
@@ -300,7 +304,7 @@ void test_sense_group_parse()
 	const char s2[] = "the-only-pos";
 	memset(&sg, 0xff, sizeof(sg));
 	state->buffers[DENTRY_BUFFER].size = 0;
-	sense_group_parse(&sg, s2, s2 + strlen(s2), state->buffers + DENTRY_BUFFER);
+	sense_group_parse(&sg, s2, s2 + strlen(s2), NULL, state->buffers + DENTRY_BUFFER);
 	assert(state->buffers[DENTRY_BUFFER].size == sizeof(i_promise_i_wont_overwrite_it_string_t));
 
 	assert(sg.num_types == 1);
@@ -312,6 +316,34 @@ void test_sense_group_parse()
 	clear_memory();
 }
 
+void test_sense_group_parse_interned()
+{
+	setup_memory();
+	init((size_t)wasm_memory, wasm_memory_size_pages * (1<<16));
+
+	const uint8_t data[] = "v5kto writeadj-i";
+	const uint32_t offsets[] = {0, 3, 11, 16};
+	const string_table_t strings = {.data = data, .offsets = offsets, .num_strings = 3};
+
+	const char s[] = "\x01" "0,\x01" "2;\x01" "1`to draw";
+	sense_group_t sg;
+	sense_group_parse(&sg, s, s + strlen(s), &strings, state->buffers + DENTRY_BUFFER);
+
+	assert(sg.num_types == 2);
+	assert(sg.types[0].text == (const char*)data);
+	assert(sg.types[0].length == 3);
+	assert(sg.types[1].text == (const char*)data + 11);
+	assert(sg.types[1].length == 5);
+
+	assert(sg.num_senses == 2);
+	assert(sg.senses[0].text == (const char*)data + 3);
+	assert(sg.senses[0].length == 8);
+	assert(sg.senses[1].text == s + 9);
+	assert(sg.senses[1].length == 7);
+
+	clear_memory();
+}
+
 void test_dentry_parse_definition()
 {
 	setup_memory();
@@ -321,7 +353,7 @@ void test_dentry_parse_definition()
 	dentry_t d;
 	d.definition_start = s;
 	d.definition_end = s + strlen(s);
-	dentry_parse_definition(&d, state->buffers + DENTRY_BUFFER);
+	dentry_parse_definition(&d, NULL, state->buffers + DENTRY_BUFFER);
 	assert(state->buffers[DENTRY_BUFFER].size == (
 		3*sizeof(sense_group_t)
 		+ (1 + 3)*sizeof(i_promise_i_wont_overwrite_it_string_t)
@@ -346,9 +378,13 @@ void test_dentry_parse_whole()
 	setup_memory();
 	init((size_t)wasm_memory, wasm_memory_size_pages * (1<<16));
 
-	const char s[] = u8"我;吾U#0,1,2,3,4;吾れU,我れU#0,2	われ;わU;あれU;あU;わぬU;わろU	pn;I; me`(only われ,わ) oneself`(only われ,わ) you\\pref;(only わ) (also 和) prefix indicating familiarity or contempt	77";
+	const char s[] = u8"我;吾U#0,1,2,3,4;吾れU,我れU#0,2	われ;わU;あれU;あU;わぬU;わろU	Bc	77";
+	const char definition[] = u8"pn;I; me`(only われ,わ) oneself`(only われ,わ) you\\pref;(only わ) (also 和) prefix indicating familiarity or contempt";
 	dentry_t* d = dentry_make(s, strlen(s), false);
 	dentry_parse(d);
+	assert(d->definition_offset == 37 * 62 + 12);
+	assert(d->num_sense_groups == 0);
+	dentry_set_definition(d, definition, definition + strlen(definition), NULL);
 
 	assert(d->entry_id == MIN_ENTRY_ID + 7 * 62 + 7);
 	assert(d->num_readings == 6);
@@ -376,6 +412,7 @@ int main()
 	test_dentry_parse_readings();
 	test_parse_i_promise_i_wont_overwrite_it_strings();
 	test_sense_group_parse();
+	test_sense_group_parse_interned();
 	test_dentry_parse_definition();
 	test_dentry_parse_whole();
 
@@ -44,8 +44,9 @@ void print(const char* s)
 void setup_memory()
 {
 	assert(wasm_memory == NULL);
-	wasm_memory = (uint8_t*)malloc(4*(1<<16));
-	wasm_memory_max_size_pages = 8;
+	// Enough for all buffer reservations
+	wasm_memory_max_size_pages = 128;
+	wasm_memory = (uint8_t*)malloc(wasm_memory_max_size_pages*(1<<16));
 	wasm_memory_size_pages = 1;
 }
 
@@ -6,6 +6,7 @@
 #include "fake-memory.h"
 
 #define dictionary_index_max_entry_length 2048
+#define dictionary_index_max_shared_postings 8
 #include "../src/state.c"
 #include "../src/libc.c"
 #include "../src/utf.c"
@@ -15,11 +16,38 @@
 #include "../generated/index.test.c"
 
 compressed_file_t test_index = {
+	.chunk_size = test_dictionary_index_chunk_size,
 	.last_chunk_index = test_dictionary_index_last_chunk_index,
 	.last_chunk_size = test_dictionary_index_last_chunk_size,
 	.original_size = test_dictionary_index_original_size,
 	.chunks_offsets = test_dictionary_index_chunks_offsets,
 	.data = test_dictionary_index_data,
+	.lz4_dict = test_dictionary_index_lz4_dict,
+	.lz4_dict_size = test_dictionary_index_lz4_dict_size,
+	.currently_decompressed_chunk_index = -1,
+};
+
+compressed_file_t test_shared_index = {
+	.chunk_size = test_shared_dictionary_index_chunk_size,
+	.last_chunk_index = test_shared_dictionary_index_last_chunk_index,
+	.last_chunk_size = test_shared_dictionary_index_last_chunk_size,
+	.original_size = test_shared_dictionary_index_original_size,
+	.chunks_offsets = test_shared_dictionary_index_chunks_offsets,
+	.data = test_shared_dictionary_index_data,
+	.lz4_dict = test_shared_dictionary_index_lz4_dict,
+	.lz4_dict_size = test_shared_dictionary_index_lz4_dict_size,
+	.currently_decompressed_chunk_index = -1,
+};
+
+compressed_file_t test_shared_postings = {
+	.chunk_size = test_shared_dictionary_postings_chunk_size,
+	.last_chunk_index = test_shared_dictionary_postings_last_chunk_index,
+	.last_chunk_size = test_shared_dictionary_postings_last_chunk_size,
+	.original_size = test_shared_dictionary_postings_original_size,
+	.chunks_offsets = test_shared_dictionary_postings_chunks_offsets,
+	.data = test_shared_dictionary_postings_data,
+	.lz4_dict = test_shared_dictionary_postings_lz4_dict,
+	.lz4_dict_size = test_shared_dictionary_postings_lz4_dict_size,
 	.currently_decompressed_chunk_index = -1,
 };
 
@@ -90,7 +118,7 @@ void get_and_compare_index_entry(size_t pos, size_t start_pos, size_t end_pos,
 
 void test_get_index_entry_at()
 {
-	assert(CHUNK_SIZE * words_dictionary_index_last_chunk_index + words_dictionary_index_last_chunk_size == words_index.original_size);
+	assert(words_index.chunk_size * words_dictionary_index_last_chunk_index + words_dictionary_index_last_chunk_size == words_index.original_size);
 
 	for (size_t entry_index = 0; entry_index < 10; ++entry_index)
 	{
@@ -181,6 +209,23 @@ void test_dictionary_index_search_for_offsets()
 	));
 }
 
+void test_resolve_shared_postings()
+{
+	const uint32_t gold[] = {1, 2, 3, dictionary_index_type_bit | 4, 5};
+	const char16_t* keys[] = {u"あ", u"い", u"う"};
+	for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i)
+	{
+		assert(dictionary_index_search_for_offsets(&test_shared_index, keys[i], 1, 0, test_shared_index.original_size));
+		current_index_entry_resolve_shared_postings(&test_shared_postings);
+		assert(current_index_entry.num_offsets == sizeof(gold) / sizeof(gold[0]));
+		assert(memcmp(current_index_entry.offsets, gold, sizeof(gold)) == 0);
+	}
+
+	assert(dictionary_index_search_for_offsets(&test_shared_index, u"え", 1, 0, test_shared_index.original_size));
+	current_index_entry_resolve_shared_postings(&test_shared_postings);
+	assert(current_index_entry.num_offsets == 1 && current_index_entry.offsets[0] == 6);
+}
+
 int main()
 {
 	test_find_entry_start_offset();
@@ -189,6 +234,7 @@ int main()
 	test_get_index_entry_at();
 	test_dictionary_index_entry_decode_offsets();
 	test_dictionary_index_search_for_offsets();
+	test_resolve_shared_postings();
 
 	return 0;
 }
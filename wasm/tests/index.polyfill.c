@@ -5,3 +5,17 @@ const uint8_t* words_dictionary_index_data = NULL;
 const uint32_t* words_dictionary_index_chunks_offsets = NULL;
 const uint8_t* names_dictionary_index_data = NULL;
 const uint32_t* names_dictionary_index_chunks_offsets = NULL;
+const uint8_t* words_dictionary_postings_data = NULL;
+const uint32_t* words_dictionary_postings_chunks_offsets = NULL;
+const uint8_t* names_dictionary_postings_data = NULL;
+const uint32_t* names_dictionary_postings_chunks_offsets = NULL;
+const uint8_t* kanji_words_index_data = NULL;
+const uint32_t* kanji_words_index_chunks_offsets = NULL;
+const uint32_t* kanji_words_code_points = NULL;
+const uint32_t* kanji_words_starts = NULL;
+
+uint32_t (*read_chunk_impl)(uint32_t, uint32_t, uint8_t*, uint32_t) = NULL;
+uint32_t read_chunk(uint32_t file_id, uint32_t chunk_index, uint8_t* dst, uint32_t capacity)
+{
+	return read_chunk_impl(file_id, chunk_index, dst, capacity);
+}
@@ -63,6 +63,111 @@ void test_memzero()
 	assert(memcmp(a, expected2, sizeof(a)) == 0);
 }
 
+void test_sizes_and_alignments()
+{
+	// Covers head/tail handling of every backend: sizes around
+	// chunk boundaries, unaligned pointers and overlapping moves
+	enum { max_size = 100, max_shift = 19, length = 2 * max_size + max_shift };
+	char a[length];
+	char b[length];
+	char expected[length];
+	for (size_t n = 0; n <= max_size; ++n)
+	{
+		for (size_t shift = 0; shift <= max_shift; ++shift)
+		{
+			for (size_t i = 0; i < length; ++i)
+			{
+				a[i] = (char)i;
+				b[i] = (char)~i;
+			}
+
+			memcpy(expected, b, length);
+			for (size_t i = 0; i < n; ++i)
+			{
+				expected[shift + i] = a[max_size + i];
+			}
+			memcpy(b + shift, a + max_size, n);
+			assert(memcmp(b, expected, length) == 0);
+
+			memcpy(expected, a, length);
+			for (size_t i = 0; i < n; ++i)
+			{
+				expected[max_size - shift + i] = a[max_size + i];
+			}
+			memmove(a + max_size - shift, a + max_size, n);
+			assert(memcmp(a, expected, length) == 0);
+
+			memcpy(expected, a, length);
+			for (size_t i = n; i > 0; --i)
+			{
+				expected[shift + i - 1] = a[i - 1];
+			}
+			memmove(a + shift, a, n);
+			assert(memcmp(a, expected, length) == 0);
+
+			memcpy(expected, b, length);
+			for (size_t i = 0; i < n; ++i)
+			{
+				expected[shift + i] = 0;
+			}
+			memzero(b + shift, n);
+			assert(memcmp(b, expected, length) == 0);
+		}
+	}
+}
+
+static inline int int_cmp(int key, const int* element)
+{
+	return (key > *element) - (key < *element);
+}
+
+int generic_int_cmp(const void* key, const void* element)
+{
+	return int_cmp(*(const int*)key, element);
+}
+
+define_binary_locate(locate_int, int, const int, int_cmp)
+define_binary_locate_bounds(locate_int_bounds, int, const int, int_cmp)
+
+void test_binary_locate()
+{
+	// Every prefix of sorted array with duplicates, every key
+	// in and around it, specialized and generic versions
+	const int a[] = {1, 3, 3, 4, 7, 7, 7, 8, 10, 12, 12};
+	const size_t length = sizeof(a) / sizeof(int);
+	for (size_t n = 0; n <= length; ++n)
+	{
+		for (int key = 0; key <= 13; ++key)
+		{
+			size_t lower = 0;
+			while (lower < n && a[lower] < key)
+			{
+				lower += 1;
+			}
+			size_t upper = lower;
+			while (upper < n && a[upper] == key)
+			{
+				upper += 1;
+			}
+
+			bool found;
+			assert(locate_int(key, a, n, &found) == a + lower);
+			assert(found == (lower != upper));
+
+			const int* it = binary_locate(&key, a, n, sizeof(int), generic_int_cmp, &found);
+			assert(found == (lower != upper));
+			assert(found ? *it == key : it == a + lower);
+
+			size_t l, u;
+			assert(locate_int_bounds(key, a, n, &l, &u) == (lower != upper));
+			assert(l == lower && u == upper);
+
+			assert(binary_locate_bounds(&key, a, n, sizeof(int), generic_int_cmp, &l, &u) == (lower != upper));
+			assert(l == lower && u == upper);
+		}
+	}
+}
+
 void test_find_char()
 {
 	const char s1[] = "some string";
@@ -78,5 +183,7 @@ int main()
 	test_memcpy(memcpy_backward);
 	test_memmove();
 	test_memzero();
+	test_sizes_and_alignments();
+	test_binary_locate();
 	test_find_char();
 }
@@ -0,0 +1,3 @@
+// Same tests against portable backend of memory functions
+#define RIKAIGU_SCALAR_MEMORY
+#include "libc.c"
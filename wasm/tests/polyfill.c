@@ -27,3 +27,29 @@ void print(const char* p)
 {
 	printf("\nprint('%s')\n", p);
 }
+
+// Native stand-in of JS readChunk(), see ExternalData in data/wasm_generator.py
+uint32_t read_chunk(uint32_t file_id, uint32_t chunk_index, uint8_t* dst, uint32_t capacity)
+{
+	static FILE* f = NULL;
+	if (f == NULL)
+	{
+		f = fopen("generated/rikai.dat", "rb");
+		assert(f);
+	}
+
+	uint32_t table_position;
+	fseek(f, 4 + 4 * (long)file_id, SEEK_SET);
+	assert(fread(&table_position, sizeof(table_position), 1, f) == 1);
+
+	uint32_t chunk_range[2];
+	fseek(f, table_position + 4 * (long)chunk_index, SEEK_SET);
+	assert(fread(chunk_range, sizeof(chunk_range[0]), 2, f) == 2);
+
+	if (chunk_range[1] - chunk_range[0] > capacity)
+	{
+		return 0;
+	}
+	fseek(f, chunk_range[0], SEEK_SET);
+	return (uint32_t)fread(dst, 1, chunk_range[1] - chunk_range[0], f);
+}
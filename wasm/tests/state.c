@@ -11,6 +11,16 @@
 #include "../src/utf.c"
 
 
+size_t total_reserved_size()
+{
+	size_t res = 0;
+	for (size_t i = 0; i < NUM_BUFFER_TOKENS; ++i)
+	{
+		res += reserved_sizes[i];
+	}
+	return res;
+}
+
 void test_init()
 {
 	setup_memory();
@@ -18,14 +28,21 @@ void test_init()
 	init((size_t)heap_base, wasm_memory_size_pages * (1<<16) - ((size_t)heap_base - (size_t)wasm_memory));
 
 	assert((uint8_t*)state == heap_base);
-	assert(wasm_memory_size_pages == 2);
+	assert(wasm_memory_size_pages * (1<<16) >= 31419 + sizeof(state_t) + total_reserved_size());
 
 	uint8_t* suggested_start = heap_base + sizeof(state_t);
 	assert(state->buffers[0].data == suggested_start + (8 - ((size_t)suggested_start % 8)));
 	for (size_t i = 0; i < NUM_BUFFER_TOKENS; ++i)
 	{
 		assert(state->buffers[i].size == 0);
+		if (i + 1 < NUM_BUFFER_TOKENS)
+		{
+			assert(state->buffers[i].capacity == reserved_sizes[i]);
+			assert(state->buffers[i + 1].data == state->buffers[i].data + reserved_sizes[i]);
+		}
 	}
+	assert(state->buffers[HTML_BUFFER].data + state->buffers[HTML_BUFFER].capacity
+		== wasm_memory + wasm_memory_size_pages * (1<<16));
 	clear_memory();
 }
 
@@ -35,68 +52,28 @@ void test_enlarge_your_buffer()
 	uint8_t* heap_base = wasm_memory + 31419;
 	init((size_t)heap_base, wasm_memory_size_pages * (1<<16) - ((size_t)heap_base - (size_t)wasm_memory));
 
-	const uint8_t buf0_content[] = {1,2,3,4,5,6,7,8,9,10,11};
-	assert(state->buffers[0].capacity >= sizeof(buf0_content));
-	memcpy(state->buffers[0].data, buf0_content, sizeof(buf0_content));
-	state->buffers[0].size = sizeof(buf0_content);
-	const size_t buf0_initial_capacity = state->buffers[0].capacity;
-
-	const uint8_t buf1_content[] = {12,13,14,15,16,17,18,19,20,21,22,23,24,25,26,27,28};
-	assert(state->buffers[1].capacity >= sizeof(buf1_content));
-	memcpy(state->buffers[1].data, buf1_content, sizeof(buf1_content));
-	state->buffers[1].size = sizeof(buf1_content);
-	const size_t buf1_initial_capacity = state->buffers[1].capacity;
-
-	const uint8_t buf2_content[] = {29,30,31,32,33,34,35,36,37,38,39,40,41,42,43};
-	assert(state->buffers[2].capacity >= sizeof(buf2_content));
-	memcpy(state->buffers[2].data, buf2_content, sizeof(buf2_content));
-	state->buffers[2].size = sizeof(buf2_content);
-	const size_t buf2_initial_capacity = state->buffers[2].capacity;
-
-	assert(state->buffers[0].size == sizeof(buf0_content));
-	assert(memcmp(state->buffers[0].data, buf0_content, sizeof(buf0_content)) == 0);
-	assert(state->buffers[1].size == sizeof(buf1_content));
-	assert(memcmp(state->buffers[1].data, buf1_content, sizeof(buf1_content)) == 0);
-	assert(state->buffers[2].size == sizeof(buf2_content));
-	assert(memcmp(state->buffers[2].data, buf2_content, sizeof(buf2_content)) == 0);
-
-	enlarge_your_buffer(state->buffers + 1, 25);
-
-	assert(state->buffers[0].size == sizeof(buf0_content));
-	assert(state->buffers[0].capacity == buf0_initial_capacity);
-	assert(memcmp(state->buffers[0].data, buf0_content, sizeof(buf0_content)) == 0);
-	assert(state->buffers[1].size == sizeof(buf1_content));
-	assert(state->buffers[1].capacity == buf1_initial_capacity + PAGE_SIZE_BYTES);
-	assert(memcmp(state->buffers[1].data, buf1_content, sizeof(buf1_content)) == 0);
-	assert(state->buffers[2].size == sizeof(buf2_content));
-	assert(state->buffers[2].capacity == buf2_initial_capacity);
-	assert(memcmp(state->buffers[2].data, buf2_content, sizeof(buf2_content)) == 0);
-
-	enlarge_your_buffer(state->buffers + 2, PAGE_SIZE_BYTES);
-
-	assert(state->buffers[0].size == sizeof(buf0_content));
-	assert(state->buffers[0].capacity == buf0_initial_capacity);
-	assert(memcmp(state->buffers[0].data, buf0_content, sizeof(buf0_content)) == 0);
-	assert(state->buffers[1].size == sizeof(buf1_content));
-	assert(state->buffers[1].capacity == buf1_initial_capacity + PAGE_SIZE_BYTES);
-	assert(memcmp(state->buffers[1].data, buf1_content, sizeof(buf1_content)) == 0);
-	assert(state->buffers[2].size == sizeof(buf2_content));
-	assert(state->buffers[2].capacity == buf2_initial_capacity + 2 * PAGE_SIZE_BYTES);
-	assert(memcmp(state->buffers[2].data, buf2_content, sizeof(buf2_content)) == 0);
+	void* buffers_data[NUM_BUFFER_TOKENS];
+	for (size_t i = 0; i < NUM_BUFFER_TOKENS; ++i)
+	{
+		buffers_data[i] = state->buffers[i].data;
+	}
 
-	enlarge_your_buffer(state->buffers, PAGE_SIZE_BYTES * 3 / 2);
+	const uint8_t html_content[] = {1,2,3,4,5,6,7,8,9,10,11};
+	memcpy(state->buffers[HTML_BUFFER].data, html_content, sizeof(html_content));
+	state->buffers[HTML_BUFFER].size = sizeof(html_content);
+	const size_t html_initial_capacity = state->buffers[HTML_BUFFER].capacity;
+	const size_t initial_num_pages = wasm_memory_size_pages;
 
-	assert(state->buffers[0].size == sizeof(buf0_content));
-	assert(state->buffers[0].capacity == buf0_initial_capacity + 2 * PAGE_SIZE_BYTES);
-	assert(memcmp(state->buffers[0].data, buf0_content, sizeof(buf0_content)) == 0);
-	assert(state->buffers[1].size == sizeof(buf1_content));
-	assert(state->buffers[1].capacity == buf1_initial_capacity + PAGE_SIZE_BYTES);
-	assert(memcmp(state->buffers[1].data, buf1_content, sizeof(buf1_content)) == 0);
-	assert(state->buffers[2].size == sizeof(buf2_content));
-	assert(state->buffers[2].capacity == buf2_initial_capacity + 2 * PAGE_SIZE_BYTES);
-	assert(memcmp(state->buffers[2].data, buf2_content, sizeof(buf2_content)) == 0);
+	enlarge_your_buffer(state->buffers + HTML_BUFFER, 25);
 
-	assert(wasm_memory_size_pages == 8);
+	assert(state->buffers[HTML_BUFFER].capacity > html_initial_capacity);
+	assert(state->buffers[HTML_BUFFER].capacity - html_initial_capacity
+		== (wasm_memory_size_pages - initial_num_pages) * PAGE_SIZE_BYTES);
+	assert(memcmp(state->buffers[HTML_BUFFER].data, html_content, sizeof(html_content)) == 0);
+	for (size_t i = 0; i < NUM_BUFFER_TOKENS; ++i)
+	{
+		assert(state->buffers[i].data == buffers_data[i]);
+	}
 
 	clear_memory();
 }
@@ -130,23 +107,77 @@ void test_buffer_allocate()
 	assert(ptr2 == ptr1 + sizeof(buf0_content1));
 	memcpy(ptr2, buf0_content2, sizeof(buf0_content2));
 
-	const size_t to_allocate = state->buffers[0].capacity - state->buffers[0].size + 10;
+	const size_t to_allocate = state->buffers[0].capacity - state->buffers[0].size;
 	buffer_allocate(state->buffers, to_allocate);
-	assert(state->buffers[0].size == sizeof(buf0_content1) + sizeof(buf0_content2) + to_allocate);
-	assert(state->buffers[0].capacity == buf0_initial_capacity + PAGE_SIZE_BYTES);
+	assert(state->buffers[0].size == state->buffers[0].capacity);
 	assert(memcmp(state->buffers[0].data, buf0_content1, sizeof(buf0_content1)) == 0);
 	assert(memcmp(state->buffers[0].data + sizeof(buf0_content1), buf0_content2, sizeof(buf0_content2)) == 0);
 
 	assert(memcmp(state->buffers[1].data, buf1_content, sizeof(buf1_content)) == 0);
-	assert(state->buffers[1].data == old_buf1_data + PAGE_SIZE_BYTES);
+	assert(state->buffers[1].data == old_buf1_data);
+
+	clear_memory();
+}
+
+void test_enlarge_your_buffer_moves_buffer()
+{
+	setup_memory();
+	uint8_t* heap_base = wasm_memory + 31419;
+	init((size_t)heap_base, wasm_memory_size_pages * (1<<16) - ((size_t)heap_base - (size_t)wasm_memory));
+
+	void* buffers_data[NUM_BUFFER_TOKENS];
+	for (size_t i = 0; i < NUM_BUFFER_TOKENS; ++i)
+	{
+		buffers_data[i] = state->buffers[i].data;
+	}
+
+	buffer_t* candidates = state->buffers + CANDIDATE_BUFFER;
+	const uint8_t content[] = {1,2,3,4,5,6,7,8,9,10,11};
+	uint8_t* old_data = buffer_allocate(candidates, sizeof(content));
+	memcpy(old_data, content, sizeof(content));
+	const size_t initial_capacity = candidates->capacity;
+	const size_t initial_num_pages = wasm_memory_size_pages;
+
+	// Outgrown buffer is moved to the end of memory with its contents
+	buffer_allocate(candidates, initial_capacity);
+	assert(candidates->data == wasm_memory + initial_num_pages * PAGE_SIZE_BYTES);
+	assert(candidates->data + candidates->capacity == wasm_memory + wasm_memory_size_pages * PAGE_SIZE_BYTES);
+	assert(candidates->size == sizeof(content) + initial_capacity);
+	assert(memcmp(candidates->data, content, sizeof(content)) == 0);
+	// Old range is left as is
+	assert(memcmp(old_data, content, sizeof(content)) == 0);
+	for (size_t i = 0; i < NUM_BUFFER_TOKENS; ++i)
+	{
+		if (i != CANDIDATE_BUFFER)
+		{
+			assert(state->buffers[i].data == buffers_data[i]);
+		}
+	}
+
+	// And grows in place since then, while html buffer, no longer
+	// at the end of memory, is moved as well
+	void* const moved_data = candidates->data;
+	buffer_allocate(candidates, candidates->capacity - candidates->size + 1);
+	assert(candidates->data == moved_data);
+
+	buffer_t* html = state->buffers + HTML_BUFFER;
+	buffer_allocate(html, html->capacity + 1);
+	assert(html->data == moved_data + candidates->capacity);
+	assert(html->data + html->capacity == wasm_memory + wasm_memory_size_pages * PAGE_SIZE_BYTES);
+
+	buffer_stats_t* stats = get_buffer_stats(candidates);
+	assert(stats->num_enlargements == 2);
+	assert(stats->peak_size == candidates->size);
 
 	clear_memory();
 }
 
 int main()
 {
+	test_init();
 	test_enlarge_your_buffer();
 	test_buffer_allocate();
+	test_enlarge_your_buffer_moves_buffer();
 
 	return 0;
 }
@@ -1,8 +1,10 @@
 import unittest
+import re
 import sys
 import random
 import secrets
 import bisect
+import struct
 import itertools
 from ctypes import (
 	cdll,
@@ -26,6 +28,7 @@ from ctypes import (
 	create_string_buffer,
 	string_at,
 	addressof,
+	memmove,
 )
 
 sys.path.append('../data')
@@ -65,10 +68,26 @@ def make_buffer(capacity):
 class State(Structure):
 	_fields_ = [
 		('input', Input),
-		('buffers', Buffer * 6),
+		('buffers', Buffer * 11),
 	]
 pState = POINTER(State)
 
+class BufferStats(Structure):
+	_fields_ = [
+		('capacity', c_size_t),
+		('size', c_size_t),
+		('peak_size', c_size_t),
+		('num_enlargements', c_size_t),
+		('enlarged_bytes', c_size_t),
+	]
+
+class ArenaStats(Structure):
+	_fields_ = [
+		('num_buffers', c_size_t),
+		('buffers', BufferStats * 11),
+	]
+pArenaStats = POINTER(ArenaStats)
+
 pChar = POINTER(c_char)
 def makePChar(buff):
 	if type(buff) == str:
@@ -108,21 +127,29 @@ class Candidate(Structure):
 
 class CompressedFile(Structure):
 	_fields_ = [
+		('chunk_size', c_size_t),
 		('last_chunk_index', c_size_t),
 		('last_chunk_size', c_size_t),
 		('original_size', c_size_t),
 		('chunks_offsets', POINTER(c_uint)),
 		('data', POINTER(c_ubyte)),
+		('lz4_dict', POINTER(c_ubyte)),
+		('lz4_dict_size', c_size_t),
 		('currently_decompressed_chunk_index', c_size_t),
+		('file_id', c_uint),
 	]
 pCompressedFile = POINTER(CompressedFile)
 test_index = CompressedFile(
+	c_size_t.in_dll(lib, 'test_dictionary_index_chunk_size'),
 	c_size_t.in_dll(lib, 'test_dictionary_index_last_chunk_index'),
 	c_size_t.in_dll(lib, 'test_dictionary_index_last_chunk_size'),
 	c_size_t.in_dll(lib, 'test_dictionary_index_original_size'),
 	cast(lib.test_dictionary_index_chunks_offsets, POINTER(c_uint)),
 	cast(lib.test_dictionary_index_data, POINTER(c_ubyte)),
-	c_size_t(-1)
+	None,
+	c_size_t.in_dll(lib, 'test_dictionary_index_lz4_dict_size'),
+	c_size_t(-1),
+	c_uint.in_dll(lib, 'test_dictionary_index_file_id'),
 )
 
 class DictionaryIndexEntry(Structure):
@@ -194,8 +221,10 @@ class Dentry(Structure):
 	_fields_ = [
 		('kanjis_start', pChar),
 		('readings_start', pChar),
+		('readings_end', pChar),
 		('definition_start', pChar),
 		('definition_end', pChar),
+		('definition_offset', c_uint),
 		('entry_id', c_uint),
 
 		('num_kanji_groups', c_size_t),
@@ -211,7 +240,7 @@ pDentry = POINTER(Dentry)
 
 class WordResult(Structure):
 	_fields_ = [
-		('offset', c_size_t),
+		('offset', c_uint),
 
 		('vardata_start_offset', c_size_t),
 		('key_length', c_ubyte),
@@ -221,9 +250,17 @@ class WordResult(Structure):
 		('is_name', c_bool),
 
 		('dentry', pDentry),
+		('render_cache_position', c_uint),
 	]
 pWordResult = POINTER(WordResult)
 
+class KanjiEntry(Structure):
+	_fields_ = [
+		('code_point', c_uint),
+		('fields', BorrowedString * 6),
+	]
+pKanjiEntry = POINTER(KanjiEntry)
+
 names_line = 'お浸し,御浸し;御ひたし#0;御したし#1\tおひたし;おしたし\tn;boiled greens in bonito-flavoured soy sauce\\p'
 dictionary_line = names_line + '\t33066'
 def make_dentry() -> Dentry:
@@ -258,9 +295,11 @@ def make_dentry() -> Dentry:
 	sg2 = SenseGroup(1, pointer(t2), 1, pointer(s2))
 	sgs = (SenseGroup * 2)(sg1, sg2)
 
+	readings_end = cast(pointer(c_char.from_buffer(buf, ends[1] - 1)), pChar)
+
 	return Dentry(
-		kanjis_start, readings_start, definition_start, definition_end,
-		123,
+		kanjis_start, readings_start, readings_end, definition_start, definition_end,
+		0, 123,
 		2, cast(pointer(kgs), pKanjiGroup),
 		2, cast(pointer(rs), pReading),
 		2, cast(pointer(sgs), pSenseGroup),
@@ -285,6 +324,14 @@ lib.state_get_index_entry_buffer.restype = pBuffer
 lib.state_get_word_result_buffer.restype = pBuffer
 lib.state_get_raw_dentry_buffer.restype = pBuffer
 lib.state_get_html_buffer.restype = pBuffer
+lib.state_get_render_cache_buffer.restype = pBuffer
+lib.state_get_review_list_buffer.restype = pBuffer
+lib.state_get_srs_buffer.restype = pBuffer
+lib.kanji_get_entry.restype = pKanjiEntry
+lib.review_list_context_buffer.argtypes = [c_size_t]
+lib.review_list_context_buffer.restype = c_void_p
+lib.review_list_set_context.argtypes = [c_uint, c_size_t]
+lib.review_list_set_context.restype = c_bool
 
 lib.state_get_word_result_iterator.restype = Iterator
 
@@ -316,14 +363,12 @@ class T(unittest.TestCase):
 	def get_offsets(cls, key):
 		return set(map(lambda o: o[1] if type(o) == tuple else o, cls.samples[key]))
 
-	def init_state(self, size=(1 << 16) * 2, initial_size=(1 << 16) * 2):
+	def init_state(self, size=(1 << 16) * 128, initial_size=(1 << 16) * 2):
 		size = max(size, initial_size)
 		self.memory = create_string_buffer(size)
 		self.memory_used_size = initial_size
 		lib.init.argtypes = [c_void_p, c_size_t]
 		lib.init.restype = None
-		lib.init(cast(pointer(self.memory), c_void_p), initial_size)
-		self.state = pState.in_dll(lib, 'state')
 
 		if size > initial_size:
 			@CFUNCTYPE(c_size_t, c_int)
@@ -342,8 +387,13 @@ class T(unittest.TestCase):
 					)
 					return -1
 				self.memory_used_size += num_bytes
-				return self.memory_used_size - num_bytes
-			c_void_p.in_dll(lib, '__builtin_wasm_memory_grow_impl').value = pointer_to_address(memory_size)
+				return (self.memory_used_size - num_bytes) // (1 << 16)
+			c_void_p.in_dll(lib, '__builtin_wasm_memory_grow_impl').value = pointer_to_address(memory_grow)
+			# callbacks must outlive the state
+			self.memory_callbacks = (memory_size, memory_grow)
+
+		lib.init(cast(pointer(self.memory), c_void_p), initial_size)
+		self.state = pState.in_dll(lib, 'state')
 
 	def clear_state(self):
 		c_void_p.in_dll(lib, 'state').value = 0
@@ -356,6 +406,9 @@ class T(unittest.TestCase):
 		if hasattr(self, 'memory'):
 			del self.memory
 
+		if hasattr(self, 'memory_callbacks'):
+			del self.memory_callbacks
+
 	def tearDown(self):
 		self.clear_state()
 		c_void_p.in_dll(lib, 'currently_decompressed_file').value = 0
@@ -493,7 +546,7 @@ class T(unittest.TestCase):
 			c_void_p,
 			POINTER(c_size_t), POINTER(c_size_t),
 		]
-		lib.binary_locate.restype = c_bool
+		lib.binary_locate_bounds.restype = c_bool
 
 		@CFUNCTYPE(c_int, c_char_p, POINTER(pChar))
 		def compar(k, v):
@@ -552,7 +605,7 @@ class T(unittest.TestCase):
 		lib.split_memory_into_buffers.argtypes = [c_void_p, c_size_t]
 		lib.split_memory_into_buffers.restype = None
 
-		capacity_left = (1 << 16) * 3 // 2
+		capacity_left = (1 << 16) * 128
 		memory = create_string_buffer(capacity_left)
 		start = pointer_to_address(memory)
 		c_void_p.in_dll(lib, 'state').value = start
@@ -571,7 +624,7 @@ class T(unittest.TestCase):
 
 		lib.split_memory_into_buffers(start, capacity_left)
 		self.assertEqual(state.contents.buffers[0].data, start + 5)
-		for i in range(0, 6):
+		for i in range(0, 8):
 			self.assertEqual(state.contents.buffers[i].capacity % 8, 0)
 			self.assertEqual(state.contents.buffers[i].data % 8, 0)
 			if i > 0:
@@ -580,6 +633,53 @@ class T(unittest.TestCase):
 					state.contents.buffers[i - 1].data + state.contents.buffers[i - 1].capacity
 				)
 
+	def test_arena_stats(self):
+		lib.rikaigu_get_arena_stats.restype = pArenaStats
+		lib.buffer_allocate.argtypes = [pBuffer, c_size_t]
+		lib.buffer_allocate.restype = c_void_p
+
+		# Available before initialization too
+		stats = lib.rikaigu_get_arena_stats().contents
+		self.assertTrue(all(buffer_stats.capacity == 0 for buffer_stats in stats.buffers[:stats.num_buffers]))
+
+		self.init_state()
+		stats = lib.rikaigu_get_arena_stats().contents
+		self.assertEqual(stats.num_buffers, 11)
+		for buffer_stats in stats.buffers:
+			self.assertEqual(buffer_stats.size, 0)
+			self.assertEqual(buffer_stats.peak_size, 0)
+			self.assertEqual(buffer_stats.num_enlargements, 0)
+
+		html_buffer = lib.state_get_html_buffer()
+		initial_capacity = html_buffer.contents.capacity
+		lib.buffer_allocate(html_buffer, 100)
+		lib.state_clear()
+		lib.buffer_allocate(html_buffer, initial_capacity + 1)
+
+		stats = lib.rikaigu_get_arena_stats().contents.buffers[10]
+		self.assertEqual(stats.size, initial_capacity + 1)
+		self.assertEqual(stats.peak_size, initial_capacity + 1)
+		self.assertEqual(stats.capacity, html_buffer.contents.capacity)
+		self.assertEqual(stats.num_enlargements, 1)
+		self.assertEqual(stats.enlarged_bytes, html_buffer.contents.capacity - initial_capacity)
+
+	def test_rikaigu_set_reserved_size(self):
+		lib.rikaigu_set_reserved_size.argtypes = [c_uint, c_uint]
+		lib.rikaigu_set_reserved_size.restype = None
+
+		reserved_sizes = (c_size_t * 11).in_dll(lib, 'reserved_sizes')
+		defaults = list(reserved_sizes)
+		try:
+			lib.rikaigu_set_reserved_size(0, 10)
+			lib.rikaigu_set_reserved_size(10, (1 << 16) * 4 + 3)
+			self.assertEqual(list(reserved_sizes), defaults[:10] + [(1 << 16) * 4 + 8])
+
+			self.init_state()
+			self.assertEqual(self.state.contents.buffers[0].capacity, defaults[0])
+			self.assertGreaterEqual(lib.state_get_html_buffer().contents.capacity, (1 << 16) * 4 + 8)
+		finally:
+			reserved_sizes[:] = defaults
+
 	def test_vardata_array(self):
 		memory, buf = make_buffer(256)
 		lib.vardata_array_make(byref(buf), 12)
@@ -1069,6 +1169,543 @@ class T(unittest.TestCase):
 		# testing if html is unicode-valid
 		self.assertIsNotNone(pChar2str(pData, html_buffer.contents.size))
 
+	def test_search_with_moved_buffers(self):
+		lib.search.argtypes = [c_size_t]
+		lib.search.restype = c_size_t
+		lib.rikaigu_get_arena_stats.restype = pArenaStats
+
+		def search_html():
+			self.init_state()
+			for i, c in enumerate('かける'):
+				self.state.contents.input.data[i] = ord(c)
+			self.assertEqual(lib.search(3), 3)
+			lib.make_html()
+			html_buffer = lib.state_get_html_buffer().contents
+			html = pChar2str(c_void_p(html_buffer.data), html_buffer.size)
+			stats = lib.rikaigu_get_arena_stats().contents
+			num_enlargements = sum(stats.buffers[i].num_enlargements for i in range(2, 7))
+			self.clear_state()
+			return html, num_enlargements
+
+		expected, num_enlargements = search_html()
+		self.assertEqual(num_enlargements, 0)
+
+		# Buffers outgrowing their reservations are moved during search
+		reserved_sizes = (c_size_t * 11).in_dll(lib, 'reserved_sizes')
+		defaults = list(reserved_sizes)
+		try:
+			for i in range(2, 7):
+				reserved_sizes[i] = 64
+			html, num_enlargements = search_html()
+			self.assertGreater(num_enlargements, 0)
+			self.assertEqual(html, expected)
+		finally:
+			reserved_sizes[:] = defaults
+
+	def test_kanji_words_search(self):
+		lib.kanji_words_search.argtypes = [c_uint, c_size_t]
+		lib.kanji_words_search.restype = c_size_t
+		lib.kanji_words_get_offsets.argtypes = [c_uint, POINTER(c_uint), c_size_t]
+		lib.kanji_words_get_offsets.restype = c_size_t
+
+		self.init_state()
+		code_point = c_uint.in_dll(lib, 'kanji_words_code_points').value
+		offsets = (c_uint * 64)()
+		num_offsets = lib.kanji_words_get_offsets(code_point, offsets, 64)
+		self.assertGreater(num_offsets, 0)
+
+		max_words = min(num_offsets, 5)
+		self.assertEqual(lib.kanji_words_search(code_point, max_words), max_words)
+		num_word_results = lib.vardata_array_num_elements(lib.state_get_word_result_buffer())
+		it = cast(lib.vardata_array_elements_start(lib.state_get_word_result_buffer()), pWordResult)
+		# Ranking order is kept
+		self.assertEqual([wr.offset for wr in it[:num_word_results]], offsets[:max_words])
+
+		lib.make_html()
+		html_buffer = lib.state_get_html_buffer()
+		html = pChar2str(c_void_p(html_buffer.contents.data), html_buffer.contents.size)
+		self.assertIn(chr(code_point), html)
+
+		lib.state_clear()
+		self.assertEqual(lib.kanji_words_search(ord('a'), 5), 0)
+		self.assertEqual(lib.kanji_words_get_offsets(0x10FFFF, offsets, 64), 0)
+
+	def test_make_binary(self):
+		lib.search.argtypes = [c_size_t]
+		lib.search.restype = c_size_t
+
+		self.init_state()
+
+		for i, c in enumerate('かける'):
+			self.state.contents.input.data[i] = ord(c)
+		self.assertEqual(lib.search(3), 3)
+		num_word_results = lib.vardata_array_num_elements(lib.state_get_word_result_buffer())
+
+		lib.make_binary()
+		binary_buffer = lib.state_get_html_buffer().contents
+		blob_start = binary_buffer.data
+
+		def read(fmt, offset):
+			return struct.unpack_from('<' + fmt, string_at(blob_start + offset, struct.calcsize('<' + fmt)))
+
+		def read_text(offset, length):
+			return string_at(blob_start + offset, length).decode()
+
+		magic, version, flags, num_results, size = read('IHHII', 0)
+		self.assertEqual(magic, 0x42474B52)
+		self.assertEqual(version, 1)
+		self.assertEqual(num_results, num_word_results)
+		self.assertEqual(size, binary_buffer.size)
+
+		for i in range(num_results):
+			(
+				entry_id, match_length, result_flags,
+				num_kanji_groups, num_readings, num_sense_groups,
+				inflection_offset, inflection_length,
+				definition_offset, definition_length,
+				kanji_groups, readings, sense_groups,
+			) = read('IBBHHHiIiIIII', 16 + i * 40)
+			self.assertEqual(match_length, 3)
+			self.assertGreater(num_readings, 0)
+			self.assertGreater(definition_length, 0)
+			# Inflection name is copied into the blob, missing one is empty
+			if inflection_length > 0:
+				self.assertTrue(0 < inflection_offset and inflection_offset + inflection_length <= size)
+				read_text(inflection_offset, inflection_length)
+			else:
+				self.assertEqual(inflection_offset, 0)
+
+			surfaces = [read('iHH', readings + j * 8) for j in range(num_readings)]
+			for offset, length, _ in surfaces:
+				read_text(offset, length)
+
+			for j in range(num_sense_groups):
+				num_types, num_senses, types, senses = read('HHII', sense_groups + j * 12)
+				for k in range(num_senses):
+					self.assertTrue(read_text(*read('iI', senses + k * 8)))
+
+	def test_review_list(self):
+		lib.in_review_list.argtypes = [c_uint]
+		lib.in_review_list.restype = c_bool
+		lib.review_list_import_buffer.argtypes = [c_size_t]
+		lib.review_list_import_buffer.restype = POINTER(c_uint)
+		lib.review_list_import.argtypes = [c_size_t]
+		lib.review_list_import.restype = None
+
+		with open('generated/config.h') as f:
+			min_entry_id = int(re.search(r'MIN_ENTRY_ID (\d+)', f.read()).group(1))
+
+		self.init_state()
+		random.seed(35)
+		expected = set()
+
+		def check():
+			for entry_id in random.sample(sorted(expected), min(len(expected), 500)):
+				self.assertTrue(lib.in_review_list(entry_id))
+			for _ in range(500):
+				entry_id = min_entry_id + random.randrange(3 << 16)
+				self.assertEqual(lib.in_review_list(entry_id), entry_id in expected)
+
+		# First container outgrows array representation, others stay sparse
+		for _ in range(6000):
+			entry_id = min_entry_id + random.choice([random.randrange(1 << 16), random.randrange(3 << 16)])
+			lib.review_list_add_entry(entry_id)
+			expected.add(entry_id)
+		check()
+
+		# And gets back to array
+		for entry_id in random.sample(sorted(expected), 4000):
+			lib.review_list_remove_entry(entry_id)
+			expected.remove(entry_id)
+		check()
+
+		entry_ids = [min_entry_id + random.randrange(3 << 16) for _ in range(30000)]
+		buf = lib.review_list_import_buffer(len(entry_ids))
+		for i, entry_id in enumerate(entry_ids):
+			buf[i] = entry_id
+		lib.review_list_import(len(entry_ids))
+		expected.update(entry_ids)
+		check()
+
+		# Out of range ids are never reviewed
+		lib.review_list_add_entry(min_entry_id - 1)
+		self.assertFalse(lib.in_review_list(min_entry_id - 1))
+
+		# Outgrown arrays are reclaimed when reservation runs out
+		reserved_sizes = (c_size_t * 11).in_dll(lib, 'reserved_sizes')
+		defaults = list(reserved_sizes)
+		try:
+			reserved_sizes[0] = 12 << 10
+			self.clear_state()
+			self.init_state()
+			expected = set()
+			for _ in range(2400):
+				entry_id = min_entry_id + random.randrange(3 << 16)
+				lib.review_list_add_entry(entry_id)
+				expected.add(entry_id)
+			check()
+			self.assertLessEqual(lib.state_get_review_list_buffer().contents.size, 12 << 10)
+
+			# And buffer is moved, when compaction isn't enough
+			reserved_sizes[0] = 4 << 10
+			self.clear_state()
+			self.init_state()
+			expected = set()
+			for _ in range(2400):
+				entry_id = min_entry_id + random.randrange(3 << 16)
+				lib.review_list_add_entry(entry_id)
+				expected.add(entry_id)
+			check()
+			self.assertGreater(lib.state_get_review_list_buffer().contents.capacity, 4 << 10)
+		finally:
+			reserved_sizes[:] = defaults
+
+	def test_review_context(self):
+		lib.review_list_import_contexts.argtypes = [c_size_t]
+		lib.review_list_import_contexts.restype = c_size_t
+		lib.review_context_get.argtypes = [c_uint, POINTER(c_void_p)]
+		lib.review_context_get.restype = c_size_t
+		lib.state_get_review_context_buffer.restype = pBuffer
+		lib.rikaigu_get_arena_stats.restype = pArenaStats
+
+		with open('generated/config.h') as f:
+			min_entry_id = int(re.search(r'MIN_ENTRY_ID (\d+)', f.read()).group(1))
+
+		self.init_state()
+		random.seed(36)
+		expected = {}
+
+		def get(entry_id):
+			text = c_void_p()
+			length = lib.review_context_get(entry_id, byref(text))
+			return string_at(text, length).decode() if length > 0 else ''
+
+		def set_context(entry_id, context):
+			data = context.encode()
+			ptr = lib.review_list_context_buffer(len(data))
+			memmove(ptr, data, len(data))
+			return lib.review_list_set_context(entry_id, len(data))
+
+		def check():
+			for entry_id, context in expected.items():
+				self.assertEqual(get(entry_id), context)
+			live_size = sum(len(context.encode()) for context in expected.values())
+			# Abandoned texts never outweigh live ones
+			self.assertLessEqual(
+				lib.state_get_review_context_buffer().contents.size,
+				16 + 12 * len(expected) + 2 * live_size
+			)
+			# Telemetry sees the buffer, though it's managed without buffer_allocate()
+			review_context_stats = lib.rikaigu_get_arena_stats().contents.buffers[7]
+			self.assertGreaterEqual(review_context_stats.peak_size, review_context_stats.size)
+			self.assertGreater(review_context_stats.size, 16)
+
+		entry_ids = [min_entry_id + i for i in random.sample(range(1 << 16), 2000)]
+		for entry_id in entry_ids:
+			lib.review_list_add_entry(entry_id)
+
+		# Not reviewed entries get no context
+		set_context(min_entry_id + (1 << 17), 'ignored')
+		self.assertEqual(get(min_entry_id + (1 << 17)), '')
+
+		for _ in range(6000):
+			entry_id = random.choice(entry_ids)
+			context = random.choice(['', '漢字を書く。', 'かく' * random.randrange(1, 40), '<b>'])
+			set_context(entry_id, context)
+			if context:
+				expected[entry_id] = context
+			else:
+				expected.pop(entry_id, None)
+		check()
+
+		for entry_id in random.sample(entry_ids, 1000):
+			lib.review_list_remove_entry(entry_id)
+			expected.pop(entry_id, None)
+			self.assertEqual(get(entry_id), '')
+		check()
+
+		records = b''
+		for entry_id in sorted(entry_ids):
+			if lib.in_review_list(entry_id) and random.random() < 0.5:
+				context = '文脈 %d' % entry_id
+				data = context.encode()
+				records += struct.pack('<II', entry_id, len(data)) + data + b'\0' * (-len(data) % 4)
+				expected[entry_id] = context
+		ptr = lib.review_list_context_buffer(len(records))
+		memmove(ptr, records, len(records))
+		self.assertEqual(lib.review_list_import_contexts(len(records)), 0)
+		check()
+
+		# Too long contexts are dropped and reported
+		reviewed_id = next(entry_id for entry_id in entry_ids if lib.in_review_list(entry_id))
+		self.assertFalse(set_context(reviewed_id, 'a' * 5000))
+		self.assertEqual(get(reviewed_id), '')
+		expected.pop(reviewed_id, None)
+		records = struct.pack('<II', reviewed_id, 5000) + b'a' * 5000
+		ptr = lib.review_list_context_buffer(len(records))
+		memmove(ptr, records, len(records))
+		self.assertEqual(lib.review_list_import_contexts(len(records)), 1)
+		check()
+
+		# Contexts not fitting reservation enlarge it
+		reserved_sizes = (c_size_t * 11).in_dll(lib, 'reserved_sizes')
+		defaults = list(reserved_sizes)
+		try:
+			reserved_sizes[7] = 1 << 10
+			self.clear_state()
+			self.init_state()
+			expected = {}
+			for i in range(40):
+				lib.review_list_add_entry(min_entry_id + i)
+				self.assertTrue(set_context(min_entry_id + i, chr(ord('a') + i % 26) * 900))
+				expected[min_entry_id + i] = chr(ord('a') + i % 26) * 900
+			check()
+			self.assertGreater(lib.state_get_review_context_buffer().contents.capacity, 1 << 10)
+		finally:
+			reserved_sizes[:] = defaults
+
+	def test_srs(self):
+		lib.srs_write_due.argtypes = [pBuffer, c_uint, c_size_t]
+		lib.srs_write_due.restype = None
+		lib.srs_write_state.argtypes = [pBuffer]
+		lib.srs_write_state.restype = None
+		lib.srs_grade.argtypes = [c_uint, c_uint, c_uint]
+		lib.srs_grade.restype = c_uint
+		lib.srs_import_buffer.argtypes = [c_size_t]
+		lib.srs_import_buffer.restype = c_void_p
+		lib.srs_import.argtypes = [c_size_t]
+		lib.srs_import.restype = None
+		lib.review_list_import_buffer.argtypes = [c_size_t]
+		lib.review_list_import_buffer.restype = POINTER(c_uint)
+
+		with open('generated/config.h') as f:
+			min_entry_id = int(re.search(r'MIN_ENTRY_ID (\d+)', f.read()).group(1))
+
+		# Exports pack pointers into 32 bits, which only works in wasm
+		def read_html_buffer():
+			html_buffer = lib.state_get_html_buffer().contents
+			return string_at(html_buffer.data, html_buffer.size)
+
+		def get_due(now, max_cards):
+			lib.srs_write_due(lib.state_get_html_buffer(), now, max_cards)
+			data = read_html_buffer()
+			return list(struct.unpack('<%dI' % (len(data) // 4), data))
+
+		self.init_state()
+		random.seed(37)
+		day = 24 * 60 * 60
+		now = 1700000000
+		due = {}
+
+		def check():
+			expected = sorted((t, entry_id) for entry_id, t in due.items() if t <= now)
+			self.assertEqual(get_due(now, 50), [entry_id for _, entry_id in expected[:50]])
+			self.assertEqual(len(get_due(now, len(due) + 10)), len(expected))
+
+		entry_ids = [min_entry_id + i for i in random.sample(range(3 << 16), 3000)]
+		for entry_id in entry_ids:
+			lib.review_list_add_entry(entry_id)
+			due[entry_id] = 0
+		check()
+
+		# New card goes to tomorrow, and its interval grows with good answers
+		entry_id = entry_ids[0]
+		self.assertEqual(lib.srs_grade(entry_id, 2, now), now + day)
+		self.assertEqual(lib.srs_grade(entry_id, 2, now + day), now + day + int(day * 2.5))
+		self.assertEqual(lib.srs_grade(entry_id, 0, now + 3 * day), now + 3 * day + 10 * 60)
+		due[entry_id] = now + 3 * day + 10 * 60
+		self.assertEqual(lib.srs_grade(min_entry_id + (3 << 16), 2, now), 0)
+		self.assertEqual(lib.srs_grade(entry_id, 4, now), 0)
+
+		for _ in range(20000):
+			entry_id = random.choice(entry_ids)
+			if entry_id not in due:
+				continue
+			t = now + random.randrange(-30 * day, 30 * day)
+			due[entry_id] = lib.srs_grade(entry_id, random.randrange(4), t)
+			self.assertGreater(due[entry_id], t)
+			if random.random() < 0.05:
+				lib.review_list_remove_entry(entry_id)
+				del due[entry_id]
+				self.assertEqual(lib.srs_grade(entry_id, 2, now), 0)
+		check()
+
+		# State survives reload, cards without it are new
+		lib.srs_write_state(lib.state_get_html_buffer())
+		state = read_html_buffer()
+		self.assertEqual(len(state), len(due) * 16)
+
+		self.clear_state()
+		self.init_state()
+		entry_ids = sorted(due.keys()) + [min_entry_id + (3 << 16) - 1]
+		buf = lib.review_list_import_buffer(len(entry_ids))
+		for i, entry_id in enumerate(entry_ids):
+			buf[i] = entry_id
+		lib.review_list_import(len(entry_ids))
+		due[entry_ids[-1]] = 0
+		self.assertEqual(len(get_due(now, len(due))), len(due))
+
+		memmove(lib.srs_import_buffer(len(state) // 16), state, len(state))
+		lib.srs_import(len(state) // 16)
+		check()
+		now += 10 * day
+		check()
+
+		# Cards don't fit reservation, so it's enlarged
+		reserved_sizes = (c_size_t * 11).in_dll(lib, 'reserved_sizes')
+		defaults = list(reserved_sizes)
+		try:
+			reserved_sizes[8] = 1 << 12
+			self.clear_state()
+			self.init_state()
+			due = {}
+			for entry_id in entry_ids:
+				lib.review_list_add_entry(entry_id)
+				due[entry_id] = 0
+			for entry_id in random.sample(entry_ids, 500):
+				due[entry_id] = lib.srs_grade(entry_id, random.randrange(4), now)
+			check()
+			self.assertGreater(lib.state_get_srs_buffer().contents.capacity, 1 << 12)
+		finally:
+			reserved_sizes[:] = defaults
+
+	def test_kanji_search(self):
+		lib.kanji_search.argtypes = [c_uint]
+		lib.kanji_search.restype = c_size_t
+		lib.make_kanji_html.argtypes = [c_uint]
+		lib.make_kanji_html.restype = None
+
+		def kanji_html(kanji, info_mask):
+			lib.state_clear()
+			self.assertEqual(lib.kanji_search(ord(kanji)), len(kanji.encode('utf-16-le')) // 2)
+			lib.make_kanji_html(info_mask)
+			html_buffer = lib.state_get_html_buffer().contents
+			return string_at(html_buffer.data, html_buffer.size).decode()
+
+		self.init_state()
+		all_info = (1 << 11) - 1
+		html = kanji_html('一', all_info)
+		self.assertIn('<span class="k-kanji">一</span>', html)
+		self.assertIn('radical<br/>1</td>', html)
+		self.assertIn('strokes<br/>1</td>', html)
+		self.assertIn('<div class="k-eigo">one, one radical (no.1)</div>', html)
+		self.assertIn('名乗り</span> かず い', html)
+		self.assertNotIn('部首名', html)
+		# "I" must not match "IN"
+		self.assertIn('Tuttle Kanji &amp; Kana</td><td class="k-mix-td0">2</td>', html)
+		self.assertIn('Tuttle Kanji Dictionary</td><td class="k-mix-td1">0a1.1</td>', html)
+		self.assertIn('<td class="k-mix-td0">4E00</td>', html)
+
+		html = kanji_html('書', 1 << 3)
+		self.assertIn('Kanji Learners Dictionary</td><td class="k-mix-td0">1703</td>', html)
+		self.assertNotIn('Halpern', html)
+		self.assertIn('<div class="k-yomi">ショ か.く -が.き -がき', html)
+
+		with open('../data/kanji.dat') as f:
+			kanji = [l[0] for l in f]
+		for k in random.sample(kanji, 200):
+			lib.state_clear()
+			self.assertEqual(lib.kanji_search(ord(k)), 1 if ord(k) < 0x10000 else 2)
+			self.assertEqual(lib.kanji_get_entry().contents.code_point, ord(k))
+
+		lib.state_clear()
+		for c in ['a', 'あ', '\U0002ffff', '\U0010ffff']:
+			self.assertEqual(lib.kanji_search(ord(c)), 0)
+
+	def test_radical_search(self):
+		lib.radical_get_names.argtypes = [pBuffer]
+		lib.radical_get_names.restype = None
+		lib.radical_search.argtypes = [pBuffer, POINTER(c_ubyte), c_size_t, c_uint, c_uint]
+		lib.radical_search.restype = None
+
+		codes = {}
+		with open('../data/kanji.dat') as f:
+			for l in f:
+				kanji_codes = {}
+				for code in l.split('|')[1].split():
+					key = ''.join(itertools.takewhile(str.isupper, code))
+					kanji_codes.setdefault(key, code[len(key):])
+				codes[l[0]] = kanji_codes
+		with open('../data/radicals.dat', encoding='utf-8-sig') as f:
+			radicals = [l.rstrip('\n').split('\t') for l in f]
+
+		self.init_state()
+		html_buffer = lib.state_get_html_buffer()
+		lib.radical_get_names(html_buffer)
+		names = string_at(html_buffer.contents.data, html_buffer.contents.size).decode().split('\n')
+		self.assertEqual(names, [r[0] for r in radicals])
+
+		def frequency_order(k):
+			return (int(codes.get(k, {}).get('F', 2**31)), int(codes.get(k, {}).get('S', 2**31)), ord(k))
+
+		def search(indices, min_strokes=0, max_strokes=255):
+			html_buffer.contents.size = 0
+			lib.radical_search(html_buffer, (c_ubyte * len(indices))(*indices), len(indices), min_strokes, max_strokes)
+			data = string_at(html_buffer.contents.data, html_buffer.contents.size)
+			return ''.join(map(chr, struct.unpack('<%dI' % (len(data) // 4), data)))
+
+		all_kanjis = sorted(set(itertools.chain.from_iterable(r[4] for r in radicals)))
+		random.seed(39)
+		for _ in range(300):
+			indices = random.sample(range(len(radicals)), random.randint(1, 3))
+			if random.random() < 0.5:
+				# Pick radicals of the same kanji, so intersection is not empty
+				kanji = random.choice(all_kanjis)
+				indices = [i for i, r in enumerate(radicals) if kanji in r[4]]
+			min_strokes, max_strokes = sorted(random.choices(range(0, 30), k=2)) if random.random() < 0.3 else (0, 255)
+
+			expected = set(radicals[indices[0]][4])
+			for i in indices[1:]:
+				expected &= set(radicals[i][4])
+			expected = [
+				k for k in sorted(expected, key=frequency_order)
+				if min_strokes <= int(codes.get(k, {}).get('S', 0)) <= max_strokes
+			]
+			self.assertEqual(search(indices, min_strokes, max_strokes), ''.join(expected))
+
+		self.assertEqual(search([]), '')
+		# 日 and 月
+		self.assertEqual(search([names.index('日'), names.index('月')])[0], '明')
+
+	def test_render_cache(self):
+		lib.search.argtypes = [c_size_t]
+		lib.search.restype = c_size_t
+
+		self.init_state()
+
+		def search_and_render(word):
+			lib.state_clear()
+			for i, c in enumerate(word):
+				self.state.contents.input.data[i] = ord(c)
+			self.assertEqual(lib.search(len(word)), len(word))
+			lib.make_html()
+			html_buffer = lib.state_get_html_buffer().contents
+			return pChar2str(c_void_p(html_buffer.data), html_buffer.size)
+
+		html = search_and_render('かく')
+		cache_size = lib.state_get_render_cache_buffer().contents.size
+		self.assertGreater(cache_size, 0)
+
+		self.assertEqual(search_and_render('かく'), html)
+		self.assertEqual(lib.state_get_render_cache_buffer().contents.size, cache_size)
+		# nothing was fetched
+		self.assertEqual(lib.state_get_raw_dentry_buffer().contents.size, 0)
+
+		entry_id = int(html.split('jmdict-id="', 1)[1].split('"', 1)[0])
+		lib.review_list_add_entry(entry_id)
+		reviewed_html = search_and_render('かく')
+		self.assertNotEqual(reviewed_html, html)
+		self.assertIn(' reviewed', reviewed_html)
+
+		context = '<書く> & more'.encode()
+		ptr = lib.review_list_context_buffer(len(context))
+		memmove(ptr, context, len(context))
+		lib.review_list_set_context(entry_id, len(context))
+		self.assertIn('&lt;書く&gt; &amp; more</p>', search_and_render('かく'))
+
+		lib.review_list_remove_entry(entry_id)
+		self.assertEqual(search_and_render('かく'), html)
+
 	def test_append(self):
 		lib.append.argtypes = [pBuffer, pChar, c_size_t]
 		lib.append.restype = None
@@ -1172,6 +1809,23 @@ class T(unittest.TestCase):
 			self.assertTrue(memory[:buf.size].strip())
 			buf.size = 0
 
+	@unittest.skipUnless(hasattr(lib, 'render_prerendered_definition'), 'dictionary built without --prerendered-html')
+	def test_render_prerendered_definition(self):
+		lib.render_prerendered_definition.argtypes = [pBuffer, pChar, pChar, c_bool]
+		lib.render_prerendered_definition.restype = None
+
+		fragment = b'<span class="a\x01">; </span><ul class="b\x02"><li>x</li></ul>'
+		start = makePChar(fragment)
+		end = cast(c_void_p(pointer_to_address(start) + len(fragment)), pChar)
+
+		memory, buf = make_buffer(256)
+		lib.render_prerendered_definition(byref(buf), start, end, False)
+		self.assertEqual(memory[:buf.size], b'<span class="a rikaigu-hidden">; </span><ul class="b"><li>x</li></ul>')
+
+		buf.size = 0
+		lib.render_prerendered_definition(byref(buf), start, end, True)
+		self.assertEqual(memory[:buf.size], b'<span class="a">; </span><ul class="b rikaigu-hidden"><li>x</li></ul>')
+
 	def test_render_dentry(self):
 		lib.render_dentry.argtypes = [pBuffer, pWordResult, pDentry, c_bool]
 		lib.render_dentry.restype = None
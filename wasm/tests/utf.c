@@ -1,3 +1,4 @@
+#include <string.h>
 
 #include "../src/utf.c"
 
@@ -38,6 +39,75 @@ void test_utf16_compare()
 	assert(utf16_compare(a4, sizeof(a4) / sizeof(char16_t) - 1, b4, sizeof(b4) / sizeof(char16_t) - 1) == 0);
 }
 
+int sign(int x)
+{
+	return (x > 0) - (x < 0);
+}
+
+int decoding_utf16_compare(const char16_t* a, const size_t alen, const char16_t* b, const size_t blen)
+{
+	// Code point by code point, like index.sort() on Python side
+	const char16_t* ait = a;
+	const char16_t* bit = b;
+	while (ait != a + alen && bit != b + blen)
+	{
+		const wchar_t achar = decode_utf16_wchar(&ait);
+		const wchar_t bchar = decode_utf16_wchar(&bit);
+		if (achar != bchar)
+		{
+			return achar < bchar ? -1 : 1;
+		}
+	}
+	return (int)alen - (int)blen;
+}
+
+size_t make_utf16_string(unsigned seed, size_t num_code_points, char16_t* out)
+{
+	// Kana, half-width katakana, private use area above surrogates
+	// and two astral characters sharing high surrogate
+	static const char16_t code_points[][2] = {
+		{ 0x3042, 0 }, { 0xFF76, 0 }, { 0xE000, 0 },
+		{ 0xD852, 0xDF62 }, { 0xD852, 0xDC00 },
+	};
+	size_t length = 0;
+	for (size_t i = 0; i < num_code_points; ++i)
+	{
+		const char16_t* c = code_points[seed % 5];
+		seed /= 5;
+		out[length++] = c[0];
+		if (c[1] != 0)
+		{
+			out[length++] = c[1];
+		}
+	}
+	return length;
+}
+
+void test_utf16_compare_fast_path()
+{
+	// Common prefix is longer than one vector, so difference
+	// falls both into vector and scalar parts of the scan
+	const char16_t prefix[] = u"あいうえおかきくけこ";
+	const size_t prefix_length = sizeof(prefix) / sizeof(char16_t) - 1;
+	for (size_t skip = 0; skip <= prefix_length; skip += 3)
+	{
+		for (unsigned i = 0; i < 5 * 5 * 5; ++i)
+		{
+			for (unsigned j = 0; j < 5 * 5 * 5; ++j)
+			{
+				char16_t a[32], b[32];
+				memcpy(a, prefix + skip, (prefix_length - skip) * sizeof(char16_t));
+				memcpy(b, prefix + skip, (prefix_length - skip) * sizeof(char16_t));
+				const size_t alen = prefix_length - skip + make_utf16_string(i, i % 4, a + prefix_length - skip);
+				const size_t blen = prefix_length - skip + make_utf16_string(j, j % 4, b + prefix_length - skip);
+
+				assert(sign(utf16_compare(a, alen, b, blen)) == sign(decoding_utf16_compare(a, alen, b, blen)));
+				assert(utf16_compare(a, alen, b, blen) == -utf16_compare(b, blen, a, alen));
+			}
+		}
+	}
+}
+
 void test_utf16_drop_code_point()
 {
 	const char16_t s1[] = u"ｵｶｷｸｹｺ";
@@ -47,6 +117,56 @@ void test_utf16_drop_code_point()
 	assert(utf16_drop_code_point(s2, 4) == 2);
 }
 
+size_t reference_kata_to_hira(char16_t* data, const size_t length, uint32_t* length_mapping)
+{
+	// Character by character, as it was before vectorization
+	char16_t previous = 0;
+	size_t out_length = 0;
+	length_mapping[0] = 0;
+	for (size_t i = 0; i < length; ++i)
+	{
+		kata_to_hira_one(data, i, &out_length, length_mapping, &previous);
+	}
+	return out_length;
+}
+
+void test_utf16_kata_to_hira()
+{
+	static const char16_t alphabet[] = u"アカガヶァヴーｰｶｻﾊﾜﾝﾞﾟあa漢";
+	const size_t alphabet_size = sizeof(alphabet) / sizeof(char16_t) - 1;
+
+	unsigned seed = 1;
+	for (size_t n = 0; n < 2000; ++n)
+	{
+		const size_t length = n % 97;
+		char16_t text[97], expected[97];
+		uint32_t mapping[98], expected_mapping[98];
+		for (size_t i = 0; i < length; ++i)
+		{
+			seed = seed * 1103515245 + 12345;
+			// Mostly full-width katakana, so vector chunks happen
+			const size_t k = (seed >> 16) % (4 * alphabet_size);
+			text[i] = alphabet[k < alphabet_size ? k : (k % 4)];
+		}
+		memcpy(expected, text, sizeof(text));
+
+		const size_t expected_length = reference_kata_to_hira(expected, length, expected_mapping);
+		const size_t converted_length = utf16_kata_to_hira(text, length, mapping);
+		assert(converted_length == expected_length);
+		assert(memcmp(text, expected, converted_length * sizeof(char16_t)) == 0);
+		assert(memcmp(mapping, expected_mapping, (converted_length + 1) * sizeof(uint32_t)) == 0);
+	}
+
+	char16_t text[] = u"カタカナ　ﾊﾟｰﾃｨｰ　コーヒー　ヴァイオリン";
+	const char16_t expected[] = u"かたかな　ぱあてぃー　こうひい　ゔぁいおりん";
+	uint32_t mapping[sizeof(text) / sizeof(char16_t)];
+	const size_t length = utf16_kata_to_hira(text, sizeof(text) / sizeof(char16_t) - 1, mapping);
+	assert(length == sizeof(expected) / sizeof(char16_t) - 1);
+	assert(memcmp(text, expected, length * sizeof(char16_t)) == 0);
+	// ﾊﾟ became one character
+	assert(mapping[5] == 5 && mapping[6] == 7 && mapping[7] == 8);
+}
+
 void test_decode_utf8_wchar()
 {
 	const char single[] = u8"a";
@@ -89,7 +209,9 @@ int main()
 {
 	test_decode_utf16_wchar();
 	test_utf16_compare();
+	test_utf16_compare_fast_path();
 	test_utf16_drop_code_point();
+	test_utf16_kata_to_hira();
 	test_decode_utf8_wchar();
 	test_utf16_utf8_kata_to_hira_eq();
 